@@ -0,0 +1,178 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <ostream>
+
+/*
+* 单调分配的内存池：只分配不单独释放，reset()一次性回收全部(保留已申请的块，下次复用)。
+* 不是线程安全的，一批结果一个Arena。用法:
+*   Arena arena;
+*   std::vector<T_TaskRecordView> rows;
+*   RowMapper<T_TaskRecordView> mapper(*res);
+*   mapper.decodeAll(*res, rows, arena);
+*   ...使用rows...
+*   rows.clear(); arena.reset(); //StrRef全部失效
+* 在sql::ResultSet上解码时Connector/C++每个字符串字段仍会临时分配一次SQLString，
+* 只有NativeStatement上是零分配的，见row_mapper.h的readColumn。
+*/
+class Arena
+{
+  public:
+    explicit Arena(size_t block_size = 64 * 1024)
+    {
+        block_size_ = std::max<size_t>(block_size, 256);
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        size_t offset = (used_ + align - 1) & ~(align - 1);
+        if (current_ >= blocks_.size() || offset + size > blocks_[current_].size)
+        {
+            nextBlock(size + align);
+            offset = (used_ + align - 1) & ~(align - 1);
+        }
+        used_ = offset + size;
+        allocated_ += size;
+        return blocks_[current_].data.get() + offset;
+    }
+
+    //复制一段字符串，末尾补'\0'，方便传给C接口
+    const char *copy(const char *s, size_t len)
+    {
+        char *dst = static_cast<char *>(allocate(len + 1, 1));
+        memcpy(dst, s, len);
+        dst[len] = '\0';
+        return dst;
+    }
+
+    //回收全部内存，已申请的块留着复用；超大的块直接释放，避免一批异常数据后一直占着内存
+    void reset()
+    {
+        blocks_.erase(std::remove_if(blocks_.begin(), blocks_.end(), [this](const Block &b) {
+                          return b.size > block_size_;
+                      }),
+                      blocks_.end());
+        current_ = 0;
+        used_ = 0;
+        allocated_ = 0;
+    }
+
+    //已分配给调用者的字节数
+    size_t allocated() const
+    {
+        return allocated_;
+    }
+
+    //向系统申请的字节数
+    size_t reserved() const
+    {
+        size_t total = 0;
+        for (const auto &b : blocks_)
+        {
+            total += b.size;
+        }
+        return total;
+    }
+
+  private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    void nextBlock(size_t min_size)
+    {
+        used_ = 0;
+        if (!blocks_.empty() && current_ + 1 < blocks_.size() && blocks_[current_ + 1].size >= min_size)
+        { //reset后复用已有的块
+            current_++;
+            return;
+        }
+        size_t size = std::max(block_size_, min_size);
+        Block b{std::unique_ptr<char[]>(new char[size]), size};
+        if (blocks_.empty())
+        {
+            blocks_.push_back(std::move(b));
+            current_ = 0;
+        }
+        else
+        { //放在当前块后面，后面的空闲块仍然可以复用
+            current_ = std::min(current_ + 1, blocks_.size());
+            blocks_.insert(blocks_.begin() + current_, std::move(b));
+        }
+    }
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+    size_t allocated_ = 0;
+};
+
+/*
+* 指向Arena里的字符串，不拥有内存，Arena reset或者析构后失效
+*/
+struct StrRef
+{
+    const char *data = "";
+    uint32_t size = 0;
+
+    StrRef() = default;
+
+    StrRef(const char *d, size_t len)
+    {
+        data = d;
+        size = static_cast<uint32_t>(len);
+    }
+
+    bool empty() const
+    {
+        return size == 0;
+    }
+
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+
+    bool operator==(const StrRef &other) const
+    {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+
+    bool operator!=(const StrRef &other) const
+    {
+        return !(*this == other);
+    }
+
+    bool operator==(const std::string &other) const
+    {
+        return size == other.size() && memcmp(data, other.data(), size) == 0;
+    }
+
+    bool operator!=(const std::string &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const StrRef &s)
+{
+    return os.write(s.data, s.size);
+}
+
+inline StrRef arenaString(Arena &arena, const char *s, size_t len)
+{
+    return StrRef(arena.copy(s, len), len);
+}
+#endif
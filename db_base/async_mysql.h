@@ -0,0 +1,959 @@
+#ifndef ASYNC_MYSQL_H_
+#define ASYNC_MYSQL_H_
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "mysql/mysql.h"
+#include "arena.h"
+#include "db_driver.h"
+#include "retry_policy.h"
+#include "query_context.h"
+
+#ifndef MYSQL_WAIT_READ
+#error "async_mysql.h需要MariaDB Connector/C的非阻塞接口(mysql_*_start/_cont)，链接-lmariadb"
+#endif
+
+/*
+* 基于MariaDB Connector/C非阻塞接口和epoll的异步查询，少量线程复用所有连接，
+* 不再需要每个进行中的查询占一个线程。用法:
+*   auto db = std::make_shared<AsyncMySql>();
+*   db->init(opt, 32, 2); //32个连接，2个事件循环线程
+*   db->query("SELECT id, task_id FROM t WHERE uid=" + std::to_string(uid), [](const std::shared_ptr<AsyncResult> &res) {
+*       while (res->next()) { ... }
+*   });
+*   auto fut = db->query("UPDATE ..."); fut.get()->affectedRows();
+* 回调在事件循环线程里执行，不能阻塞，也不能抛异常。只支持文本协议，sql里的字符串要自己转义。
+*/
+
+class AsyncResult
+{
+  public:
+    AsyncResult() = default;
+    AsyncResult(const AsyncResult &) = delete;
+    AsyncResult &operator=(const AsyncResult &) = delete;
+
+    ~AsyncResult()
+    {
+        if (res_)
+        {
+            mysql_free_result(res_); //结果已经全部读到客户端，释放时不会有网络操作
+        }
+    }
+
+    //0：成功；>0：mysql错误码；-2：连接无效或者已经停止；-4：排队超过截止时间，语句没有执行
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    const std::string &errorMsg() const
+    {
+        return error_msg_;
+    }
+
+    uint64_t affectedRows() const
+    {
+        return affected_rows_;
+    }
+
+    uint64_t insertId() const
+    {
+        return insert_id_;
+    }
+
+    uint64_t rowCount() const
+    {
+        return res_ ? mysql_num_rows(res_) : 0;
+    }
+
+    //排队等待连接的时间和执行时间
+    uint64_t queueUs() const
+    {
+        return queue_us_;
+    }
+
+    uint64_t executeUs() const
+    {
+        return execute_us_;
+    }
+
+    bool next()
+    {
+        if (!res_)
+        {
+            return false;
+        }
+        row_ = mysql_fetch_row(res_);
+        lengths_ = row_ ? mysql_fetch_lengths(res_) : nullptr;
+        return row_ != nullptr;
+    }
+
+    uint32_t findColumn(const char *name) const
+    {
+        for (uint32_t i = 0; i < field_count_; i++)
+        {
+            if (strcasecmp(fields_[i].name, name) == 0)
+            {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    bool isNull(uint32_t idx) const
+    {
+        return !row_ || idx == 0 || idx > field_count_ || !row_[idx - 1];
+    }
+
+    int32_t getInt(uint32_t idx) const
+    {
+        return static_cast<int32_t>(getInt64(idx));
+    }
+
+    uint32_t getUInt(uint32_t idx) const
+    {
+        return static_cast<uint32_t>(getUInt64(idx));
+    }
+
+    int64_t getInt64(uint32_t idx) const
+    {
+        return isNull(idx) ? 0 : strtoll(row_[idx - 1], nullptr, 10);
+    }
+
+    uint64_t getUInt64(uint32_t idx) const
+    {
+        return isNull(idx) ? 0 : strtoull(row_[idx - 1], nullptr, 10);
+    }
+
+    double getDouble(uint32_t idx) const
+    {
+        return isNull(idx) ? 0 : strtod(row_[idx - 1], nullptr);
+    }
+
+    //指向结果集内部，和AsyncResult同生命周期
+    StrRef getString(uint32_t idx) const
+    {
+        return isNull(idx) ? StrRef() : StrRef(row_[idx - 1], lengths_[idx - 1]);
+    }
+
+  private:
+    friend class AsyncLoop;
+    friend class AsyncMySql;
+
+    void setResult(MYSQL_RES *res)
+    {
+        res_ = res;
+        field_count_ = mysql_num_fields(res_);
+        fields_ = mysql_fetch_fields(res_);
+    }
+
+    int error_code_ = 0;
+    std::string error_msg_;
+    uint64_t affected_rows_ = 0;
+    uint64_t insert_id_ = 0;
+    uint64_t queue_us_ = 0;
+    uint64_t execute_us_ = 0;
+    MYSQL_RES *res_ = nullptr;
+    MYSQL_FIELD *fields_ = nullptr;
+    uint32_t field_count_ = 0;
+    MYSQL_ROW row_ = nullptr;
+    unsigned long *lengths_ = nullptr;
+};
+
+using ASYNC_CALLBACK = std::function<void(const std::shared_ptr<AsyncResult> &)>;
+//连接失败的回调，参数为mysql错误码和错误信息，在事件循环线程里调用，不能阻塞
+using ASYNC_CONNECT_ERROR_CB = std::function<void(int, const std::string &)>;
+
+struct AsyncTask
+{
+    std::string sql;
+    ASYNC_CALLBACK cb;
+    std::chrono::steady_clock::time_point enqueue_time;
+    std::chrono::steady_clock::time_point deadline; //排队超过这个时间还没开始执行就返回-4
+};
+
+/*
+* 一个事件循环线程和它负责的连接，连接只在本线程里操作，其他线程通过post()投递查询
+*/
+class AsyncLoop
+{
+  public:
+    using CLOCK = std::chrono::steady_clock;
+
+    AsyncLoop(const DriverOptions &opt, size_t conn_count, const ASYNC_CONNECT_ERROR_CB &connect_error_cb = nullptr)
+    {
+        opt_ = opt;
+        connect_error_cb_ = connect_error_cb;
+        conns_.resize(std::max<size_t>(conn_count, 1));
+        for (auto &c : conns_)
+        {
+            c.reset(new AsyncConn);
+        }
+    }
+
+    AsyncLoop(const AsyncLoop &) = delete;
+    AsyncLoop &operator=(const AsyncLoop &) = delete;
+
+    ~AsyncLoop()
+    {
+        stop();
+    }
+
+    int start()
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || event_fd_ < 0)
+        {
+            return -1;
+        }
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr; //nullptr表示eventfd
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev);
+        {
+            std::lock_guard<std::mutex> lck(incoming_mutex_);
+            stopped_ = false;
+        }
+        exit_atm_ = false;
+        thread_ = std::thread(&AsyncLoop::run, this);
+        return 0;
+    }
+
+    //停止事件循环，没有完成的查询以-2回调
+    void stop()
+    {
+        if (thread_.joinable())
+        {
+            exit_atm_ = true;
+            wakeup();
+            thread_.join();
+        }
+        if (event_fd_ >= 0)
+        {
+            close(event_fd_);
+            event_fd_ = -1;
+        }
+        if (epoll_fd_ >= 0)
+        {
+            close(epoll_fd_);
+            epoll_fd_ = -1;
+        }
+    }
+
+    //线程安全，可以在任意线程(包括回调里)调用；循环已经停止时直接在调用线程以-2回调
+    void post(AsyncTask &&task)
+    {
+        pending_atm_++;
+        {
+            std::lock_guard<std::mutex> lck(incoming_mutex_);
+            if (!stopped_)
+            {
+                incoming_.push_back(std::move(task));
+                wakeup(); //在锁里唤醒，循环线程这时还没退出，event_fd_有效
+                return;
+            }
+        }
+        fail(task, -2, "async loop stopped");
+    }
+
+    //还没完成的查询数
+    size_t pending() const
+    {
+        return pending_atm_.load();
+    }
+
+    size_t connected() const
+    {
+        return connected_atm_.load();
+    }
+
+    uint64_t connectFailures() const
+    {
+        return connect_failures_atm_.load();
+    }
+
+  private:
+    enum E_ASYNC_STATE
+    {
+        E_ASYNC_BROKEN = 0,     //未连接，等待重连
+        E_ASYNC_CONNECTING = 1,
+        E_ASYNC_IDLE = 2,
+        E_ASYNC_QUERYING = 3,   //mysql_real_query
+        E_ASYNC_STORING = 4,    //mysql_store_result
+    };
+
+    struct AsyncConn
+    {
+        MYSQL *mysql = nullptr;
+        int fd = -1; //已经加入epoll的socket
+        E_ASYNC_STATE state = E_ASYNC_BROKEN;
+        bool has_deadline = false;
+        CLOCK::time_point deadline; //非阻塞接口要求的超时时间，或者重连时间
+        AsyncTask task;
+        CLOCK::time_point start_time;
+        MYSQL *connect_ret = nullptr;
+        int query_ret = 0;
+        MYSQL_RES *store_ret = nullptr;
+    };
+
+    //用函数而不是static constexpr成员，C++14里按引用使用(ODR-use)时成员需要类外定义
+    static constexpr int reconnectIntervalMs()
+    {
+        return 1000;
+    }
+
+    void wakeup()
+    {
+        uint64_t one = 1;
+        ssize_t n = write(event_fd_, &one, sizeof(one));
+        (void)n;
+    }
+
+    void run()
+    {
+        for (auto &c : conns_)
+        {
+            startConnect(*c);
+        }
+
+        epoll_event events[64];
+        while (!exit_atm_)
+        {
+            int n = epoll_wait(epoll_fd_, events, 64, waitTimeoutMs());
+            for (int i = 0; i < n; i++)
+            {
+                if (!events[i].data.ptr)
+                {
+                    uint64_t count;
+                    ssize_t r = read(event_fd_, &count, sizeof(count));
+                    (void)r;
+                    continue;
+                }
+                onSocketEvent(*static_cast<AsyncConn *>(events[i].data.ptr), events[i].events);
+            }
+            takeIncoming();
+            checkTimeouts();
+            dispatch();
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(incoming_mutex_);
+            stopped_ = true; //之后post的查询不再入队
+        }
+        takeIncoming();
+        for (auto &c : conns_)
+        {
+            if (c->state == E_ASYNC_QUERYING || c->state == E_ASYNC_STORING)
+            {
+                fail(c->task, -2, "async loop stopped");
+            }
+            closeConn(*c);
+        }
+        while (!pending_.empty())
+        {
+            fail(pending_.front(), -2, "async loop stopped");
+            pending_.pop_front();
+        }
+    }
+
+    int waitTimeoutMs() const
+    {
+        auto now = CLOCK::now();
+        auto wake = now + std::chrono::milliseconds(1000);
+        for (const auto &c : conns_)
+        {
+            if (c->has_deadline)
+            {
+                wake = std::min(wake, c->deadline);
+            }
+        }
+        if (!pending_.empty())
+        {
+            wake = std::min(wake, pending_.front().deadline);
+        }
+        return wake <= now ? 0 : static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count()) + 1;
+    }
+
+    void takeIncoming()
+    {
+        std::vector<AsyncTask> tasks;
+        {
+            std::lock_guard<std::mutex> lck(incoming_mutex_);
+            tasks.swap(incoming_);
+        }
+        for (auto &t : tasks)
+        {
+            pending_.push_back(std::move(t));
+        }
+    }
+
+    void checkTimeouts()
+    {
+        auto now = CLOCK::now();
+        for (auto &c : conns_)
+        {
+            if (!c->has_deadline || c->deadline > now)
+            {
+                continue;
+            }
+            c->has_deadline = false;
+            if (c->state == E_ASYNC_BROKEN)
+            {
+                startConnect(*c);
+            }
+            else
+            {
+                resume(*c, MYSQL_WAIT_TIMEOUT);
+            }
+        }
+
+        //排队超时的查询直接失败，不再执行
+        for (auto it = pending_.begin(); it != pending_.end();)
+        {
+            if (it->deadline <= now)
+            {
+                fail(*it, -4, "queue timeout");
+                it = pending_.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    //把排队的查询分给空闲连接
+    void dispatch()
+    {
+        for (auto &c : conns_)
+        {
+            if (pending_.empty())
+            {
+                return;
+            }
+            if (c->state == E_ASYNC_IDLE)
+            {
+                advance(*c, startNext(*c));
+            }
+        }
+    }
+
+    void onSocketEvent(AsyncConn &c, uint32_t events)
+    {
+        if (c.state == E_ASYNC_IDLE || c.state == E_ASYNC_BROKEN)
+        { //空闲时socket可读或挂断，说明服务端关闭了连接(wait_timeout、重启等)
+            startConnect(c);
+            return;
+        }
+
+        int status = 0;
+        if (events & EPOLLIN)
+        {
+            status |= MYSQL_WAIT_READ;
+        }
+        if (events & EPOLLOUT)
+        {
+            status |= MYSQL_WAIT_WRITE;
+        }
+        if (events & EPOLLPRI)
+        {
+            status |= MYSQL_WAIT_EXCEPT;
+        }
+        if (events & (EPOLLERR | EPOLLHUP))
+        { //交给客户端库去读写，由它报告错误
+            status |= MYSQL_WAIT_READ | MYSQL_WAIT_WRITE;
+        }
+        c.has_deadline = false;
+        resume(c, status);
+    }
+
+    //socket就绪或超时后，继续当前的非阻塞操作
+    void resume(AsyncConn &c, int events)
+    {
+        int status = 0;
+        switch (c.state)
+        {
+        case E_ASYNC_CONNECTING:
+            status = mysql_real_connect_cont(&c.connect_ret, c.mysql, events);
+            break;
+        case E_ASYNC_QUERYING:
+            status = mysql_real_query_cont(&c.query_ret, c.mysql, events);
+            break;
+        case E_ASYNC_STORING:
+            status = mysql_store_result_cont(&c.store_ret, c.mysql, events);
+            break;
+        default:
+            return;
+        }
+        advance(c, status);
+    }
+
+    /*
+    * @fun:根据start/cont的返回值推进连接的状态
+    * @param[in] status 0表示当前操作已完成，否则是需要等待的事件(MYSQL_WAIT_*)
+    */
+    void advance(AsyncConn &c, int status)
+    {
+        while (status == 0)
+        {
+            switch (c.state)
+            {
+            case E_ASYNC_CONNECTING:
+                if (!c.connect_ret)
+                {
+                    connect_failures_atm_++;
+                    if (connect_error_cb_)
+                    {
+                        connect_error_cb_(static_cast<int>(mysql_errno(c.mysql)), mysql_error(c.mysql));
+                    }
+                    scheduleReconnect(c);
+                    return;
+                }
+                connected_atm_++;
+                c.state = E_ASYNC_IDLE;
+                status = startNext(c);
+                break;
+            case E_ASYNC_QUERYING:
+                if (c.query_ret != 0)
+                {
+                    if (finishError(c))
+                    {
+                        return;
+                    }
+                    status = startNext(c);
+                    break;
+                }
+                c.state = E_ASYNC_STORING;
+                status = mysql_store_result_start(&c.store_ret, c.mysql);
+                break;
+            case E_ASYNC_STORING:
+                if (!c.store_ret && mysql_field_count(c.mysql) != 0)
+                { //应该有结果集但是读取失败
+                    if (finishError(c))
+                    {
+                        return;
+                    }
+                    status = startNext(c);
+                    break;
+                }
+                finishResult(c);
+                status = startNext(c);
+                break;
+            default:
+                return;
+            }
+            if (c.state == E_ASYNC_IDLE)
+            {
+                waitFor(c, 0);
+                return;
+            }
+        }
+        waitFor(c, status);
+    }
+
+    /*
+    * @fun:空闲连接取一条排队的查询开始执行
+    * @return mysql_real_query_start的返回值；没有排队的查询时返回0，连接保持空闲
+    */
+    int startNext(AsyncConn &c)
+    {
+        c.state = E_ASYNC_IDLE;
+        auto now = CLOCK::now();
+        while (!pending_.empty() && pending_.front().deadline <= now)
+        {
+            fail(pending_.front(), -4, "queue timeout");
+            pending_.pop_front();
+        }
+        if (pending_.empty())
+        {
+            return 0;
+        }
+        c.task = std::move(pending_.front());
+        pending_.pop_front();
+        c.state = E_ASYNC_QUERYING;
+        c.start_time = now;
+        return mysql_real_query_start(&c.query_ret, c.mysql, c.task.sql.data(), c.task.sql.size());
+    }
+
+    void finishResult(AsyncConn &c)
+    {
+        std::shared_ptr<AsyncResult> res = std::make_shared<AsyncResult>();
+        if (c.store_ret)
+        {
+            res->setResult(c.store_ret);
+            c.store_ret = nullptr;
+        }
+        else
+        {
+            res->affected_rows_ = mysql_affected_rows(c.mysql);
+            res->insert_id_ = mysql_insert_id(c.mysql);
+        }
+        complete(c, res);
+    }
+
+    //查询出错时回调；连接类错误顺便重连，返回true表示连接已经不可用
+    bool finishError(AsyncConn &c)
+    {
+        std::shared_ptr<AsyncResult> res = std::make_shared<AsyncResult>();
+        int err = mysql_errno(c.mysql);
+        res->error_code_ = err > 0 ? err : -2;
+        res->error_msg_ = mysql_error(c.mysql);
+        complete(c, res);
+        if (err == 0 || isConnectionError(err))
+        {
+            startConnect(c);
+            return true;
+        }
+        return false;
+    }
+
+    void complete(AsyncConn &c, const std::shared_ptr<AsyncResult> &res)
+    {
+        auto now = CLOCK::now();
+        res->queue_us_ = std::chrono::duration_cast<std::chrono::microseconds>(c.start_time - c.task.enqueue_time).count();
+        res->execute_us_ = std::chrono::duration_cast<std::chrono::microseconds>(now - c.start_time).count();
+        AsyncTask task = std::move(c.task);
+        c.task = AsyncTask();
+        c.state = E_ASYNC_IDLE;
+        pending_atm_--;
+        if (task.cb)
+        {
+            task.cb(res);
+        }
+    }
+
+    void fail(AsyncTask &task, int error_code, const char *msg)
+    {
+        std::shared_ptr<AsyncResult> res = std::make_shared<AsyncResult>();
+        res->error_code_ = error_code;
+        res->error_msg_ = msg;
+        res->queue_us_ = std::chrono::duration_cast<std::chrono::microseconds>(CLOCK::now() - task.enqueue_time).count();
+        pending_atm_--;
+        if (task.cb)
+        {
+            task.cb(res);
+        }
+    }
+
+    void startConnect(AsyncConn &c)
+    {
+        closeConn(c);
+        c.mysql = mysql_init(nullptr);
+        if (!c.mysql)
+        {
+            scheduleReconnect(c);
+            return;
+        }
+        mysql_options(c.mysql, MYSQL_OPT_NONBLOCK, 0);
+        unsigned int timeout = opt_.connect_timeout_s;
+        mysql_options(c.mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+        if (opt_.read_timeout_s > 0)
+        {
+            timeout = opt_.read_timeout_s;
+            mysql_options(c.mysql, MYSQL_OPT_READ_TIMEOUT, &timeout);
+        }
+        if (opt_.write_timeout_s > 0)
+        {
+            timeout = opt_.write_timeout_s;
+            mysql_options(c.mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+        }
+        mysql_options(c.mysql, MYSQL_SET_CHARSET_NAME, opt_.charset.c_str());
+
+        c.state = E_ASYNC_CONNECTING;
+        c.connect_ret = nullptr;
+        int status = mysql_real_connect_start(&c.connect_ret, c.mysql, opt_.host.c_str(), opt_.user.c_str(), opt_.password.c_str(),
+                                              opt_.schema.empty() ? nullptr : opt_.schema.c_str(), opt_.port, nullptr, 0);
+        advance(c, status);
+    }
+
+    void scheduleReconnect(AsyncConn &c)
+    {
+        closeConn(c);
+        c.has_deadline = true;
+        c.deadline = CLOCK::now() + std::chrono::milliseconds(reconnectIntervalMs());
+    }
+
+    void closeConn(AsyncConn &c)
+    {
+        if (c.fd >= 0)
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+            c.fd = -1;
+        }
+        if (c.state == E_ASYNC_IDLE || c.state == E_ASYNC_QUERYING || c.state == E_ASYNC_STORING)
+        {
+            connected_atm_--;
+        }
+        if (c.store_ret)
+        {
+            mysql_free_result(c.store_ret);
+            c.store_ret = nullptr;
+        }
+        if (c.mysql)
+        {
+            mysql_close(c.mysql); //连接已断开或者在退出时，不会长时间阻塞
+            c.mysql = nullptr;
+        }
+        c.state = E_ASYNC_BROKEN;
+        c.has_deadline = false;
+    }
+
+    /*
+    * @fun:按非阻塞接口要求的事件注册epoll，status为0表示空闲，不关注任何事件(挂断仍然会通知)
+    */
+    void waitFor(AsyncConn &c, int status)
+    {
+        int fd = mysql_get_socket(c.mysql);
+        epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = &c;
+        if (status & MYSQL_WAIT_READ)
+        {
+            ev.events |= EPOLLIN;
+        }
+        if (status & MYSQL_WAIT_WRITE)
+        {
+            ev.events |= EPOLLOUT;
+        }
+        if (status & MYSQL_WAIT_EXCEPT)
+        {
+            ev.events |= EPOLLPRI;
+        }
+        if (c.state == E_ASYNC_IDLE)
+        {
+            ev.events |= EPOLLRDHUP;
+        }
+        c.has_deadline = (status & MYSQL_WAIT_TIMEOUT) != 0;
+        if (c.has_deadline)
+        {
+            c.deadline = CLOCK::now() + std::chrono::milliseconds(mysql_get_timeout_value_ms(c.mysql));
+        }
+
+        if (fd < 0)
+        {
+            return;
+        }
+        if (c.fd != fd)
+        {
+            if (c.fd >= 0)
+            {
+                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+            }
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+            c.fd = fd;
+        }
+        else
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+        }
+    }
+
+    DriverOptions opt_;
+    ASYNC_CONNECT_ERROR_CB connect_error_cb_;
+    std::vector<std::unique_ptr<AsyncConn>> conns_;
+    std::deque<AsyncTask> pending_; //只在循环线程里访问
+    std::mutex incoming_mutex_;
+    std::vector<AsyncTask> incoming_;
+    bool stopped_ = false; //受incoming_mutex_保护
+    std::atomic<size_t> pending_atm_{0};
+    std::atomic<size_t> connected_atm_{0};
+    std::atomic<uint64_t> connect_failures_atm_{0};
+    std::atomic<bool> exit_atm_{false};
+    int epoll_fd_ = -1;
+    int event_fd_ = -1;
+    std::thread thread_;
+};
+
+class AsyncMySql
+{
+  public:
+    AsyncMySql() = default;
+    AsyncMySql(const AsyncMySql &) = delete;
+    AsyncMySql &operator=(const AsyncMySql &) = delete;
+
+    ~AsyncMySql()
+    {
+        uninit();
+    }
+
+    /*
+    * @fun:设置连接失败的回调，在init之前调用。连不上时每个连接每秒回调一次，不设置时只计数(见connectFailures)
+    */
+    void onConnectError(const ASYNC_CONNECT_ERROR_CB &cb)
+    {
+        std::lock_guard<std::mutex> lck(loops_mutex_);
+        connect_error_cb_ = cb;
+    }
+
+    /*
+    * @fun:建立事件循环，连接在各自的循环线程里异步建立，连不上时每秒重试
+    * @param[in] opt 连接参数
+    * @param[in] conn_count 连接总数，平均分给各个循环
+    * @param[in] loop_count 事件循环线程数
+    * @param[in] queue_timeout_ms 查询排队等连接的最长时间，超过后以-4回调；调用者有QueryDeadline时取较早的
+    * @return 0：成功；-1：参数错误或者创建epoll失败
+    */
+    int init(const DriverOptions &opt, size_t conn_count, size_t loop_count = 1, uint32_t queue_timeout_ms = 3000)
+    {
+        std::lock_guard<std::mutex> lck(loops_mutex_);
+        if (initialized_ || conn_count == 0 || loop_count == 0)
+        {
+            return -1;
+        }
+
+        static std::once_flag init_flag;
+        std::call_once(init_flag, []() { mysql_library_init(0, nullptr, nullptr); });
+
+        loop_count = std::min(loop_count, conn_count);
+        queue_timeout_ms_ = queue_timeout_ms;
+        for (size_t i = 0; i < loop_count; i++)
+        {
+            size_t count = conn_count / loop_count + (i < conn_count % loop_count ? 1 : 0);
+            loops_.emplace_back(std::make_shared<AsyncLoop>(opt, count, connect_error_cb_));
+            if (loops_.back()->start() != 0)
+            {
+                loops_.clear();
+                return -1;
+            }
+        }
+        initialized_ = true;
+        return 0;
+    }
+
+    /*
+    * @fun:停止事件循环，没有完成的查询以-2回调。可以和query()并发调用，
+    *      并发的query要么在停止前入队，要么直接以-2回调。不能在回调(事件循环线程)里调用
+    */
+    void uninit()
+    {
+        std::vector<std::shared_ptr<AsyncLoop>> loops;
+        {
+            std::lock_guard<std::mutex> lck(loops_mutex_);
+            loops.swap(loops_);
+            initialized_ = false;
+        }
+        for (auto &loop : loops)
+        {
+            loop->stop();
+        }
+    }
+
+    /*
+    * @fun:投递一条查询，完成后在事件循环线程里回调
+    * @param[in] sql 文本sql，不支持多语句
+    * @param[in] cb 回调，参数为结果，errorCode()不为0时表示失败
+    */
+    void query(const std::string &sql, ASYNC_CALLBACK cb)
+    {
+        AsyncTask task;
+        task.sql = sql;
+        task.cb = std::move(cb);
+        task.enqueue_time = AsyncLoop::CLOCK::now();
+        task.deadline = task.enqueue_time + std::chrono::milliseconds(queue_timeout_ms_);
+        QueryDeadline::CLOCK::time_point ctx_deadline;
+        if (QueryDeadline::current(ctx_deadline) && ctx_deadline < task.deadline)
+        {
+            task.deadline = ctx_deadline;
+        }
+
+        std::shared_ptr<AsyncLoop> best;
+        {
+            std::lock_guard<std::mutex> lck(loops_mutex_);
+            if (!loops_.empty())
+            { //排队最少的循环
+                size_t start = next_loop_atm_++ % loops_.size();
+                best = loops_[start];
+                for (size_t i = 1; i < loops_.size(); i++)
+                {
+                    const auto &loop = loops_[(start + i) % loops_.size()];
+                    if (loop->pending() < best->pending())
+                    {
+                        best = loop;
+                    }
+                }
+            }
+        }
+        if (!best)
+        {
+            std::shared_ptr<AsyncResult> res = std::make_shared<AsyncResult>();
+            res->error_code_ = -2;
+            if (task.cb)
+            {
+                task.cb(res);
+            }
+            return;
+        }
+        best->post(std::move(task)); //不持有loops_mutex_，回调里可以再调用query
+    }
+
+    //同query，通过future取结果，不要在回调(事件循环线程)里等待
+    std::future<std::shared_ptr<AsyncResult>> query(const std::string &sql)
+    {
+        auto promise = std::make_shared<std::promise<std::shared_ptr<AsyncResult>>>();
+        std::future<std::shared_ptr<AsyncResult>> fut = promise->get_future();
+        query(sql, [promise](const std::shared_ptr<AsyncResult> &res) { promise->set_value(res); });
+        return fut;
+    }
+
+    //还没完成的查询数
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lck(loops_mutex_);
+        size_t count = 0;
+        for (const auto &loop : loops_)
+        {
+            count += loop->pending();
+        }
+        return count;
+    }
+
+    //已经连上的连接数
+    size_t connected() const
+    {
+        std::lock_guard<std::mutex> lck(loops_mutex_);
+        size_t count = 0;
+        for (const auto &loop : loops_)
+        {
+            count += loop->connected();
+        }
+        return count;
+    }
+
+    //建立连接失败的次数，包括每秒的重连
+    uint64_t connectFailures() const
+    {
+        std::lock_guard<std::mutex> lck(loops_mutex_);
+        uint64_t count = 0;
+        for (const auto &loop : loops_)
+        {
+            count += loop->connectFailures();
+        }
+        return count;
+    }
+
+  private:
+    mutable std::mutex loops_mutex_;
+    std::vector<std::shared_ptr<AsyncLoop>> loops_; //query()只在锁里选循环，uninit()停止时query可能还持有引用
+    std::atomic<size_t> next_loop_atm_{0};
+    uint32_t queue_timeout_ms_ = 3000;
+    bool initialized_ = false;
+    ASYNC_CONNECT_ERROR_CB connect_error_cb_;
+};
+#endif
@@ -0,0 +1,554 @@
+#ifndef COLUMNAR_RESULT_H_
+#define COLUMNAR_RESULT_H_
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "row_cursor.h"
+
+/*
+* 按列存放的结果集，数值列是连续的数组，字符串列是 offsets+bytes，适合对大量行做客户端过滤和聚合。用法:
+*   ColumnarResult cols;
+*   cols.addColumn<uint32_t>("duration").addColumn<uint32_t>("file_size").addColumn<uint32_t>("start_dts");
+*   cols.load(*table.select({"duration", "file_size", "start_dts"}).where("appid", "=", 1).executeQuery());
+*   std::vector<uint8_t> mask;
+*   columnar::maskRange(cols.numeric<uint32_t>("duration"), 1000u, 5000u, mask);
+*   uint64_t bytes = columnar::sumWhere(cols.numeric<uint32_t>("file_size"), mask);
+* 下面columnar里的函数都是没有分支的简单循环，-O3(或-O2 -ftree-vectorize)下编译器会生成SIMD指令
+*/
+enum E_COLUMN_TYPE
+{
+    E_COL_INT32 = 0,
+    E_COL_UINT32 = 1,
+    E_COL_INT64 = 2,
+    E_COL_UINT64 = 3,
+    E_COL_DOUBLE = 4,
+    E_COL_STRING = 5
+};
+
+template <typename T>
+struct ColumnTypeOf;
+template <>
+struct ColumnTypeOf<int32_t>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_INT32;
+};
+template <>
+struct ColumnTypeOf<uint32_t>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_UINT32;
+};
+template <>
+struct ColumnTypeOf<int64_t>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_INT64;
+};
+template <>
+struct ColumnTypeOf<uint64_t>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_UINT64;
+};
+template <>
+struct ColumnTypeOf<double>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_DOUBLE;
+};
+template <>
+struct ColumnTypeOf<std::string>
+{
+    static constexpr E_COLUMN_TYPE value = E_COL_STRING;
+};
+
+/*
+* 字符串列：第i行是bytes[offsets[i], offsets[i+1])
+*/
+struct StringColumn
+{
+    std::vector<uint32_t> offsets{0};
+    std::string bytes;
+
+    size_t size() const
+    {
+        return offsets.size() - 1;
+    }
+
+    const char *data(size_t i) const
+    {
+        return bytes.data() + offsets[i];
+    }
+
+    size_t length(size_t i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+
+    std::string str(size_t i) const
+    {
+        return std::string(data(i), length(i));
+    }
+
+    void append(const char *s, size_t len)
+    {
+        bytes.append(s, len);
+        offsets.push_back(static_cast<uint32_t>(bytes.size()));
+    }
+};
+
+class ColumnarResult
+{
+  public:
+    struct Column
+    {
+        std::string name;
+        E_COLUMN_TYPE type;
+        std::vector<int32_t> i32;
+        std::vector<uint32_t> u32;
+        std::vector<int64_t> i64;
+        std::vector<uint64_t> u64;
+        std::vector<double> f64;
+        StringColumn str;
+        std::vector<uint8_t> nulls; //有NULL时才分配，1表示NULL，NULL行的数值是0、字符串为空
+        bool has_null = false;
+    };
+
+    //增加一列，T是int32_t/uint32_t/int64_t/uint64_t/double/std::string
+    template <typename T>
+    ColumnarResult &addColumn(const std::string &name)
+    {
+        columns_.emplace_back();
+        columns_.back().name = name;
+        columns_.back().type = ColumnTypeOf<T>::value;
+        return *this;
+    }
+
+    //预分配行数，已知结果集大小时减少扩容
+    void reserve(size_t rows)
+    {
+        for (auto &c : columns_)
+        {
+            switch (c.type)
+            {
+            case E_COL_INT32:
+                c.i32.reserve(rows);
+                break;
+            case E_COL_UINT32:
+                c.u32.reserve(rows);
+                break;
+            case E_COL_INT64:
+                c.i64.reserve(rows);
+                break;
+            case E_COL_UINT64:
+                c.u64.reserve(rows);
+                break;
+            case E_COL_DOUBLE:
+                c.f64.reserve(rows);
+                break;
+            case E_COL_STRING:
+                c.str.offsets.reserve(rows + 1);
+                break;
+            }
+        }
+    }
+
+    /*
+    * @fun:读取结果集剩余的所有行，追加在已有的行后面
+    * @return 读取的行数；-1：结果集中没有某一列
+    */
+    template <typename RS>
+    int64_t load(RS &res)
+    {
+        std::vector<uint32_t> idx;
+        if (resolve(res, idx) != 0)
+        {
+            return -1;
+        }
+        int64_t count = 0;
+        while (res.next())
+        {
+            appendRow(res, idx);
+            count++;
+        }
+        return count;
+    }
+
+    /*
+    * @fun:读取游标剩余的所有行，结果集很大时不需要驱动缓存整个结果集
+    * @return 读取的行数；-1：结果集中没有某一列或者读取出错
+    */
+    int64_t load(RowCursor &cursor)
+    {
+        std::vector<uint32_t> idx;
+        int64_t count = 0;
+        while (cursor.next())
+        {
+            if (count == 0 && resolve(*cursor.row(), idx) != 0)
+            {
+                cursor.close();
+                return -1;
+            }
+            appendRow(*cursor.row(), idx);
+            count++;
+        }
+        return cursor.errorCode() == 0 ? count : -1;
+    }
+
+    size_t rowsCount() const
+    {
+        return rows_;
+    }
+
+    size_t columnCount() const
+    {
+        return columns_.size();
+    }
+
+    //按名字取列，没有时返回nullptr
+    const Column *column(const std::string &name) const
+    {
+        for (const auto &c : columns_)
+        {
+            if (c.name == name)
+            {
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    //数值列的数组，类型必须和addColumn时一致，否则返回空数组
+    template <typename T>
+    const std::vector<T> &numeric(const std::string &name) const
+    {
+        static const std::vector<T> empty;
+        const Column *c = column(name);
+        return c && c->type == ColumnTypeOf<T>::value ? values<T>(*c) : empty;
+    }
+
+    const StringColumn &strings(const std::string &name) const
+    {
+        static const StringColumn empty;
+        const Column *c = column(name);
+        return c && c->type == E_COL_STRING ? c->str : empty;
+    }
+
+    //NULL标记，没有NULL时返回空数组
+    const std::vector<uint8_t> &nulls(const std::string &name) const
+    {
+        static const std::vector<uint8_t> empty;
+        const Column *c = column(name);
+        return c ? c->nulls : empty;
+    }
+
+    //清空数据，保留列定义和已分配的容量
+    void clear()
+    {
+        for (auto &c : columns_)
+        {
+            c.i32.clear();
+            c.u32.clear();
+            c.i64.clear();
+            c.u64.clear();
+            c.f64.clear();
+            c.str.offsets.assign(1, 0);
+            c.str.bytes.clear();
+            c.nulls.clear();
+            c.has_null = false;
+        }
+        rows_ = 0;
+    }
+
+  private:
+    template <typename T>
+    static const std::vector<T> &values(const Column &c);
+
+    template <typename RS>
+    int resolve(RS &res, std::vector<uint32_t> &idx)
+    {
+        idx.clear();
+        for (const auto &c : columns_)
+        {
+            uint32_t i = res.findColumn(c.name);
+            if (i == 0)
+            {
+                return -1;
+            }
+            idx.push_back(i);
+        }
+        return 0;
+    }
+
+    template <typename RS>
+    void appendRow(RS &res, const std::vector<uint32_t> &idx)
+    {
+        for (size_t k = 0; k < columns_.size(); k++)
+        {
+            Column &c = columns_[k];
+            bool is_null = res.isNull(idx[k]);
+            if (is_null && !c.has_null)
+            { //第一次出现NULL时才分配
+                c.has_null = true;
+                c.nulls.assign(rows_, 0);
+            }
+            if (c.has_null)
+            {
+                c.nulls.push_back(is_null ? 1 : 0);
+            }
+
+            switch (c.type)
+            {
+            case E_COL_INT32:
+                c.i32.push_back(is_null ? 0 : res.getInt(idx[k]));
+                break;
+            case E_COL_UINT32:
+                c.u32.push_back(is_null ? 0 : res.getUInt(idx[k]));
+                break;
+            case E_COL_INT64:
+                c.i64.push_back(is_null ? 0 : res.getInt64(idx[k]));
+                break;
+            case E_COL_UINT64:
+                c.u64.push_back(is_null ? 0 : res.getUInt64(idx[k]));
+                break;
+            case E_COL_DOUBLE:
+                c.f64.push_back(is_null ? 0.0 : static_cast<double>(res.getDouble(idx[k])));
+                break;
+            case E_COL_STRING:
+                if (is_null)
+                {
+                    c.str.append("", 0);
+                }
+                else
+                {
+                    sql::SQLString s = res.getString(idx[k]);
+                    c.str.append(s.c_str(), s.length());
+                }
+                break;
+            }
+        }
+        rows_++;
+    }
+
+    std::vector<Column> columns_;
+    size_t rows_ = 0;
+};
+
+template <>
+inline const std::vector<int32_t> &ColumnarResult::values<int32_t>(const Column &c)
+{
+    return c.i32;
+}
+
+template <>
+inline const std::vector<uint32_t> &ColumnarResult::values<uint32_t>(const Column &c)
+{
+    return c.u32;
+}
+
+template <>
+inline const std::vector<int64_t> &ColumnarResult::values<int64_t>(const Column &c)
+{
+    return c.i64;
+}
+
+template <>
+inline const std::vector<uint64_t> &ColumnarResult::values<uint64_t>(const Column &c)
+{
+    return c.u64;
+}
+
+template <>
+inline const std::vector<double> &ColumnarResult::values<double>(const Column &c)
+{
+    return c.f64;
+}
+
+/*
+* 列上的过滤和聚合。过滤结果是每行一个字节的mask(0/1)，多个条件用maskAnd/maskOr组合，
+* 聚合函数只统计mask为1的行。循环里没有分支和函数调用，便于编译器向量化
+*/
+namespace columnar
+{
+//mask[i] = lo <= v[i] <= hi
+template <typename T>
+void maskRange(const std::vector<T> &v, T lo, T hi, std::vector<uint8_t> &mask)
+{
+    size_t n = v.size();
+    mask.resize(n);
+    const T *src = v.data();
+    uint8_t *dst = mask.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = static_cast<uint8_t>((src[i] >= lo) & (src[i] <= hi));
+    }
+}
+
+//mask[i] = v[i] == value
+template <typename T>
+void maskEqual(const std::vector<T> &v, T value, std::vector<uint8_t> &mask)
+{
+    size_t n = v.size();
+    mask.resize(n);
+    const T *src = v.data();
+    uint8_t *dst = mask.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = static_cast<uint8_t>(src[i] == value);
+    }
+}
+
+//字符串列 mask[i] = s[i] == value
+inline void maskEqual(const StringColumn &s, const std::string &value, std::vector<uint8_t> &mask)
+{
+    size_t n = s.size();
+    mask.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        mask[i] = static_cast<uint8_t>(s.length(i) == value.size() && memcmp(s.data(i), value.data(), value.size()) == 0);
+    }
+}
+
+//去掉NULL行，nulls为空表示没有NULL
+inline void maskNotNull(const std::vector<uint8_t> &nulls, std::vector<uint8_t> &mask)
+{
+    size_t n = std::min(nulls.size(), mask.size());
+    for (size_t i = 0; i < n; i++)
+    {
+        mask[i] &= static_cast<uint8_t>(nulls[i] ^ 1);
+    }
+}
+
+//mask &= other
+inline void maskAnd(std::vector<uint8_t> &mask, const std::vector<uint8_t> &other)
+{
+    size_t n = std::min(mask.size(), other.size());
+    uint8_t *dst = mask.data();
+    const uint8_t *src = other.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] &= src[i];
+    }
+}
+
+//mask |= other
+inline void maskOr(std::vector<uint8_t> &mask, const std::vector<uint8_t> &other)
+{
+    size_t n = std::min(mask.size(), other.size());
+    uint8_t *dst = mask.data();
+    const uint8_t *src = other.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] |= src[i];
+    }
+}
+
+inline uint64_t countWhere(const std::vector<uint8_t> &mask)
+{
+    uint64_t count = 0;
+    const uint8_t *m = mask.data();
+    for (size_t i = 0; i < mask.size(); i++)
+    {
+        count += m[i];
+    }
+    return count;
+}
+
+//整数列的和用64位累加，不会因为uint32_t溢出
+template <typename T>
+typename std::conditional<std::is_floating_point<T>::value, double,
+                          typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type
+sumWhere(const std::vector<T> &v, const std::vector<uint8_t> &mask)
+{
+    using ACC = typename std::conditional<std::is_floating_point<T>::value, double,
+                                          typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type;
+    ACC sum = 0;
+    size_t n = std::min(v.size(), mask.size());
+    const T *src = v.data();
+    const uint8_t *m = mask.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += static_cast<ACC>(src[i]) * m[i];
+    }
+    return sum;
+}
+
+//m为1时取v，否则取fallback；整数用位运算代替条件选择，编译器才能向量化min/max
+template <typename T>
+inline T blendValue(T v, T fallback, uint8_t m, std::true_type)
+{
+    T keep = static_cast<T>(m) - 1; //m为1时全0，为0时全1
+    return v ^ ((v ^ fallback) & keep);
+}
+
+template <typename T>
+inline T blendValue(T v, T fallback, uint8_t m, std::false_type)
+{
+    return m ? v : fallback;
+}
+
+//没有mask为1的行时返回T的最大值
+template <typename T>
+T minWhere(const std::vector<T> &v, const std::vector<uint8_t> &mask)
+{
+    const T fallback = std::numeric_limits<T>::max();
+    T result = fallback;
+    size_t n = std::min(v.size(), mask.size());
+    const T *src = v.data();
+    const uint8_t *m = mask.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        T candidate = blendValue(src[i], fallback, m[i], std::is_integral<T>());
+        result = candidate < result ? candidate : result;
+    }
+    return result;
+}
+
+//没有mask为1的行时返回T的最小值
+template <typename T>
+T maxWhere(const std::vector<T> &v, const std::vector<uint8_t> &mask)
+{
+    const T fallback = std::numeric_limits<T>::lowest();
+    T result = fallback;
+    size_t n = std::min(v.size(), mask.size());
+    const T *src = v.data();
+    const uint8_t *m = mask.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        T candidate = blendValue(src[i], fallback, m[i], std::is_integral<T>());
+        result = candidate > result ? candidate : result;
+    }
+    return result;
+}
+
+//mask为1的行号，用于回取其他列或者字符串
+inline std::vector<uint32_t> selected(const std::vector<uint8_t> &mask)
+{
+    std::vector<uint32_t> rows;
+    rows.reserve(countWhere(mask));
+    for (size_t i = 0; i < mask.size(); i++)
+    {
+        if (mask[i])
+        {
+            rows.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    return rows;
+}
+
+//按行号取出数值
+template <typename T>
+std::vector<T> gather(const std::vector<T> &v, const std::vector<uint32_t> &rows)
+{
+    std::vector<T> out(rows.size());
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        out[i] = v[rows[i]];
+    }
+    return out;
+}
+} // namespace columnar
+#endif
@@ -0,0 +1,224 @@
+#ifndef COMPILED_QUERY_H_
+#define COMPILED_QUERY_H_
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include "db_table.h"
+#include "prepared_exec.h"
+#include "boost/algorithm/string/join.hpp"
+
+/*
+* 不可变的预编译查询，启动时构建一次，之后可以在多个线程、任意连接上并发执行，
+* 每次执行只绑定参数，不再有Table的构建过程和状态。用法:
+*   static const CompiledQuery kTaskStatus = QueryBuilder("T_TaskRecord").select("status").where("task_id", "=").compile();
+*   auto res = kTaskStatus.executeQuery(conn, task_id);
+*/
+class CompiledQuery
+{
+  public:
+    CompiledQuery(E_MYSQL_OP op, const std::string &table, const std::string &sql, size_t param_count)
+        : op_(op), table_name_(table), sql_(sql), param_count_(param_count)
+    {
+    }
+
+    E_MYSQL_OP op() const
+    {
+        return op_;
+    }
+
+    const std::string &table() const
+    {
+        return table_name_;
+    }
+
+    const std::string &sql() const
+    {
+        return sql_;
+    }
+
+    size_t paramCount() const
+    {
+        return param_count_;
+    }
+
+    //sql为空说明构建时参数不合法
+    bool valid() const
+    {
+        return !sql_.empty();
+    }
+
+    /*
+    * @fun:执行SELECT
+    * @return nullptr：不是查询语句、参数个数不对、连接无效或执行出错；非nullptr：结果集
+    */
+    template <typename... ARGS>
+    std::shared_ptr<sql::ResultSet> executeQuery(const std::shared_ptr<sql::Connection> &conn, ARGS &&... args) const
+    {
+        if (op_ != E_OP_SELECT || sizeof...(ARGS) != param_count_)
+        {
+            return nullptr;
+        }
+        return preparedQuery(conn, table_name_, sql_, std::forward<ARGS>(args)...);
+    }
+
+    /*
+    * @fun:执行UPDATE/INSERT/DELETE
+    * @return 影响行数；-1：语句类型或参数个数不对，或者执行出错；-2：连接无效；-3：主键冲突；-4：超时
+    */
+    template <typename... ARGS>
+    int executeUpdate(const std::shared_ptr<sql::Connection> &conn, ARGS &&... args) const
+    {
+        if (op_ == E_OP_SELECT || !valid() || sizeof...(ARGS) != param_count_)
+        {
+            return -1;
+        }
+        return preparedUpdate(conn, table_name_, sql_, std::forward<ARGS>(args)...); //成功时已经让查询缓存失效
+    }
+
+    /*
+    * @fun:把参数渲染进sql，得到可以直接执行的文本，用于多语句批量执行
+    * @return 渲染后的sql；语句不合法或参数个数不对时返回空串
+    */
+    template <typename... ARGS>
+    std::string render(ARGS &&... args) const
+    {
+        if (!valid() || sizeof...(ARGS) != param_count_)
+        {
+            return "";
+        }
+        return renderSql(sql_, {sqlLiteral(std::forward<ARGS>(args))...});
+    }
+
+  private:
+    const E_MYSQL_OP op_;
+    const std::string table_name_;
+    const std::string sql_;
+    const size_t param_count_;
+};
+
+/*
+* 预编译查询的构建器，条件的值全部用占位符代替，只在启动时使用
+*/
+class QueryBuilder
+{
+  public:
+    QueryBuilder(const std::string &table)
+    {
+        table_name_ = table;
+    }
+
+    template <typename... FIELDS>
+    QueryBuilder &select(FIELDS... f)
+    {
+        op_ = E_OP_SELECT;
+        fields_ = {f...};
+        return *this;
+    }
+
+    QueryBuilder &update()
+    {
+        op_ = E_OP_UPDATE;
+        return *this;
+    }
+
+    QueryBuilder &set(const std::string &field)
+    {
+        if (op_ == E_OP_UPDATE)
+        {
+            fields_.emplace_back(field);
+        }
+        return *this;
+    }
+
+    template <typename... FIELDS>
+    QueryBuilder &insert(FIELDS... f)
+    {
+        op_ = E_OP_INSERT;
+        fields_ = {f...};
+        return *this;
+    }
+
+    QueryBuilder &del()
+    {
+        op_ = E_OP_DELETE;
+        return *this;
+    }
+
+    //field expr ?，多个where之间用AND连接
+    QueryBuilder &where(const std::string &field, const std::string &expr)
+    {
+        queries_.emplace_back(field + expr + "?");
+        where_params_++;
+        return *this;
+    }
+
+    //直接写表达式，占位符个数由调用者给出，例如whereOrg("uid=? OR sid=?", 2)
+    QueryBuilder &whereOrg(const std::string &expr, size_t param_count)
+    {
+        queries_.emplace_back(expr);
+        where_params_ += param_count;
+        return *this;
+    }
+
+    CompiledQuery compile() const
+    {
+        std::string sql;
+        size_t params = where_params_;
+        if (op_ == E_OP_SELECT && fields_.size() > 0)
+        {
+            sql = "SELECT " + boost::join(fields_, ",") + " FROM " + table_name_ + genWhere();
+        }
+        else if (op_ == E_OP_UPDATE && fields_.size() > 0)
+        {
+            std::vector<std::string> sets;
+            for (const auto &f : fields_)
+            {
+                sets.emplace_back(f + "=?");
+            }
+            sql = "UPDATE " + table_name_ + " SET " + boost::join(sets, ",") + genWhere();
+            params += fields_.size();
+        }
+        else if (op_ == E_OP_INSERT && fields_.size() > 0)
+        {
+            std::vector<std::string> marks(fields_.size(), "?");
+            sql = "INSERT INTO " + table_name_ + "(" + boost::join(fields_, ",") + ") VALUES(" + boost::join(marks, ",") + ")";
+            params = fields_.size();
+        }
+        else if (op_ == E_OP_DELETE && queries_.size() > 0)
+        { //不能全部删
+            sql = "DELETE FROM " + table_name_ + genWhere();
+        }
+        return CompiledQuery(op_, table_name_, sql, params);
+    }
+
+  private:
+    std::string genWhere() const
+    {
+        if (queries_.size() <= 0)
+        {
+            return "";
+        }
+
+        std::string where;
+        for (auto it = queries_.begin(); it != queries_.end(); it++)
+        {
+            if (it != queries_.begin())
+            {
+                where += " AND (" + *it + ")";
+            }
+            else
+            {
+                where += "(" + *it + ")";
+            }
+        }
+        return " WHERE " + where;
+    }
+
+    E_MYSQL_OP op_ = E_OP_NONE;
+    std::string table_name_;
+    std::vector<std::string> fields_;
+    std::vector<std::string> queries_;
+    size_t where_params_ = 0;
+};
+#endif
@@ -0,0 +1,12 @@
+#ifndef CONN_PROVIDER_H_
+#define CONN_PROVIDER_H_
+#include <memory>
+#include <functional>
+#include "mysql/mysql_driver.h"
+
+/*
+* 连接提供者，返回的连接在引用释放时自动归还连接池，返回nullptr表示取不到连接。
+* 连接池通过leaseConnection()生成
+*/
+using CONN_PROVIDER = std::function<std::shared_ptr<sql::Connection>()>;
+#endif
@@ -0,0 +1,401 @@
+#ifndef DB_DRIVER_H_
+#define DB_DRIVER_H_
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "mysql/cppconn/datatype.h"
+
+/*
+* 数据库驱动接口。驱动是模板参数(和ConnPool<DB>一样)，不走虚函数，目前有两个实现：
+*   CppConnDriver  基于MySQL Connector/C++，见本文件
+*   NativeDriver   直接基于libmysqlclient/MariaDB C API的二进制协议，见native_driver.h
+* 两个驱动提供同样的方法，热路径上不抛异常，出错时返回错误码：
+*   0：成功；>0：mysql错误码；-1：参数或状态不对；-2：连接无效
+*
+* DRIVER:
+*   int connect(const DriverOptions &opt);
+*   int reconnect();                       //重连后之前prepare的语句失效
+*   bool ping();
+*   int execute(const std::string &sql, uint64_t *affected_rows = nullptr); //文本协议，丢弃结果集
+*   std::unique_ptr<STATEMENT> prepare(const std::string &sql);           //失败返回nullptr，错误码见errorCode()
+*   int errorCode() const; const std::string &errorMsg() const;
+* STATEMENT(参数和列下标都从1开始，和Connector/C++一致):
+*   void bind(uint32_t idx, int32_t/uint32_t/int64_t/uint64_t/double/const std::string &);
+*   void bindNull(uint32_t idx);
+*   int execute();                         //有结果集时用next()读取
+*   uint64_t affectedRows() const;
+*   bool next();
+*   uint32_t findColumn(const char *name) const; //0表示没有该列
+*   bool isNull(uint32_t idx) const;
+*   getInt/getUInt/getInt64/getUInt64/getDouble/getString(uint32_t idx) const;
+* STATEMENT满足RowMapper对结果集的要求，可以直接 RowMapper<T, DRIVER::STATEMENT> 解码。
+*
+* Table::executeQuery(driver)/executeUpdate(driver)在驱动上执行，DriverConn<DRIVER>让MySqlConnPool管理驱动连接。
+* Table的其他操作、事务、组提交等仍然只支持sql::Connection。
+*/
+
+struct DriverOptions
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 3306;
+    std::string user = "root";
+    std::string password;
+    std::string schema;
+    std::string charset = "utf8mb4";
+    uint32_t connect_timeout_s = 3;
+    uint32_t read_timeout_s = 0; //0表示不设置
+    uint32_t write_timeout_s = 0;
+};
+
+class CppConnStatement
+{
+  public:
+    explicit CppConnStatement(sql::PreparedStatement *pstmt)
+    {
+        pstmt_.reset(pstmt);
+    }
+
+    void bind(uint32_t idx, int32_t v)
+    {
+        pstmt_->setInt(idx, v);
+    }
+
+    void bind(uint32_t idx, uint32_t v)
+    {
+        pstmt_->setUInt(idx, v);
+    }
+
+    void bind(uint32_t idx, int64_t v)
+    {
+        pstmt_->setInt64(idx, v);
+    }
+
+    void bind(uint32_t idx, uint64_t v)
+    {
+        pstmt_->setUInt64(idx, v);
+    }
+
+    void bind(uint32_t idx, double v)
+    {
+        pstmt_->setDouble(idx, v);
+    }
+
+    void bind(uint32_t idx, const std::string &v)
+    {
+        pstmt_->setString(idx, v);
+    }
+
+    void bindNull(uint32_t idx)
+    {
+        pstmt_->setNull(idx, sql::DataType::VARCHAR);
+    }
+
+    /*
+    * @fun:执行语句，上一次的结果集先释放
+    * @return 0：成功；>0：mysql错误码；-1：其他错误
+    */
+    int execute()
+    {
+        res_.reset();
+        affected_rows_ = 0;
+        try
+        {
+            if (pstmt_->execute())
+            {
+                res_.reset(pstmt_->getResultSet());
+            }
+            else
+            {
+                affected_rows_ = pstmt_->getUpdateCount();
+            }
+            return 0;
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode() > 0 ? e.getErrorCode() : -1;
+            return error_code_;
+        }
+    }
+
+    uint64_t affectedRows() const
+    {
+        return affected_rows_;
+    }
+
+    bool next()
+    {
+        try
+        {
+            return res_ && res_->next();
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode() > 0 ? e.getErrorCode() : -1;
+            return false;
+        }
+    }
+
+    uint32_t findColumn(const char *name) const
+    {
+        try
+        {
+            return res_ ? res_->findColumn(name) : 0;
+        }
+        catch (sql::SQLException &)
+        {
+            return 0;
+        }
+    }
+
+    bool isNull(uint32_t idx) const
+    {
+        return res_->isNull(idx);
+    }
+
+    int32_t getInt(uint32_t idx) const
+    {
+        return res_->getInt(idx);
+    }
+
+    uint32_t getUInt(uint32_t idx) const
+    {
+        return res_->getUInt(idx);
+    }
+
+    int64_t getInt64(uint32_t idx) const
+    {
+        return res_->getInt64(idx);
+    }
+
+    uint64_t getUInt64(uint32_t idx) const
+    {
+        return res_->getUInt64(idx);
+    }
+
+    double getDouble(uint32_t idx) const
+    {
+        return static_cast<double>(res_->getDouble(idx));
+    }
+
+    sql::SQLString getString(uint32_t idx) const
+    {
+        return res_->getString(idx);
+    }
+
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+  private:
+    std::unique_ptr<sql::PreparedStatement> pstmt_;
+    std::unique_ptr<sql::ResultSet> res_;
+    uint64_t affected_rows_ = 0;
+    int error_code_ = 0;
+};
+
+/*
+* Connector/C++驱动，也可以包装已有的sql::Connection
+*/
+class CppConnDriver
+{
+  public:
+    using STATEMENT = CppConnStatement;
+
+    CppConnDriver() = default;
+
+    explicit CppConnDriver(std::shared_ptr<sql::Connection> conn)
+    {
+        conn_ = conn;
+    }
+
+    int connect(const DriverOptions &opt)
+    {
+        opt_ = opt;
+        try
+        {
+            sql::ConnectOptionsMap connection_properties;
+            connection_properties["hostName"] = opt.host;
+            connection_properties["userName"] = opt.user;
+            connection_properties["password"] = opt.password;
+            connection_properties["schema"] = opt.schema;
+            connection_properties["port"] = static_cast<int>(opt.port);
+            connection_properties["OPT_CHARSET_NAME"] = opt.charset;
+            connection_properties["OPT_CONNECT_TIMEOUT"] = static_cast<int>(opt.connect_timeout_s);
+            if (opt.read_timeout_s > 0)
+            {
+                connection_properties["OPT_READ_TIMEOUT"] = static_cast<int>(opt.read_timeout_s);
+            }
+            if (opt.write_timeout_s > 0)
+            {
+                connection_properties["OPT_WRITE_TIMEOUT"] = static_cast<int>(opt.write_timeout_s);
+            }
+            conn_.reset(sql::mysql::get_mysql_driver_instance()->connect(connection_properties));
+            return 0;
+        }
+        catch (sql::SQLException &e)
+        {
+            return setError(e);
+        }
+    }
+
+    int reconnect()
+    {
+        if (!conn_)
+        {
+            return connect(opt_);
+        }
+        try
+        {
+            conn_->reconnect();
+            return 0;
+        }
+        catch (sql::SQLException &e)
+        {
+            return setError(e);
+        }
+    }
+
+    bool ping()
+    {
+        try
+        {
+            return conn_ && conn_->isValid();
+        }
+        catch (sql::SQLException &e)
+        {
+            setError(e);
+            return false;
+        }
+    }
+
+    int execute(const std::string &sql, uint64_t *affected_rows = nullptr)
+    {
+        if (!conn_)
+        {
+            return -2;
+        }
+        try
+        {
+            std::unique_ptr<sql::Statement> stmt(conn_->createStatement());
+            bool has_result = stmt->execute(sql);
+            uint64_t affected = has_result ? 0 : stmt->getUpdateCount();
+            while (has_result || stmt->getMoreResults())
+            { //读完所有结果集，否则连接不能再执行其他语句
+                std::unique_ptr<sql::ResultSet> res(stmt->getResultSet());
+                while (res && res->next())
+                {
+                }
+                has_result = false;
+            }
+            if (affected_rows)
+            {
+                *affected_rows = affected;
+            }
+            return 0;
+        }
+        catch (sql::SQLException &e)
+        {
+            return setError(e);
+        }
+    }
+
+    std::unique_ptr<CppConnStatement> prepare(const std::string &sql)
+    {
+        if (!conn_)
+        {
+            error_code_ = -2;
+            return nullptr;
+        }
+        try
+        {
+            return std::unique_ptr<CppConnStatement>(new CppConnStatement(conn_->prepareStatement(sql)));
+        }
+        catch (sql::SQLException &e)
+        {
+            setError(e);
+            return nullptr;
+        }
+    }
+
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    const std::string &errorMsg() const
+    {
+        return error_msg_;
+    }
+
+    //给还在用sql::Connection的代码(Table等)
+    std::shared_ptr<sql::Connection> getConnection()
+    {
+        return conn_;
+    }
+
+  private:
+    int setError(const sql::SQLException &e)
+    {
+        error_code_ = e.getErrorCode() > 0 ? e.getErrorCode() : -1;
+        error_msg_ = e.what();
+        return error_code_;
+    }
+
+    DriverOptions opt_;
+    std::shared_ptr<sql::Connection> conn_;
+    int error_code_ = 0;
+    std::string error_msg_;
+};
+
+/*
+* 把驱动包装成MySqlConnPool能管理的连接：无参connect()、onDisconnect()。
+* 连接参数在构造时传入，连接池用factory()创建连接，每个连接池可以连不同的库。驱动出错时由Table的重试自己重连，
+* 不需要连接池补连接，所以onDisconnect的回调只保存不调用。用法:
+*   auto pool = std::make_shared<MySqlConnPool<DriverConn<NativeDriver>>>(DriverConn<NativeDriver>::factory(opt));
+*   pool->init(4, 16);
+*   auto lease = pool->getConnDB();
+*   auto stmt = table.select("*").where("task_id", "=", id).executeQuery(lease->getDB()->driver());
+*/
+template <typename DRIVER>
+class DriverConn
+{
+  public:
+    using DISCONNECT_CB = std::function<void(DriverConn *)>;
+
+    explicit DriverConn(const DriverOptions &opt)
+    {
+        opt_ = opt;
+    }
+
+    //MySqlConnPool的工厂，连接池里的连接都用opt连接
+    static std::function<std::shared_ptr<DriverConn>()> factory(const DriverOptions &opt)
+    {
+        return [opt]() { return std::make_shared<DriverConn>(opt); };
+    }
+
+    int connect()
+    {
+        return driver_.connect(opt_);
+    }
+
+    void onDisconnect(const DISCONNECT_CB &cb)
+    {
+        disconnect_cb_ = cb;
+    }
+
+    DRIVER &driver()
+    {
+        return driver_;
+    }
+
+  private:
+    DriverOptions opt_;
+    DRIVER driver_;
+    DISCONNECT_CB disconnect_cb_;
+};
+#endif
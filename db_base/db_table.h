@@ -1,691 +1,1097 @@
-#ifndef DB_TABLE_H_
-#define DB_TABLE_H_
-#include <string>
-#include <utility>
-#include <type_traits>
-#include <functional>
-#include <iostream>
-#include <boost/any.hpp>
-#include "mysql/mysql_driver.h"
-#include "mysql/cppconn/prepared_statement.h"
-#include "boost/any.hpp"
-#include "boost/algorithm/string/join.hpp"
-
-enum E_QUERY_CONNECTOR
-{
-    E_QUERY_AND = 0,
-    E_QUERY_OR = 1
-};
-
-enum E_MYSQL_OP
-{ //CURD
-    E_OP_NONE = 0,
-    E_OP_SELECT = 1,
-    E_OP_UPDATE = 2,
-    E_OP_INSERT = 3,
-    E_OP_DELETE = 4
-};
-
-class Query
-{
-  public:
-    Query()
-    {
-    }
-    operator std::string() const
-    {
-        std::string s;
-        for (auto it = queries_.begin(); it != queries_.end(); it++)
-        {
-            auto c = std::get<0>(*it);
-            if (c == E_QUERY_AND)
-            {
-                if (it == queries_.begin())
-                {
-                    s += std::get<1>(*it);
-                }
-                else
-                {
-                    s += " AND " + std::get<1>(*it);
-                }
-            }
-            else if (c == E_QUERY_OR)
-            {
-                if (it == queries_.begin())
-                {
-                    s += std::get<1>(*it);
-                }
-                else
-                {
-                    s += " OR " + std::get<1>(*it);
-                }
-            }
-        }
-        return s;
-    }
-
-    Query(E_QUERY_CONNECTOR c, const std::string &s)
-    {
-        queries_.emplace_back(std::make_tuple(c, std::move(s)));
-    }
-
-    void addQuery(const Query &t)
-    {
-        queries_.emplace_back(std::make_tuple(E_QUERY_AND, (std::string)t));
-    }
-
-    template <typename T>
-    Query &where(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + std::to_string(val);
-        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<char *, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
-    where(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + "'" + std::string(val) + "'";
-        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Query &>::type //处理std::string类参数
-    where(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + val;
-        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
-        return *this;
-    }
-
-    template <typename T>
-    Query &orWhere(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + std::to_string(val);
-        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<char *, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
-    orWhere(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + "'" + std::string(val) + "'";
-        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
-    orWhere(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + "'" + val + "'";
-        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
-        return *this;
-    }
-
-  public:
-    std::vector<std::tuple<E_QUERY_CONNECTOR, std::string>> queries_;
-};
-
-class Table
-{
-  public:
-    Table(const std::string &table)
-    {
-        table_name_ = table;
-    }
-    virtual ~Table()
-    {
-    }
-    void setConn(std::weak_ptr<sql::Connection> conn)
-    {
-        weak_conn_ = conn;
-    }
-
-  public:
-    template <typename T>
-    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
-                                !std::is_same<const char *, typename std::decay<T>::type>::value,
-                            Table &>::type
-    where(const std::string &field, const std::string &expr, T &&val)
-    {
-        std::string query;
-        query = field + expr + std::to_string(val);
-        Query q(E_QUERY_AND, std::move(query));
-        queries_.emplace_back(std::move(q));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<typename std::decay<T>::type, const char *>::value, Table &>::type //const char*
-    where(const std::string &field, const std::string &expr, T &&val)
-    { //const char*
-        std::string query;
-        query = field + expr + "'" + std::string(val) + "'";
-        Query q(E_QUERY_AND, std::move(query));
-        queries_.emplace_back(std::move(q));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<typename std::decay<T>::type, std::string>::value, Table &>::type //std::string
-    where(const std::string &field, const std::string &expr, T &&val)
-    { //
-        std::string query;
-        query = field + expr + "'" + val + "'";
-        Query q(E_QUERY_AND, std::move(query));
-        queries_.emplace_back(std::move(q));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
-                                !std::is_same<const char *, typename std::decay<T>::type>::value,
-                            Table &>::type
-    orWhere(const std::string &field, const std::string &expr, T &&val)
-    {
-        std::string query;
-        query = field + expr + std::to_string(val);
-        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<typename std::decay<T>::type, std::string>::value, Table &>::type //std::string
-    orWhere(const std::string &field, const std::string &expr, T &&val)
-    {
-        std::string query;
-        query = field + expr + "'" + val + "'";
-        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<typename std::decay<T>::type, const char *>::value, Table &>::type //char*
-    orWhere(const std::string &field, const std::string &expr, T val)
-    {
-        std::string query;
-        query = field + expr + "'" + std::string(val) + "'";
-        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
-        return *this;
-    }
-
-    template <typename... T>
-    Table &whereOrg(T... args)
-    { //直接写表达式的方式，例如直接写 id = 12345 AND name = 'liming'，这些需要用AND连接起来
-        Query query;
-        std::vector<std::string> ws = {(0, args)...};
-        for (const auto &w : ws)
-        {
-            Query q(E_QUERY_AND, std::move(w));
-            query.addQuery(std::move(q));
-        }
-        queries_.emplace_back(std::move(query));
-        return *this;
-    }
-
-    template <typename... T>
-    Table &orWhereOrg(T... args)
-    { //直接写表达式,所有参数都要传string类型
-        Query query;
-        std::vector<std::string> ws = {(0, args)...};
-        for (const auto &w : ws)
-        {
-            Query q(E_QUERY_AND, std::move(w));
-            query.addQuery(std::move(q));
-        }
-        queries_.emplace_back(std::move(query));
-        return *this;
-    }
-
-    using QUERY_GENERATOR = std::function<void(Query&)>;
-    Table &where(const QUERY_GENERATOR &query_generator)
-    {
-        Query query;
-        query_generator(query);
-        Query q(E_QUERY_AND, "(" + std::string(query) + ")");
-        queries_.emplace_back(std::move(q));
-        return *this;
-    }
-
-    template <typename... FIELDS>
-    Table &select(FIELDS... f)
-    { //无类型检查
-        reset();
-        std::string sql;
-        std::vector<std::string> fields = {(0, f)...};
-        fields_ = fields;
-        op_ = E_OP_SELECT;
-        return *this;
-    }
-
-    Table &update()
-    {
-        reset();
-        op_ = E_OP_UPDATE;
-        return *this;
-    }
-
-    template <typename T> //common template
-    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
-                                !std::is_same<const char *, typename std::decay<T>::type>::value,
-                            Table &>::type
-    set(const std::string &field, T v)
-    {
-        if (op_ == E_OP_UPDATE)
-        {
-            update_fields_values_.insert(std::make_pair(field, std::to_string(v)));
-        }
-        return *this;
-    }
-
-    template <typename T> //string template
-    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Table &>::type
-    set(const std::string &field, T v)
-    {
-        if (op_ == E_OP_UPDATE)
-        {
-            update_fields_values_.insert(std::make_pair(field, "'" + v + "'"));
-        }
-        return *this;
-    }
-
-    template <typename T> //char * template
-    typename std::enable_if<std::is_same<const char *, typename std::decay<T>::type>::value, Table &>::type
-    set(const std::string &field, T v)
-    {
-        if (op_ == E_OP_UPDATE)
-        {
-            update_fields_values_.insert(std::make_pair(field, "'" + std::string(v) + "'"));
-        }
-        return *this;
-    }
-
-    template <typename... FIELDS>
-    Table &insert(FIELDS... f)
-    {
-        reset();
-        op_ = E_OP_INSERT;
-        std::vector<std::string> fields = {(0, f)...};
-        fields_ = fields;
-        return *this;
-    }
-
-    Table &values()
-    {
-        return *this;
-    }
-
-    template <typename T> //一个参数的
-    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
-                                !std::is_same<const char *, typename std::decay<T>::type>::value,
-                            Table &>::type
-    values(T && v)
-    {
-        if (op_ == E_OP_INSERT)
-        {
-            values_.push_back(std::to_string(v));
-        }
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Table &>::type // std::string
-    values(T && v)
-    {
-        if (op_ == E_OP_INSERT)
-        {
-            values_.push_back("'" + v + "'");
-        }
-        return *this;
-    }
-
-    template <typename T>
-    typename std::enable_if<std::is_same<const char *, typename std::decay<T>::type>::value, Table &>::type // char*
-    values(T && v)
-    {
-        if (op_ == E_OP_INSERT)
-        {
-            values_.push_back("'" + std::string(v) + "'");
-        }
-        return *this;
-    }
-
-    template <typename T, typename... REST> //至少两个参数的
-    Table &values(T && v, REST... vs)
-    {
-        if (op_ == E_OP_INSERT)
-        {
-            return values(std::forward<T>(v)).values(vs...);
-        }
-        return *this;
-    }
-
-    Table &del()
-    {
-        reset();
-        op_ = E_OP_DELETE;
-        return *this;
-    }
-
-    std::string get_sql()
-    {
-        std::string sql;
-        if (op_ == E_OP_SELECT)
-        {
-            sql = genSelectSql();
-        }
-        else if (op_ == E_OP_UPDATE)
-        {
-            sql = genUpdateSql();
-        }
-        else if (op_ == E_OP_INSERT)
-        {
-            sql = genInsertSql();
-        }
-        else if (op_ == E_OP_DELETE)
-        {
-            sql = genDeleteSql();
-        }
-        reset();
-        return sql;
-    }
-
-    std::shared_ptr<sql::ResultSet> executeQuery()
-    {
-        std::string sql = genSelectSql();
-        if (sql.empty())
-        {
-            reset();
-            return nullptr;
-        }
-        std::shared_ptr<sql::ResultSet> res;
-        auto shr_conn = weak_conn_.lock();
-        if (!shr_conn)
-        {
-            reset();
-            return nullptr;
-        }
-
-        try
-        {
-            std::shared_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(shr_conn->prepareStatement(sql));
-            res.reset(pstmt->executeQuery());
-        }
-        catch (sql::SQLException &e)
-        {
-            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
-            {
-                shr_conn->reconnect();
-            }
-        }
-
-        reset();
-        return res;
-    }
-
-    int executeInsert()
-    {
-        std::string sql = genInsertSql();
-        // std::cout << "executeInsert:"<< sql<<std::endl;
-        if (sql.empty())
-        {
-            reset();
-            return -1;
-        }
-
-        auto shr_conn = weak_conn_.lock();
-        if (!shr_conn)
-        {
-            reset();
-            return -2;
-        }
-
-        int ret = 0;
-        try
-        {
-            std::shared_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(shr_conn->prepareStatement(sql));
-            ret = pstmt->executeUpdate();
-        }
-        catch (sql::SQLException &e)
-        {
-            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
-            {
-                shr_conn->reconnect();
-            }
-            else if (e.getErrorCode() == 1062)
-            { //duplicate key
-                reset();
-                return -3;
-            }
-        }
-        reset();
-        return ret;
-    }
-
-    int executeUpdate()
-    {
-        std::string sql = genUpdateSql();
-        // std::cout << "executeUpdate:"<< sql<<std::endl;
-        if (sql.empty())
-        {
-            reset();
-            return -1;
-        }
-
-        auto shr_conn = weak_conn_.lock();
-        if (!shr_conn)
-        {
-            reset();
-            return -2;
-        }
-
-        int ret = 0;
-        try
-        {
-            std::shared_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(shr_conn->prepareStatement(sql));
-            ret = pstmt->executeUpdate();
-        }
-        catch (sql::SQLException &e)
-        {
-            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
-            {
-                shr_conn->reconnect();
-            }
-        }
-        reset();
-        return ret;
-    }
-
-    int executeDelete()
-    {
-        std::string sql = genDeleteSql();
-        // std::cout << "executeUpdate:"<< sql<<std::endl;
-        if (sql.empty())
-        {
-            reset();
-            return -1;
-        }
-
-        auto shr_conn = weak_conn_.lock();
-        if (!shr_conn)
-        {
-            reset();
-            return -2;
-        }
-
-        bool ret = false;
-        try
-        {
-            std::shared_ptr<sql::PreparedStatement> pstmt;
-            pstmt.reset(shr_conn->prepareStatement(sql));
-            ret = pstmt->execute();
-        }
-        catch (sql::SQLException &e)
-        {
-            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
-            {
-                shr_conn->reconnect();
-            }
-        }
-        reset();
-        return ret ? 0 : -2;
-    }
-
-  private:
-    std::string genSelectSql()
-    {
-        if (E_OP_SELECT != op_)
-        {
-            return "";
-        }
-        
-        std::string select_fields;
-        if (fields_.size() <= 0)
-        {
-            return "";
-        }
-
-        if (std::count_if(fields_.begin(), fields_.end(), [](const std::string &f) { return f == "*"; }) > 0)
-        {
-            select_fields = "*";
-        }
-        else
-        {
-            select_fields = boost::join(fields_, ",");
-        }
-
-        std::string query_where;
-        for (auto it = queries_.begin(); it != queries_.end(); it++)
-        {
-            if (it != queries_.begin())
-            {
-                query_where += " AND (" + std::string(*it) + ")";
-            }
-            else
-            {
-                query_where += "(" + std::string(*it) + ")";
-            }
-        }
-
-        std::string sql = "SELECT " + select_fields + " FROM " + table_name_ + " WHERE " + query_where;
-        return sql;
-    }
-
-    std::string genUpdateSql()
-    {
-        if (E_OP_UPDATE != op_)
-        {
-            return "";
-        }
-
-        if (update_fields_values_.size() <= 0)
-        {
-            return "";
-        }
-
-        std::vector<std::string> field_values_vec;
-        for (const auto &fv : update_fields_values_)
-        {
-            field_values_vec.emplace_back(fv.first + "=" + fv.second);
-        }
-
-        std::string field_values = boost::join(field_values_vec, ",");
-
-        std::string update_where;
-        for (auto it = queries_.begin(); it != queries_.end(); it++)
-        {
-            if (it != queries_.begin())
-            {
-                update_where += " AND (" + std::string(*it) + ")";
-            }
-            else
-            {
-                update_where += "(" + std::string(*it) + ")";
-            }
-        }
-
-        std::string sql = "UPDATE " + table_name_ + " SET " + field_values + " WHERE " + update_where;
-        return sql;
-    }
-
-    std::string genInsertSql()
-    {
-        if (E_OP_INSERT != op_)
-        {
-            return "";
-        }
-
-        std::string insert_fields;
-        if (fields_.size() <= 0)
-        {
-            return "";
-        }
-        insert_fields = boost::join(fields_, ",");
-
-        std::string str_values;
-        str_values = boost::join(values_, ",");
-
-        std::string sql = "INSERT INTO " + table_name_ + "(" + insert_fields + ")" + " VALUES(" + str_values + ")";
-        return sql;
-    }
-
-    std::string genDeleteSql()
-    {
-        if (E_OP_DELETE != op_)
-        {
-            return "";
-        }
-
-        if (queries_.size() <= 0)
-        { //不能全部删
-            return "";
-        }
-
-        std::string delete_where;
-        for (auto it = queries_.begin(); it != queries_.end(); it++)
-        {
-            if (it != queries_.begin())
-            {
-                delete_where += " AND (" + std::string(*it) + ")";
-            }
-            else
-            {
-                delete_where += "(" + std::string(*it) + ")";
-            }
-        }
-
-        std::string sql = "DELETE FROM " + table_name_ + " WHERE " + delete_where;
-        return sql;
-    }
-
-    void reset()
-    {
-        op_ = E_OP_NONE;
-        update_fields_values_.clear();
-        fields_.clear();
-        values_.clear();
-        queries_.clear();
-    }
-
-    E_MYSQL_OP op_ = E_OP_NONE;
-    std::weak_ptr<sql::Connection> weak_conn_;
-    std::string table_name_;
-    std::map<std::string, std::string> update_fields_values_;
-    std::vector<std::string> fields_;
-    std::vector<std::string> values_;
-    std::vector<Query> queries_;
-};
+#ifndef DB_TABLE_H_
+#define DB_TABLE_H_
+#include <string>
+#include <utility>
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <boost/any.hpp>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "boost/any.hpp"
+#include "boost/algorithm/string/join.hpp"
+#include "row_cursor.h"
+#include "query_cache.h"
+#include "single_flight.h"
+#include "retry_policy.h"
+#include "query_context.h"
+#include "query_trace.h"
+#include "io_accounting.h"
+#include "sql_exec.h"
+#include "sql_param.h"
+
+enum E_QUERY_CONNECTOR
+{
+    E_QUERY_AND = 0,
+    E_QUERY_OR = 1
+};
+
+enum E_MYSQL_OP
+{ //CURD
+    E_OP_NONE = 0,
+    E_OP_SELECT = 1,
+    E_OP_UPDATE = 2,
+    E_OP_INSERT = 3,
+    E_OP_DELETE = 4,
+    E_OP_UPSERT = 5
+};
+
+class Query
+{
+  public:
+    Query()
+    {
+    }
+    operator std::string() const
+    {
+        std::string s;
+        for (auto it = queries_.begin(); it != queries_.end(); it++)
+        {
+            auto c = std::get<0>(*it);
+            if (c == E_QUERY_AND)
+            {
+                if (it == queries_.begin())
+                {
+                    s += std::get<1>(*it);
+                }
+                else
+                {
+                    s += " AND " + std::get<1>(*it);
+                }
+            }
+            else if (c == E_QUERY_OR)
+            {
+                if (it == queries_.begin())
+                {
+                    s += std::get<1>(*it);
+                }
+                else
+                {
+                    s += " OR " + std::get<1>(*it);
+                }
+            }
+        }
+        return s;
+    }
+
+    Query(E_QUERY_CONNECTOR c, const std::string &s)
+    {
+        queries_.emplace_back(std::make_tuple(c, std::move(s)));
+    }
+
+    void addQuery(const Query &t)
+    {
+        queries_.emplace_back(std::make_tuple(E_QUERY_AND, (std::string)t));
+    }
+
+    template <typename T>
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<char *, typename std::decay<T>::type>::value,
+                            Query &>::type
+    where(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<char *, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
+    where(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(std::string(val));
+        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Query &>::type //处理std::string类参数，原样拼接，可以是列名或表达式
+    where(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + val;
+        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
+        return *this;
+    }
+
+    //字符串值，转义并加引号
+    Query &whereValue(const std::string &field, const std::string &expr, const std::string &val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::make_tuple(E_QUERY_AND, std::move(query)));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<char *, typename std::decay<T>::type>::value,
+                            Query &>::type
+    orWhere(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<char *, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
+    orWhere(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(std::string(val));
+        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Query &>::type //处理char*类参数
+    orWhere(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::make_tuple(E_QUERY_OR, std::move(query)));
+        return *this;
+    }
+
+  public:
+    std::vector<std::tuple<E_QUERY_CONNECTOR, std::string>> queries_;
+};
+
+class Table
+{
+  public:
+    Table(const std::string &table)
+    {
+        table_name_ = table;
+    }
+    virtual ~Table()
+    {
+    }
+    void setConn(std::weak_ptr<sql::Connection> conn)
+    {
+        weak_conn_ = conn;
+    }
+
+    std::shared_ptr<sql::Connection> getConn()
+    {
+        return weak_conn_.lock();
+    }
+
+    //查询按这个策略自动重试，写操作只有标记了idempotent()才重试
+    void setRetryPolicy(const RetryPolicy &policy)
+    {
+        retry_policy_ = policy;
+    }
+
+    //标记本次写操作可以安全地重复执行(例如按主键设置固定值)，出错时按重试策略重试，在update()/insert()等之后调用
+    Table &idempotent()
+    {
+        idempotent_ = true;
+        return *this;
+    }
+
+  public:
+    template <typename T>
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<const char *, typename std::decay<T>::type>::value,
+                            Table &>::type
+    where(const std::string &field, const std::string &expr, T &&val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        Query q(E_QUERY_AND, std::move(query));
+        queries_.emplace_back(std::move(q));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<typename std::decay<T>::type, const char *>::value, Table &>::type //const char*
+    where(const std::string &field, const std::string &expr, T &&val)
+    { //const char*
+        std::string query;
+        query = field + expr + sqlLiteral(std::string(val));
+        Query q(E_QUERY_AND, std::move(query));
+        queries_.emplace_back(std::move(q));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<typename std::decay<T>::type, std::string>::value, Table &>::type //std::string
+    where(const std::string &field, const std::string &expr, T &&val)
+    { //
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        Query q(E_QUERY_AND, std::move(query));
+        queries_.emplace_back(std::move(q));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<const char *, typename std::decay<T>::type>::value,
+                            Table &>::type
+    orWhere(const std::string &field, const std::string &expr, T &&val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<typename std::decay<T>::type, std::string>::value, Table &>::type //std::string
+    orWhere(const std::string &field, const std::string &expr, T &&val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(val);
+        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<typename std::decay<T>::type, const char *>::value, Table &>::type //char*
+    orWhere(const std::string &field, const std::string &expr, T val)
+    {
+        std::string query;
+        query = field + expr + sqlLiteral(std::string(val));
+        queries_.emplace_back(std::move(std::make_tuple(E_QUERY_OR, std::move(query))));
+        return *this;
+    }
+
+    template <typename... T>
+    Table &whereOrg(T... args)
+    { //直接写表达式的方式，例如直接写 id = 12345 AND name = 'liming'，这些需要用AND连接起来
+        Query query;
+        std::vector<std::string> ws = {(0, args)...};
+        for (const auto &w : ws)
+        {
+            Query q(E_QUERY_AND, std::move(w));
+            query.addQuery(std::move(q));
+        }
+        queries_.emplace_back(std::move(query));
+        return *this;
+    }
+
+    template <typename... T>
+    Table &orWhereOrg(T... args)
+    { //直接写表达式,所有参数都要传string类型
+        Query query;
+        std::vector<std::string> ws = {(0, args)...};
+        for (const auto &w : ws)
+        {
+            Query q(E_QUERY_AND, std::move(w));
+            query.addQuery(std::move(q));
+        }
+        queries_.emplace_back(std::move(query));
+        return *this;
+    }
+
+    using QUERY_GENERATOR = std::function<void(Query&)>;
+    Table &where(const QUERY_GENERATOR &query_generator)
+    {
+        Query query;
+        query_generator(query);
+        Query q(E_QUERY_AND, "(" + std::string(query) + ")");
+        queries_.emplace_back(std::move(q));
+        return *this;
+    }
+
+    template <typename... FIELDS>
+    Table &select(FIELDS... f)
+    { //无类型检查
+        reset();
+        std::string sql;
+        std::vector<std::string> fields = {(0, f)...};
+        fields_ = fields;
+        op_ = E_OP_SELECT;
+        return *this;
+    }
+
+    Table &select(const std::vector<std::string> &fields)
+    {
+        reset();
+        fields_ = fields;
+        op_ = E_OP_SELECT;
+        return *this;
+    }
+
+    //只对select有效，可以多次调用
+    Table &orderBy(const std::string &field, bool desc = false)
+    {
+        if (op_ == E_OP_SELECT)
+        {
+            order_by_.emplace_back(desc ? field + " DESC" : field);
+        }
+        return *this;
+    }
+
+    //只对select有效，0表示不限制
+    Table &limit(size_t n)
+    {
+        if (op_ == E_OP_SELECT)
+        {
+            limit_ = n;
+        }
+        return *this;
+    }
+
+    Table &update()
+    {
+        reset();
+        op_ = E_OP_UPDATE;
+        return *this;
+    }
+
+    template <typename T> //common template
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<const char *, typename std::decay<T>::type>::value,
+                            Table &>::type
+    set(const std::string &field, T v)
+    {
+        if (op_ == E_OP_UPDATE)
+        {
+            update_fields_values_.insert(std::make_pair(field, sqlLiteral(v)));
+        }
+        return *this;
+    }
+
+    template <typename T> //string template
+    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Table &>::type
+    set(const std::string &field, T v)
+    {
+        if (op_ == E_OP_UPDATE)
+        {
+            update_fields_values_.insert(std::make_pair(field, sqlLiteral(v)));
+        }
+        return *this;
+    }
+
+    template <typename T> //char * template
+    typename std::enable_if<std::is_same<const char *, typename std::decay<T>::type>::value, Table &>::type
+    set(const std::string &field, T v)
+    {
+        if (op_ == E_OP_UPDATE)
+        {
+            update_fields_values_.insert(std::make_pair(field, sqlLiteral(std::string(v))));
+        }
+        return *this;
+    }
+
+    template <typename... FIELDS>
+    Table &insert(FIELDS... f)
+    {
+        reset();
+        op_ = E_OP_INSERT;
+        std::vector<std::string> fields = {(0, f)...};
+        fields_ = fields;
+        return *this;
+    }
+
+    Table &values()
+    {
+        return *this;
+    }
+
+    template <typename T> //一个参数的
+    typename std::enable_if<!std::is_same<std::string, typename std::decay<T>::type>::value &&
+                                !std::is_same<const char *, typename std::decay<T>::type>::value,
+                            Table &>::type
+    values(T && v)
+    {
+        if (op_ == E_OP_INSERT || op_ == E_OP_UPSERT)
+        {
+            values_.push_back(sqlLiteral(v));
+        }
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<std::string, typename std::decay<T>::type>::value, Table &>::type // std::string
+    values(T && v)
+    {
+        if (op_ == E_OP_INSERT || op_ == E_OP_UPSERT)
+        {
+            values_.push_back(sqlLiteral(v));
+        }
+        return *this;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<const char *, typename std::decay<T>::type>::value, Table &>::type // char*
+    values(T && v)
+    {
+        if (op_ == E_OP_INSERT || op_ == E_OP_UPSERT)
+        {
+            values_.push_back(sqlLiteral(std::string(v)));
+        }
+        return *this;
+    }
+
+    template <typename T, typename... REST> //至少两个参数的
+    Table &values(T && v, REST... vs)
+    {
+        if (op_ == E_OP_INSERT || op_ == E_OP_UPSERT)
+        {
+            return values(std::forward<T>(v)).values(vs...);
+        }
+        return *this;
+    }
+
+    Table &del()
+    {
+        reset();
+        op_ = E_OP_DELETE;
+        return *this;
+    }
+
+    /*
+    * INSERT ... ON DUPLICATE KEY UPDATE，多次调用values()可以一次写入多行，例如:
+    * upsert("task_id", "status").values("t1", 1).values("t2", 2).onDuplicateValues("status").executeUpsert();
+    * 不指定onDuplicate时，所有字段都用新值更新
+    */
+    template <typename... FIELDS>
+    Table &upsert(FIELDS... f)
+    {
+        reset();
+        op_ = E_OP_UPSERT;
+        std::vector<std::string> fields = {(0, f)...};
+        fields_ = fields;
+        return *this;
+    }
+
+    //主键冲突时字段的更新表达式，例如onDuplicate("retry", "retry+1")
+    Table &onDuplicate(const std::string &field, const std::string &expr)
+    {
+        if (op_ == E_OP_UPSERT)
+        {
+            update_fields_values_[field] = expr;
+        }
+        return *this;
+    }
+
+    //主键冲突时这些字段取新插入的值
+    template <typename... FIELDS>
+    Table &onDuplicateValues(FIELDS... f)
+    {
+        std::vector<std::string> fields = {(0, f)...};
+        for (const auto &field : fields)
+        {
+            onDuplicate(field, "VALUES(" + field + ")");
+        }
+        return *this;
+    }
+
+    std::string get_sql()
+    {
+        std::string sql;
+        if (op_ == E_OP_SELECT)
+        {
+            sql = genSelectSql();
+        }
+        else if (op_ == E_OP_UPDATE)
+        {
+            sql = genUpdateSql();
+        }
+        else if (op_ == E_OP_INSERT)
+        {
+            sql = genInsertSql();
+        }
+        else if (op_ == E_OP_DELETE)
+        {
+            sql = genDeleteSql();
+        }
+        else if (op_ == E_OP_UPSERT && fields_.size() > 0)
+        {
+            sql = genUpsertSql(0, values_.size() / fields_.size());
+        }
+        reset();
+        return sql;
+    }
+
+    std::shared_ptr<sql::ResultSet> executeQuery()
+    {
+        std::string sql = genSelectSql();
+        if (sql.empty())
+        {
+            reset();
+            return nullptr;
+        }
+
+        std::shared_ptr<sql::ResultSet> res = querySql(sql);
+        reset();
+        return res;
+    }
+
+    /*
+    * @fun:在驱动上执行查询(见db_driver.h)，不经过Connector/C++。按重试策略重试，开启跟踪时记录；
+    *      I/O统计和QueryWatchdog只支持sql::Connection，这里不做，截止时间靠MAX_EXECUTION_TIME提示
+    * @param[in] driver 驱动，例如从MySqlConnPool<DriverConn<NativeDriver>>借出的连接的driver()
+    * @param[out] error_code 不为空时返回错误码：0：成功；>0：mysql错误码；-1：sql不合法；-2：连接无效；-4：超时
+    * @return nullptr：出错；非nullptr：已执行的语句，用next()读取，可以用 RowMapper<T, DRIVER::STATEMENT> 解码
+    */
+    template <typename DRIVER>
+    std::unique_ptr<typename DRIVER::STATEMENT> executeQuery(DRIVER &driver, int *error_code = nullptr)
+    {
+        std::string sql = genSelectSql();
+        reset();
+        std::unique_ptr<typename DRIVER::STATEMENT> stmt;
+        int err = sql.empty() ? -1 : runDriverSql(driver, E_OP_SELECT, sql, true, [&](DRIVER &d) -> int {
+            stmt = d.prepare(applyDeadlineHint(sql));
+            if (!stmt)
+            {
+                return d.errorCode() != 0 ? d.errorCode() : -1;
+            }
+            int ret = stmt->execute();
+            if (ret != 0)
+            { //重试前驱动可能重连，语句必须先释放
+                stmt.reset();
+            }
+            return ret;
+        });
+        if (error_code)
+        {
+            *error_code = err;
+        }
+        if (err != 0)
+        {
+            stmt.reset();
+        }
+        return stmt;
+    }
+
+    /*
+    * @fun:带缓存的查询，命中时不访问数据库；同一张表在本进程内有写操作后缓存自动失效
+    * @param[in] cache 查询缓存
+    * @return nullptr：sql不合法、连接无效或执行出错；非nullptr：结果游标，可以用RowMapper解码
+    */
+    std::shared_ptr<CachedResultSet> executeCachedQuery(QueryCache &cache)
+    {
+        std::string sql = genSelectSql();
+        reset();
+        if (sql.empty())
+        {
+            return nullptr;
+        }
+
+        std::string key = QueryCache::normalize(sql);
+        std::shared_ptr<CachedResultSet> cached = cache.get(key, table_name_);
+        if (cached)
+        {
+            return cached;
+        }
+
+        uint64_t version = TableVersions::get(table_name_); //必须在查询之前读
+        std::shared_ptr<sql::ResultSet> res = querySql(sql);
+        if (!res)
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<const CachedResult> result;
+        try
+        {
+            result = std::make_shared<const CachedResult>(*res);
+        }
+        catch (sql::SQLException &)
+        {
+            return nullptr;
+        }
+        cache.put(key, table_name_, version, result);
+        return std::make_shared<CachedResultSet>(result);
+    }
+
+    /*
+    * @fun:合并并发的相同查询，同一条sql同时只有一个调用访问数据库，其他调用共享它的结果
+    * @param[in] flight 合并器，多个Table共用一个
+    * @return nullptr：sql不合法、连接无效或执行出错；非nullptr：结果游标，可以用RowMapper解码
+    */
+    std::shared_ptr<CachedResultSet> executeSharedQuery(QUERY_FLIGHT &flight)
+    {
+        std::string sql = genSelectSql();
+        reset();
+        if (sql.empty())
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<const CachedResult> result = flight.doCall(QueryCache::normalize(sql), [&]() {
+            std::shared_ptr<const CachedResult> r;
+            std::shared_ptr<sql::ResultSet> res = querySql(sql);
+            if (res)
+            {
+                try
+                {
+                    r = std::make_shared<const CachedResult>(*res);
+                }
+                catch (sql::SQLException &)
+                {
+                }
+            }
+            return r;
+        });
+
+        if (!result)
+        {
+            return nullptr;
+        }
+        return std::make_shared<CachedResultSet>(result);
+    }
+
+    /*
+    * @fun:流式执行查询，不在客户端缓存整个结果集
+    * @param[in] fetch_size 游标每批读取的行数
+    * @return nullptr：sql不合法、连接无效或执行出错；非nullptr：游标
+    */
+    std::shared_ptr<RowCursor> executeCursor(size_t fetch_size = 1000)
+    {
+        std::string sql = genSelectSql();
+        if (sql.empty())
+        {
+            reset();
+            return nullptr;
+        }
+        std::shared_ptr<RowCursor> cursor;
+        runSql(E_OP_SELECT, sql, true, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            stmt->setResultSetType(sql::ResultSet::TYPE_FORWARD_ONLY);
+            std::shared_ptr<sql::ResultSet> res;
+            res.reset(IoScope::roundTrip(sql.size(), [&]() { return stmt->executeQuery(applyDeadlineHint(sql)); }));
+            cursor = std::make_shared<RowCursor>(stmt, res, fetch_size);
+            return -1; //流式读取，行数未知
+        }, false); //结果还没读完，不能在连接上采样
+
+        reset();
+        return cursor;
+    }
+
+    int executeInsert()
+    {
+        std::string sql = genInsertSql();
+        // std::cout << "executeInsert:"<< sql<<std::endl;
+        if (sql.empty())
+        {
+            reset();
+            return -1;
+        }
+
+        int ret = 0;
+        int err = runSql(E_OP_INSERT, sql, idempotent_, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            WatchdogGuard guard(conn);
+            std::shared_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(sql); }));
+            ret = IoScope::roundTrip(0, [&]() { return pstmt->executeUpdate(); });
+            return ret;
+        });
+        reset();
+        if (err == 0)
+        {
+            TableVersions::bump(table_name_); //让查询缓存失效
+        }
+        else if (err == -1 || err == -2 || err == -4)
+        {
+            return err;
+        }
+        else if (err == 1062)
+        { //duplicate key
+            return -3;
+        }
+        return ret;
+    }
+
+    /*
+    * @fun:执行upsert，行数多时按chunk_rows分成多条语句，各自提交
+    * @param[in] chunk_rows 每条语句最多的行数
+    * @param[out] error_code 不为空时返回出错语句的错误码(0：成功；>0：mysql错误码；<0：同runSql)
+    * @return 影响行数(插入的行算1，更新的行算2)；-1：sql不合法、客户端错误或其他mysql错误；-2：连接无效；
+    *         -3：主键冲突；-4：超时。出错时在它之前的块可能已经写入，出错的块和之后的块没有执行
+    */
+    int executeUpsert(size_t chunk_rows = 500, int *error_code = nullptr)
+    {
+        if (error_code)
+        {
+            *error_code = 0;
+        }
+        if (E_OP_UPSERT != op_ || fields_.size() <= 0 || values_.size() <= 0 || values_.size() % fields_.size() != 0)
+        {
+            reset();
+            return -1;
+        }
+
+        chunk_rows = chunk_rows > 0 ? chunk_rows : 1;
+        size_t rows = values_.size() / fields_.size();
+        int ret = 0;
+        int err = 0;
+        size_t begin = 0;
+        for (; begin < rows && err == 0; begin += chunk_rows)
+        { //每块单独执行、跟踪和重试，跟踪和抓包里记录的是实际执行的语句
+            std::string chunk_sql = genUpsertSql(begin, std::min(rows, begin + chunk_rows));
+            err = runSql(E_OP_UPSERT, chunk_sql, idempotent_, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+                WatchdogGuard guard(conn);
+                std::shared_ptr<sql::Statement> stmt;
+                stmt.reset(conn->createStatement());
+                int affected = IoScope::roundTrip(chunk_sql.size(), [&]() { return stmt->executeUpdate(chunk_sql); });
+                ret += affected;
+                return affected;
+            });
+        }
+        reset();
+        if (error_code)
+        {
+            *error_code = err;
+        }
+        if (err == -2 && begin == chunk_rows)
+        { //第一块就取不到连接，什么都没有写
+            return -2;
+        }
+        TableVersions::bump(table_name_); //让查询缓存失效，出错时前面的块可能已经写入
+        if (err == 1062)
+        { //duplicate key
+            return -3;
+        }
+        else if (err > 0)
+        { //影响行数也是正数，mysql错误码从error_code取
+            return -1;
+        }
+        return err < 0 ? err : ret;
+    }
+
+    int executeUpdate()
+    {
+        std::string sql = genUpdateSql();
+        // std::cout << "executeUpdate:"<< sql<<std::endl;
+        if (sql.empty())
+        {
+            reset();
+            return -1;
+        }
+
+        int ret = 0;
+        int err = runSql(E_OP_UPDATE, sql, idempotent_, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            WatchdogGuard guard(conn);
+            std::shared_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(sql); }));
+            ret = IoScope::roundTrip(0, [&]() { return pstmt->executeUpdate(); });
+            return ret;
+        });
+        reset();
+        if (err == -1 || err == -2 || err == -4)
+        {
+            return err;
+        }
+        if (err == 0)
+        {
+            TableVersions::bump(table_name_); //让查询缓存失效
+        }
+        return ret;
+    }
+
+    /*
+    * @fun:在驱动上执行更新(见db_driver.h)，文本协议一次往返。标记了idempotent()时按重试策略重试
+    * @param[in] driver 驱动
+    * @return 影响行数；-1：sql不合法或执行出错；-2：连接无效；-3：主键冲突；-4：超时
+    */
+    template <typename DRIVER>
+    int executeUpdate(DRIVER &driver)
+    {
+        std::string sql = genUpdateSql();
+        bool retry = idempotent_;
+        reset();
+        if (sql.empty())
+        {
+            return -1;
+        }
+
+        uint64_t affected = 0;
+        int err = runDriverSql(driver, E_OP_UPDATE, sql, retry, [&](DRIVER &d) -> int {
+            return d.execute(sql, &affected);
+        });
+        if (err == 0)
+        {
+            TableVersions::bump(table_name_); //让查询缓存失效
+            return static_cast<int>(affected);
+        }
+        else if (err == 1062)
+        { //duplicate key
+            return -3;
+        }
+        return err < 0 ? err : -1;
+    }
+
+    int executeDelete()
+    {
+        std::string sql = genDeleteSql();
+        // std::cout << "executeUpdate:"<< sql<<std::endl;
+        if (sql.empty())
+        {
+            reset();
+            return -1;
+        }
+
+        bool ret = false;
+        int err = runSql(E_OP_DELETE, sql, idempotent_, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            WatchdogGuard guard(conn);
+            std::shared_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(sql); }));
+            ret = IoScope::roundTrip(0, [&]() { return pstmt->execute(); });
+            return pstmt->getUpdateCount();
+        });
+        reset();
+        if (err == 0)
+        {
+            TableVersions::bump(table_name_); //让查询缓存失效
+        }
+        else if (err == -1 || err == -4)
+        {
+            return err;
+        }
+        return ret ? 0 : -2;
+    }
+
+  private:
+    /*
+    * @fun:在当前连接上执行fn，见runTrackedSql
+    * @param[in] op、sql 用于跟踪
+    * @param[in] retry 是否允许重试，不幂等的写操作不能重试
+    * @param[in] fn 执行体，返回结果或影响的行数，未知时返回-1
+    * @param[in] sample_io 是否参与I/O采样，见runTrackedSql
+    * @return 0：成功；>0：mysql错误码；-1：客户端错误；-2：连接无效；-4：超过QueryDeadline
+    */
+    template <typename FN>
+    int runSql(E_MYSQL_OP op, const std::string &sql, bool retry, FN &&fn, bool sample_io = true)
+    {
+        return runTrackedSql(weak_conn_.lock(), op, table_name_, sql, retry ? retry_policy_ : RetryPolicy::none(), std::forward<FN>(fn),
+                             sample_io);
+    }
+
+    //runSql的驱动版本，fn返回驱动的错误码
+    template <typename DRIVER, typename FN>
+    int runDriverSql(DRIVER &driver, E_MYSQL_OP op, const std::string &sql, bool retry, FN &&fn)
+    {
+        QueryTraceScope trace(op, table_name_, sql, reinterpret_cast<uintptr_t>(&driver));
+        int err = runDriverWithRetry(retry ? retry_policy_ : RetryPolicy::none(), driver, fn);
+        trace.finish(-1, err);
+        return err;
+    }
+
+    std::shared_ptr<sql::ResultSet> querySql(const std::string &sql)
+    {
+        std::shared_ptr<sql::ResultSet> res;
+        runSql(E_OP_SELECT, sql, true, [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            std::shared_ptr<sql::PreparedStatement> pstmt;
+            pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(applyDeadlineHint(sql)); }));
+            res.reset(IoScope::roundTrip(0, [&]() { return pstmt->executeQuery(); }));
+            return res->rowsCount();
+        });
+        return res;
+    }
+
+    std::string genSelectSql()
+    {
+        if (E_OP_SELECT != op_)
+        {
+            return "";
+        }
+        
+        std::string select_fields;
+        if (fields_.size() <= 0)
+        {
+            return "";
+        }
+
+        if (std::count_if(fields_.begin(), fields_.end(), [](const std::string &f) { return f == "*"; }) > 0)
+        {
+            select_fields = "*";
+        }
+        else
+        {
+            select_fields = boost::join(fields_, ",");
+        }
+
+        std::string query_where;
+        for (auto it = queries_.begin(); it != queries_.end(); it++)
+        {
+            if (it != queries_.begin())
+            {
+                query_where += " AND (" + std::string(*it) + ")";
+            }
+            else
+            {
+                query_where += "(" + std::string(*it) + ")";
+            }
+        }
+
+        std::string sql = "SELECT " + select_fields + " FROM " + table_name_;
+        if (!query_where.empty())
+        {
+            sql += " WHERE " + query_where;
+        }
+        if (!order_by_.empty())
+        {
+            sql += " ORDER BY " + boost::join(order_by_, ",");
+        }
+        if (limit_ > 0)
+        {
+            sql += " LIMIT " + std::to_string(limit_);
+        }
+        return sql;
+    }
+
+    std::string genUpdateSql()
+    {
+        if (E_OP_UPDATE != op_)
+        {
+            return "";
+        }
+
+        if (update_fields_values_.size() <= 0)
+        {
+            return "";
+        }
+
+        std::vector<std::string> field_values_vec;
+        for (const auto &fv : update_fields_values_)
+        {
+            field_values_vec.emplace_back(fv.first + "=" + fv.second);
+        }
+
+        std::string field_values = boost::join(field_values_vec, ",");
+
+        std::string update_where;
+        for (auto it = queries_.begin(); it != queries_.end(); it++)
+        {
+            if (it != queries_.begin())
+            {
+                update_where += " AND (" + std::string(*it) + ")";
+            }
+            else
+            {
+                update_where += "(" + std::string(*it) + ")";
+            }
+        }
+
+        std::string sql = "UPDATE " + table_name_ + " SET " + field_values + " WHERE " + update_where;
+        return sql;
+    }
+
+    std::string genInsertSql()
+    {
+        if (E_OP_INSERT != op_)
+        {
+            return "";
+        }
+
+        std::string insert_fields;
+        if (fields_.size() <= 0)
+        {
+            return "";
+        }
+        insert_fields = boost::join(fields_, ",");
+
+        std::string str_values;
+        str_values = boost::join(values_, ",");
+
+        std::string sql = "INSERT INTO " + table_name_ + "(" + insert_fields + ")" + " VALUES(" + str_values + ")";
+        return sql;
+    }
+
+    //生成[begin, end)行的upsert语句
+    std::string genUpsertSql(size_t begin, size_t end)
+    {
+        if (E_OP_UPSERT != op_ || fields_.size() <= 0 || begin >= end || end * fields_.size() > values_.size())
+        {
+            return "";
+        }
+
+        std::string rows_values;
+        for (size_t r = begin; r < end; r++)
+        {
+            auto first = values_.begin() + r * fields_.size();
+            std::vector<std::string> row(first, first + fields_.size());
+            if (r != begin)
+            {
+                rows_values += ",";
+            }
+            rows_values += "(" + boost::join(row, ",") + ")";
+        }
+
+        std::vector<std::string> field_values_vec;
+        if (update_fields_values_.size() > 0)
+        {
+            for (const auto &fv : update_fields_values_)
+            {
+                field_values_vec.emplace_back(fv.first + "=" + fv.second);
+            }
+        }
+        else
+        {
+            for (const auto &f : fields_)
+            {
+                field_values_vec.emplace_back(f + "=VALUES(" + f + ")");
+            }
+        }
+
+        std::string sql = "INSERT INTO " + table_name_ + "(" + boost::join(fields_, ",") + ") VALUES" + rows_values +
+                          " ON DUPLICATE KEY UPDATE " + boost::join(field_values_vec, ",");
+        return sql;
+    }
+
+    std::string genDeleteSql()
+    {
+        if (E_OP_DELETE != op_)
+        {
+            return "";
+        }
+
+        if (queries_.size() <= 0)
+        { //不能全部删
+            return "";
+        }
+
+        std::string delete_where;
+        for (auto it = queries_.begin(); it != queries_.end(); it++)
+        {
+            if (it != queries_.begin())
+            {
+                delete_where += " AND (" + std::string(*it) + ")";
+            }
+            else
+            {
+                delete_where += "(" + std::string(*it) + ")";
+            }
+        }
+
+        std::string sql = "DELETE FROM " + table_name_ + " WHERE " + delete_where;
+        return sql;
+    }
+
+    void reset()
+    {
+        op_ = E_OP_NONE;
+        update_fields_values_.clear();
+        fields_.clear();
+        values_.clear();
+        queries_.clear();
+        order_by_.clear();
+        limit_ = 0;
+        idempotent_ = false;
+    }
+
+    E_MYSQL_OP op_ = E_OP_NONE;
+    std::weak_ptr<sql::Connection> weak_conn_;
+    std::string table_name_;
+    std::map<std::string, std::string> update_fields_values_;
+    std::vector<std::string> fields_;
+    std::vector<std::string> values_;
+    std::vector<Query> queries_;
+    std::vector<std::string> order_by_;
+    size_t limit_ = 0;
+    RetryPolicy retry_policy_;
+    bool idempotent_ = false;
+};
 #endif
\ No newline at end of file
@@ -0,0 +1,528 @@
+#ifndef IO_ACCOUNTING_H_
+#define IO_ACCOUNTING_H_
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "query_trace.h"
+
+/*
+* 当前线程的调用方标签，作用域内Table的操作都记在这个标签下，嵌套时用最内层的。用法:
+*   IoTag tag("course.list");
+*   auto res = table.select("*").where("course_id", "=", id).executeQuery();
+*/
+class IoTag
+{
+  public:
+    explicit IoTag(const std::string &tag)
+    {
+        prev_ = slot();
+        slot() = tag;
+    }
+
+    ~IoTag()
+    {
+        slot() = prev_;
+    }
+
+    IoTag(const IoTag &) = delete;
+    IoTag &operator=(const IoTag &) = delete;
+
+    static const std::string &current()
+    {
+        return slot();
+    }
+
+  private:
+    static std::string &slot()
+    {
+        static thread_local std::string tag;
+        return tag;
+    }
+
+    std::string prev_;
+};
+
+struct IoCounters
+{
+    std::atomic<uint64_t> ops{0};
+    std::atomic<uint64_t> round_trips{0};
+    std::atomic<uint64_t> bytes_sent{0};       //按语句长度估算，每次都统计
+    std::atomic<uint64_t> server_us{0};        //在IoScope::roundTrip包住的驱动调用里的时间，包括网络传输
+    std::atomic<uint64_t> client_us{0};        //操作内其余的时间：建语句、解码、重连、重试等待等；结果集在操作结束后读的部分不算
+    std::atomic<uint64_t> sampled_ops{0};      //采样了服务端字节数的操作
+    std::atomic<uint64_t> sampled_bytes_sent{0};
+    std::atomic<uint64_t> sampled_bytes_received{0};
+};
+
+/*
+* 按 表+操作+调用方标签 以及按连接统计往返次数、字节数和服务端/客户端时间，用来判断瓶颈是往返次数还是传输量。
+* 开启后Table的每个操作都会统计；setSampleEvery(n)后每n个操作在同一连接上前后各查一次
+* SHOW SESSION STATUS LIKE 'Bytes_%'，得到准确的收发字节数，多两次往返，所以只用于采样。
+* 每个线程缓存取过的计数器，命中时不加锁；reset()和淘汰连接时让所有线程的缓存失效
+*/
+class IoAccounting
+{
+  public:
+    struct Entry
+    {
+        std::string table;
+        int op = 0;
+        std::string tag;
+        std::shared_ptr<IoCounters> counters;
+    };
+
+    static IoAccounting &instance()
+    {
+        static IoAccounting accounting;
+        return accounting;
+    }
+
+    static bool enabled()
+    {
+        return instance().enabled_.load(std::memory_order_relaxed);
+    }
+
+    void enable(bool on)
+    {
+        enabled_.store(on, std::memory_order_relaxed);
+    }
+
+    //0表示不采样
+    void setSampleEvery(uint32_t n)
+    {
+        sample_every_.store(n, std::memory_order_relaxed);
+    }
+
+    bool shouldSample()
+    {
+        uint32_t n = sample_every_.load(std::memory_order_relaxed);
+        return n > 0 && sample_seq_.fetch_add(1, std::memory_order_relaxed) % n == 0;
+    }
+
+    std::shared_ptr<IoCounters> counters(const std::string &table, int op, const std::string &tag)
+    {
+        ThreadCache &cache = threadCache();
+        syncCache(cache);
+        auto it = cache.by_op.find(std::tie(table, op, tag)); //不拷贝字符串
+        if (it != cache.by_op.end())
+        {
+            return it->second;
+        }
+
+        std::shared_ptr<IoCounters> c;
+        {
+            std::lock_guard<std::mutex> lck(mutex_);
+            auto found = by_op_.find(std::tie(table, op, tag));
+            if (found == by_op_.end())
+            {
+                found = by_op_.emplace(std::make_tuple(table, op, tag), std::make_shared<IoCounters>()).first;
+            }
+            c = found->second;
+        }
+        if (cache.by_op.size() >= thread_cache_size)
+        {
+            cache.by_op.clear();
+        }
+        cache.by_op.emplace(std::make_tuple(table, op, tag), c);
+        return c;
+    }
+
+    /*
+    * @fun:按连接的计数，conn_key是sql::Connection的地址。连接重建后地址会变，
+    *      超过max_conns个时淘汰最久没用的1/4连接，淘汰掉的数据仍然在按 表+操作 的统计里
+    */
+    std::shared_ptr<IoCounters> connCounters(uint64_t conn_key)
+    {
+        ThreadCache &cache = threadCache();
+        syncCache(cache);
+        auto it = cache.by_conn.find(conn_key);
+        if (it == cache.by_conn.end())
+        {
+            std::shared_ptr<ConnEntry> e = connEntry(conn_key);
+            if (cache.by_conn.size() >= thread_cache_size)
+            {
+                cache.by_conn.clear();
+            }
+            it = cache.by_conn.emplace(conn_key, e).first;
+        }
+        ConnEntry &e = *it->second;
+        uint64_t now = nowMs();
+        if (e.last_used.load(std::memory_order_relaxed) != now)
+        { //每毫秒最多写一次，多个线程用同一连接时不反复写同一缓存行
+            e.last_used.store(now, std::memory_order_relaxed);
+        }
+        return e.counters;
+    }
+
+    //按连接统计最多保留的连接数，一般设成连接池上限的几倍
+    void setMaxConns(size_t n)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        max_conns_ = n > 0 ? n : 1;
+    }
+
+    std::vector<Entry> entries()
+    {
+        std::vector<Entry> all;
+        std::lock_guard<std::mutex> lck(mutex_);
+        for (const auto &kv : by_op_)
+        {
+            all.push_back(Entry{std::get<0>(kv.first), std::get<1>(kv.first), std::get<2>(kv.first), kv.second});
+        }
+        return all;
+    }
+
+    std::vector<std::pair<uint64_t, std::shared_ptr<IoCounters>>> connEntries()
+    {
+        std::vector<std::pair<uint64_t, std::shared_ptr<IoCounters>>> all;
+        std::lock_guard<std::mutex> lck(mutex_);
+        for (const auto &kv : by_conn_)
+        {
+            all.emplace_back(kv.first, kv.second->counters);
+        }
+        return all;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        by_op_.clear();
+        by_conn_.clear();
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    /*
+    * @fun:文本报表，每个 表+操作+标签 一行：操作数、平均往返次数、平均发送字节(估算)、
+    *      采样得到的平均收发字节、平均服务端/客户端时间和服务端时间占比
+    */
+    std::string report()
+    {
+        std::string out;
+        char line[512];
+        snprintf(line, sizeof(line), "%-24s %-7s %-20s %10s %8s %10s %12s %12s %10s %10s %8s\n", "table", "op", "tag", "ops", "rtt/op",
+                 "sent/op", "s_sent/op", "s_recv/op", "server_us", "client_us", "server%");
+        out += line;
+        for (const auto &e : entries())
+        {
+            const IoCounters &c = *e.counters;
+            double ops = static_cast<double>(c.ops.load(std::memory_order_relaxed));
+            double sampled = static_cast<double>(c.sampled_ops.load(std::memory_order_relaxed));
+            double server_us = static_cast<double>(c.server_us.load(std::memory_order_relaxed));
+            double client_us = static_cast<double>(c.client_us.load(std::memory_order_relaxed));
+            if (ops <= 0)
+            {
+                continue;
+            }
+            snprintf(line, sizeof(line), "%-24s %-7s %-20s %10.0f %8.2f %10.0f %12.0f %12.0f %10.1f %10.1f %7.1f%%\n",
+                     e.table.c_str(), traceOpName(e.op), e.tag.empty() ? "-" : e.tag.c_str(), ops, c.round_trips.load(std::memory_order_relaxed) / ops,
+                     c.bytes_sent.load(std::memory_order_relaxed) / ops,
+                     sampled > 0 ? c.sampled_bytes_sent.load(std::memory_order_relaxed) / sampled : 0.0,
+                     sampled > 0 ? c.sampled_bytes_received.load(std::memory_order_relaxed) / sampled : 0.0,
+                     server_us / ops, client_us / ops, server_us + client_us > 0 ? 100.0 * server_us / (server_us + client_us) : 0.0);
+            out += line;
+        }
+        return out;
+    }
+
+    /*
+    * @fun:读连接的Bytes_received/Bytes_sent(服务端视角)
+    * @return false：查询失败
+    */
+    static bool serverBytes(const std::shared_ptr<sql::Connection> &conn, uint64_t &received, uint64_t &sent)
+    {
+        try
+        {
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            std::shared_ptr<sql::ResultSet> res;
+            res.reset(stmt->executeQuery("SHOW SESSION STATUS LIKE 'Bytes_%'"));
+            int found = 0;
+            while (res && res->next())
+            {
+                std::string name = res->getString(1);
+                if (name == "Bytes_received")
+                {
+                    received = res->getUInt64(2);
+                    found++;
+                }
+                else if (name == "Bytes_sent")
+                {
+                    sent = res->getUInt64(2);
+                    found++;
+                }
+            }
+            return found == 2;
+        }
+        catch (sql::SQLException &)
+        {
+            return false;
+        }
+    }
+
+    /*
+    * 两次SHOW STATUS之间的差值包含一次SHOW的请求和响应，第一次采样时在同一连接上连续查两次测出这部分，之后减掉
+    */
+    bool overhead(const std::shared_ptr<sql::Connection> &conn, uint64_t &received, uint64_t &sent)
+    {
+        if (overhead_ready_.load(std::memory_order_acquire))
+        {
+            received = overhead_received_;
+            sent = overhead_sent_;
+            return true;
+        }
+        uint64_t r1 = 0, s1 = 0, r2 = 0, s2 = 0;
+        if (!serverBytes(conn, r1, s1) || !serverBytes(conn, r2, s2))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (!overhead_ready_.load(std::memory_order_relaxed))
+        {
+            overhead_received_ = r2 - r1;
+            overhead_sent_ = s2 - s1;
+            overhead_ready_.store(true, std::memory_order_release);
+        }
+        received = overhead_received_;
+        sent = overhead_sent_;
+        return true;
+    }
+
+  private:
+    using OP_KEY = std::tuple<std::string, int, std::string>;
+    using OP_MAP = std::map<OP_KEY, std::shared_ptr<IoCounters>, std::less<>>; //可以用std::tie查找
+
+    struct ConnEntry
+    {
+        std::shared_ptr<IoCounters> counters = std::make_shared<IoCounters>();
+        std::atomic<uint64_t> last_used{0}; //毫秒
+    };
+
+    struct ThreadCache
+    {
+        const IoAccounting *owner = nullptr;
+        uint64_t generation = 0;
+        OP_MAP by_op;
+        std::unordered_map<uint64_t, std::shared_ptr<ConnEntry>> by_conn;
+    };
+
+    static constexpr size_t thread_cache_size = 1024;
+
+    static ThreadCache &threadCache()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static uint64_t nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void syncCache(ThreadCache &cache)
+    {
+        uint64_t generation = generation_.load(std::memory_order_acquire);
+        if (cache.owner != this || cache.generation != generation)
+        {
+            cache.by_op.clear();
+            cache.by_conn.clear();
+            cache.owner = this;
+            cache.generation = generation;
+        }
+    }
+
+    std::shared_ptr<ConnEntry> connEntry(uint64_t conn_key)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        auto it = by_conn_.find(conn_key);
+        if (it != by_conn_.end())
+        {
+            return it->second;
+        }
+
+        if (by_conn_.size() >= max_conns_)
+        { //一次淘汰1/4，均摊下来每次插入不用扫描
+            std::vector<std::pair<uint64_t, uint64_t>> ages;
+            ages.reserve(by_conn_.size());
+            for (const auto &kv : by_conn_)
+            {
+                ages.emplace_back(kv.second->last_used.load(std::memory_order_relaxed), kv.first);
+            }
+            size_t evict = std::max<size_t>(by_conn_.size() / 4, 1);
+            std::nth_element(ages.begin(), ages.begin() + (evict - 1), ages.end());
+            for (size_t i = 0; i < evict; i++)
+            {
+                by_conn_.erase(ages[i].second);
+            }
+            generation_.fetch_add(1, std::memory_order_release); //其他线程缓存的被淘汰的连接作废
+        }
+        std::shared_ptr<ConnEntry> e = std::make_shared<ConnEntry>();
+        e->last_used.store(nowMs(), std::memory_order_relaxed);
+        by_conn_.emplace(conn_key, e);
+        return e;
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<uint32_t> sample_every_{0};
+    std::atomic<uint64_t> sample_seq_{0};
+    std::mutex mutex_;
+    OP_MAP by_op_;
+    std::unordered_map<uint64_t, std::shared_ptr<ConnEntry>> by_conn_;
+    size_t max_conns_ = 256;
+    std::atomic<uint64_t> generation_{1};
+    std::atomic<bool> overhead_ready_{false};
+    uint64_t overhead_received_ = 0;
+    uint64_t overhead_sent_ = 0;
+};
+
+/*
+* 统计一次Table操作，没有开启时什么都不做。作用域内每次和服务端往返的驱动调用用IoScope::roundTrip包住，
+* 登记往返次数和字节数，调用的耗时记为服务端时间，操作的其余时间记为客户端时间
+*/
+class IoScope
+{
+  public:
+    using CLOCK = std::chrono::steady_clock;
+
+    /*
+    * @param[in] sample 是否参与服务端字节数采样。结果集在操作结束后才流式读取时传false，
+    *            这时连接上还有没读完的结果，再执行SHOW STATUS会报命令不同步(2014)
+    */
+    IoScope(int op, const std::string &table, const std::shared_ptr<sql::Connection> &conn, bool sample = true)
+    {
+        if (!IoAccounting::enabled() || !conn)
+        {
+            return;
+        }
+        active_ = true;
+        conn_ = conn;
+        counters_ = IoAccounting::instance().counters(table, op, IoTag::current());
+        conn_counters_ = IoAccounting::instance().connCounters(reinterpret_cast<uintptr_t>(conn.get()));
+        sampled_ = sample && IoAccounting::instance().shouldSample() && IoAccounting::instance().overhead(conn, overhead_received_, overhead_sent_) &&
+                   IoAccounting::serverBytes(conn, received_before_, sent_before_);
+        begin_ = CLOCK::now(); //采样的查询不计入操作时间
+        prev_ = current();
+        current() = this;
+    }
+
+    ~IoScope()
+    {
+        if (!active_)
+        {
+            return;
+        }
+        current() = prev_;
+
+        uint64_t total_us = std::chrono::duration_cast<std::chrono::microseconds>(CLOCK::now() - begin_).count();
+        uint64_t client_us = total_us > server_us_ ? total_us - server_us_ : 0;
+        uint64_t received_after = 0, sent_after = 0;
+        bool sampled = sampled_ && IoAccounting::serverBytes(conn_, received_after, sent_after);
+        for (IoCounters *c : {counters_.get(), conn_counters_.get()})
+        {
+            c->ops.fetch_add(1, std::memory_order_relaxed);
+            c->round_trips.fetch_add(round_trips_, std::memory_order_relaxed);
+            c->bytes_sent.fetch_add(bytes_sent_, std::memory_order_relaxed);
+            c->server_us.fetch_add(server_us_, std::memory_order_relaxed);
+            c->client_us.fetch_add(client_us, std::memory_order_relaxed);
+            if (sampled)
+            { //客户端发送的是服务端的Bytes_received
+                c->sampled_ops.fetch_add(1, std::memory_order_relaxed);
+                c->sampled_bytes_sent.fetch_add(delta(received_after, received_before_, overhead_received_), std::memory_order_relaxed);
+                c->sampled_bytes_received.fetch_add(delta(sent_after, sent_before_, overhead_sent_), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    IoScope(const IoScope &) = delete;
+    IoScope &operator=(const IoScope &) = delete;
+
+    /*
+    * @fun:执行一次和服务端往返的驱动调用，登记到当前线程正在统计的操作，没有在统计时只执行fn
+    * @param[in] request_bytes 请求的语句长度
+    * @param[in] fn 驱动调用，例如 [&]() { return pstmt->executeUpdate(); }
+    * @return fn的返回值
+    */
+    template <typename FN>
+    static auto roundTrip(size_t request_bytes, FN &&fn) -> decltype(fn())
+    {
+        IoScope *scope = current();
+        if (scope)
+        {
+            scope->round_trips_++;
+            scope->bytes_sent_ += request_bytes + 5; //包头4字节+命令1字节
+        }
+        ServerWait wait;
+        return fn();
+    }
+
+    /*
+    * 在作用域内计时等待服务端的时间，roundTrip已经包含，只给不方便包成一个调用的地方用
+    */
+    class ServerWait
+    {
+      public:
+        ServerWait()
+        {
+            scope_ = current();
+            if (scope_)
+            {
+                begin_ = CLOCK::now();
+            }
+        }
+
+        ~ServerWait()
+        {
+            if (scope_)
+            {
+                scope_->server_us_ += std::chrono::duration_cast<std::chrono::microseconds>(CLOCK::now() - begin_).count();
+            }
+        }
+
+        ServerWait(const ServerWait &) = delete;
+        ServerWait &operator=(const ServerWait &) = delete;
+
+      private:
+        IoScope *scope_;
+        CLOCK::time_point begin_;
+    };
+
+  private:
+    static IoScope *&current()
+    {
+        static thread_local IoScope *scope = nullptr;
+        return scope;
+    }
+
+    static uint64_t delta(uint64_t after, uint64_t before, uint64_t overhead)
+    {
+        uint64_t d = after > before ? after - before : 0;
+        return d > overhead ? d - overhead : 0;
+    }
+
+    bool active_ = false;
+    bool sampled_ = false;
+    IoScope *prev_ = nullptr;
+    std::shared_ptr<sql::Connection> conn_;
+    CLOCK::time_point begin_;
+    std::shared_ptr<IoCounters> counters_;
+    std::shared_ptr<IoCounters> conn_counters_;
+    uint64_t round_trips_ = 0;
+    uint64_t bytes_sent_ = 0;
+    uint64_t server_us_ = 0;
+    uint64_t received_before_ = 0;
+    uint64_t sent_before_ = 0;
+    uint64_t overhead_received_ = 0;
+    uint64_t overhead_sent_ = 0;
+};
+#endif
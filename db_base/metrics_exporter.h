@@ -0,0 +1,374 @@
+#ifndef METRICS_EXPORTER_H_
+#define METRICS_EXPORTER_H_
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "query_trace.h"
+#include "io_accounting.h"
+#include "query_context.h"
+
+/*
+* Prometheus文本格式的输出，同名指标的HELP/TYPE只输出一次
+*/
+class PrometheusWriter
+{
+  public:
+    using LABELS = std::vector<std::pair<std::string, std::string>>;
+
+    void gauge(const std::string &name, const std::string &help, const LABELS &labels, double value)
+    {
+        header(name, help, "gauge");
+        sample(name, labels, value);
+    }
+
+    void counter(const std::string &name, const std::string &help, const LABELS &labels, double value)
+    {
+        header(name, help, "counter");
+        sample(name, labels, value);
+    }
+
+    //直方图的桶是微秒的2的幂，输出时换算成秒
+    void histogram(const std::string &name, const std::string &help, const LABELS &labels, const LatencyHistogram &h)
+    {
+        header(name, help, "histogram");
+        uint64_t cumulative = 0;
+        LABELS bucket_labels = labels;
+        bucket_labels.emplace_back("le", "");
+        for (size_t i = 0; i < LatencyHistogram::bucket_count; i++)
+        {
+            cumulative += h.bucket(i);
+            char le[32];
+            snprintf(le, sizeof(le), "%.10g", static_cast<double>(2ULL << i) / 1e6);
+            bucket_labels.back().second = le;
+            sample(name + "_bucket", bucket_labels, static_cast<double>(cumulative));
+        }
+        bucket_labels.back().second = "+Inf";
+        sample(name + "_bucket", bucket_labels, static_cast<double>(h.count()));
+        sample(name + "_sum", labels, h.sumUs() / 1e6);
+        sample(name + "_count", labels, static_cast<double>(h.count()));
+    }
+
+    const std::string &str() const
+    {
+        return out_;
+    }
+
+  private:
+    void header(const std::string &name, const std::string &help, const char *type)
+    {
+        if (!declared_.insert(name).second)
+        {
+            return;
+        }
+        out_ += "# HELP " + name + " " + help + "\n";
+        out_ += "# TYPE " + name + " " + type + "\n";
+    }
+
+    void sample(const std::string &name, const LABELS &labels, double value)
+    {
+        out_ += name;
+        if (!labels.empty())
+        {
+            out_ += '{';
+            for (size_t i = 0; i < labels.size(); i++)
+            {
+                if (i > 0)
+                {
+                    out_ += ',';
+                }
+                out_ += labels[i].first + "=\"" + escape(labels[i].second) + "\"";
+            }
+            out_ += '}';
+        }
+        out_ += ' ' + formatDouble(value) + '\n';
+    }
+
+    static std::string formatDouble(double v)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.17g", v);
+        return buf;
+    }
+
+    static std::string escape(const std::string &v)
+    {
+        std::string out;
+        for (char c : v)
+        {
+            if (c == '\\' || c == '"')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c == '\n')
+            {
+                out += "\\n";
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    std::string out_;
+    std::set<std::string> declared_;
+};
+
+/*
+* @fun:连接池的指标，POOL需要提供stats()，只读原子计数，不会拿连接池的锁
+* @param[in] pool 连接池，例如MySqlConnPool
+* @param[in] pool_name 标签pool的值
+*/
+template <typename POOL>
+std::function<void(PrometheusWriter &)> poolMetrics(const std::shared_ptr<POOL> &pool, const std::string &pool_name)
+{
+    std::weak_ptr<POOL> weak_pool = pool;
+    return [weak_pool, pool_name](PrometheusWriter &w) {
+        std::shared_ptr<POOL> shr_pool = weak_pool.lock();
+        if (!shr_pool)
+        {
+            return;
+        }
+        auto s = shr_pool->stats();
+        PrometheusWriter::LABELS labels = {{"pool", pool_name}};
+        w.gauge("mysql_pool_idle_connections", "Idle connections in the pool", labels, s.idle);
+        w.gauge("mysql_pool_in_use_connections", "Connections lent out", labels, s.in_use);
+        w.counter("mysql_pool_connects_total", "Successful connects", labels, s.connects);
+        w.counter("mysql_pool_connect_failures_total", "Failed connects", labels, s.connect_failures);
+        w.counter("mysql_pool_disconnects_total", "Connections lost", labels, s.disconnects);
+        w.counter("mysql_pool_exhausted_total", "Requests refused because the pool was at its limit", labels, s.exhausted);
+    };
+}
+
+//QueryTracer里按 表+操作 的延迟直方图、错误数和超时数，需要开启QueryTracer
+inline void queryMetrics(PrometheusWriter &w)
+{
+    for (const auto &s : QueryTracer::instance().tableStats())
+    {
+        PrometheusWriter::LABELS labels = {{"table", s.table}, {"op", traceOpName(s.op)}};
+        w.histogram("mysql_query_duration_seconds", "Query latency including retries", labels, *s.histogram);
+        w.counter("mysql_query_errors_total", "Queries that returned an error", labels, s.errors->load(std::memory_order_relaxed));
+        w.counter("mysql_query_timeouts_total", "Queries that ran past their QueryDeadline", labels,
+                  s.timeouts->load(std::memory_order_relaxed));
+    }
+}
+
+//QueryWatchdog::install安装的看门狗执行KILL QUERY的次数，没有安装时不输出
+inline void watchdogMetrics(PrometheusWriter &w)
+{
+    std::shared_ptr<QueryWatchdog> watchdog = QueryWatchdog::global();
+    if (!watchdog)
+    {
+        return;
+    }
+    w.counter("mysql_watchdog_kills_total", "Statements cancelled with KILL QUERY after their deadline", {}, watchdog->kills());
+}
+
+//IoAccounting里按 表+操作+标签 的往返次数、字节数和时间，需要开启IoAccounting
+inline void ioMetrics(PrometheusWriter &w)
+{
+    for (const auto &e : IoAccounting::instance().entries())
+    {
+        const IoCounters &c = *e.counters;
+        PrometheusWriter::LABELS labels = {{"table", e.table}, {"op", traceOpName(e.op)}, {"tag", e.tag}};
+        w.counter("mysql_io_ops_total", "Table operations", labels, c.ops.load(std::memory_order_relaxed));
+        w.counter("mysql_io_round_trips_total", "Round trips to the server", labels, c.round_trips.load(std::memory_order_relaxed));
+        w.counter("mysql_io_bytes_sent_total", "Request bytes estimated from statement text", labels, c.bytes_sent.load(std::memory_order_relaxed));
+        w.counter("mysql_io_server_seconds_total", "Time spent waiting on the server", labels, c.server_us.load(std::memory_order_relaxed) / 1e6);
+        w.counter("mysql_io_client_seconds_total", "Time spent outside driver calls", labels, c.client_us.load(std::memory_order_relaxed) / 1e6);
+    }
+}
+
+/*
+* 内嵌的指标导出：一个线程监听本地端口，每次GET /metrics时调用所有collector生成Prometheus文本。用法:
+*   MetricsExporter exporter(9105);
+*   exporter.addCollector(poolMetrics(pool, "course"));
+*   exporter.addCollector(queryMetrics);
+*   exporter.addCollector(watchdogMetrics);
+*   exporter.start();
+*/
+class MetricsExporter
+{
+  public:
+    using COLLECTOR = std::function<void(PrometheusWriter &)>;
+
+    /*
+    * @param[in] port 监听端口
+    * @param[in] bind_ip 监听地址，默认只监听本机
+    */
+    MetricsExporter(uint16_t port, const std::string &bind_ip = "127.0.0.1")
+    {
+        port_ = port;
+        bind_ip_ = bind_ip;
+        exit_atm_ = false;
+    }
+
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+    virtual ~MetricsExporter()
+    {
+        stop();
+    }
+
+    void addCollector(const COLLECTOR &collector)
+    {
+        std::lock_guard<std::mutex> lck(collectors_mutex_);
+        collectors_.push_back(collector);
+    }
+
+    //return 0：成功；-1：已经启动；-2：监听失败
+    int start()
+    {
+        if (serve_thread_)
+        {
+            return -1;
+        }
+
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+        {
+            return -2;
+        }
+        int on = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        if (inet_pton(AF_INET, bind_ip_.c_str(), &addr.sin_addr) != 1 ||
+            bind(listen_fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listen_fd_, 16) != 0)
+        {
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return -2;
+        }
+
+        exit_atm_ = false;
+        serve_thread_ = std::make_shared<std::thread>(std::bind(&MetricsExporter::serveThread, this));
+        return 0;
+    }
+
+    void stop()
+    {
+        if (!serve_thread_)
+        {
+            return;
+        }
+        exit_atm_ = true;
+        serve_thread_->join();
+        serve_thread_.reset();
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    //生成当前所有指标的文本
+    std::string render()
+    {
+        std::vector<COLLECTOR> collectors;
+        {
+            std::lock_guard<std::mutex> lck(collectors_mutex_);
+            collectors = collectors_;
+        }
+        PrometheusWriter w;
+        for (const auto &c : collectors)
+        {
+            c(w);
+        }
+        return w.str();
+    }
+
+  private:
+    void serveThread()
+    {
+        while (!exit_atm_)
+        {
+            pollfd pfd;
+            pfd.fd = listen_fd_;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 200) <= 0)
+            { //超时醒来检查退出
+                continue;
+            }
+
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0)
+            {
+                continue;
+            }
+            handle(fd);
+            close(fd);
+        }
+    }
+
+    void handle(int fd)
+    {
+        timeval tv = {1, 0}; //慢的客户端不能卡住导出线程
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+        {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+            {
+                return;
+            }
+            request.append(buf, n);
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0)
+        {
+            body = render();
+        }
+        else
+        {
+            status = "404 Not Found";
+            body = "not found\n";
+        }
+
+        std::string response = "HTTP/1.0 " + status + "\r\n" +
+                               "Content-Type: text/plain; version=0.0.4\r\n" +
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+                               "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return;
+            }
+            sent += n;
+        }
+    }
+
+    uint16_t port_;
+    std::string bind_ip_;
+    int listen_fd_ = -1;
+    std::shared_ptr<std::thread> serve_thread_;
+    std::atomic<bool> exit_atm_;
+    std::mutex collectors_mutex_;
+    std::vector<COLLECTOR> collectors_;
+};
+#endif
@@ -0,0 +1,700 @@
+#ifndef NATIVE_DRIVER_H_
+#define NATIVE_DRIVER_H_
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <strings.h>
+#include <type_traits>
+#include "mysql/mysql.h"
+#include "arena.h"
+#include "db_driver.h"
+
+/*
+* 直接基于libmysqlclient(或MariaDB Connector/C)的驱动，预处理语句走二进制协议。
+* 结果列按类型绑定到固定的缓冲区：整数列读成int64/uint64，浮点列读成double，其他列(字符串、decimal、时间)读成文本，
+* 解码时不经过SQLString，也不抛异常。字符串缓冲区按列复用，比当前值短时自动加长后重新读取该列。
+* 接口说明见db_driver.h。链接: -lmysqlclient 或 -lmariadb
+* 注意：一个连接同一时间只能被一个线程使用；连接关闭或重连前要先释放它prepare的语句。
+*/
+
+//MySQL 8.0去掉了my_bool，MYSQL_BIND里对应的字段是bool，MariaDB和5.7仍然是my_bool(char)
+using NATIVE_BOOL = std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+class NativeStatement
+{
+  public:
+    explicit NativeStatement(MYSQL *mysql)
+    {
+        mysql_ = mysql;
+    }
+
+    NativeStatement(const NativeStatement &) = delete;
+    NativeStatement &operator=(const NativeStatement &) = delete;
+
+    ~NativeStatement()
+    {
+        if (meta_)
+        {
+            mysql_free_result(meta_);
+        }
+        if (stmt_)
+        {
+            mysql_stmt_close(stmt_);
+        }
+    }
+
+    /*
+    * @fun:预处理语句，并按结果集的列类型准备好结果缓冲区
+    * @return 0：成功；>0：mysql错误码；-2：连接无效
+    */
+    int prepare(const std::string &sql)
+    {
+        if (!mysql_)
+        {
+            return -2;
+        }
+        stmt_ = mysql_stmt_init(mysql_);
+        if (!stmt_)
+        {
+            error_code_ = mysql_errno(mysql_);
+            error_msg_ = mysql_error(mysql_);
+            return error_code_ > 0 ? error_code_ : -1;
+        }
+        if (mysql_stmt_prepare(stmt_, sql.data(), sql.size()) != 0)
+        {
+            return setError();
+        }
+
+        params_.resize(mysql_stmt_param_count(stmt_));
+        param_binds_.resize(params_.size());
+        memset(param_binds_.data(), 0, param_binds_.size() * sizeof(MYSQL_BIND));
+        for (size_t i = 0; i < params_.size(); i++)
+        { //没有bind的参数按NULL处理
+            param_binds_[i].buffer_type = MYSQL_TYPE_NULL;
+        }
+
+        meta_ = mysql_stmt_result_metadata(stmt_);
+        if (meta_)
+        {
+            prepareColumns();
+        }
+        return 0;
+    }
+
+    void bind(uint32_t idx, int32_t v)
+    {
+        bindInteger(idx, v, false);
+    }
+
+    void bind(uint32_t idx, uint32_t v)
+    {
+        bindInteger(idx, v, true);
+    }
+
+    void bind(uint32_t idx, int64_t v)
+    {
+        bindInteger(idx, v, false);
+    }
+
+    void bind(uint32_t idx, uint64_t v)
+    {
+        bindInteger(idx, static_cast<int64_t>(v), true);
+    }
+
+    void bind(uint32_t idx, double v)
+    {
+        MYSQL_BIND *b = paramBind(idx);
+        if (b)
+        {
+            params_[idx - 1].d = v;
+            b->buffer_type = MYSQL_TYPE_DOUBLE;
+            b->buffer = &params_[idx - 1].d;
+        }
+    }
+
+    void bind(uint32_t idx, const std::string &v)
+    {
+        MYSQL_BIND *b = paramBind(idx);
+        if (b)
+        {
+            Param &p = params_[idx - 1];
+            p.s = v; //复用已有容量
+            p.length = p.s.size();
+            b->buffer_type = MYSQL_TYPE_STRING;
+            b->buffer = &p.s[0];
+            b->buffer_length = p.length;
+            b->length = &p.length;
+        }
+    }
+
+    void bindNull(uint32_t idx)
+    {
+        MYSQL_BIND *b = paramBind(idx);
+        if (b)
+        {
+            b->buffer_type = MYSQL_TYPE_NULL;
+        }
+    }
+
+    /*
+    * @fun:执行语句，有结果集时整个读到客户端(mysql_stmt_store_result)，之后用next()逐行解码
+    * @return 0：成功；>0：mysql错误码；-1：有参数没有bind；-2：语句无效
+    */
+    int execute()
+    {
+        if (!stmt_)
+        {
+            return -2;
+        }
+        if (bad_param_)
+        {
+            bad_param_ = false;
+            error_code_ = -1;
+            error_msg_ = "parameter index out of range";
+            return -1;
+        }
+
+        has_result_ = false;
+        affected_rows_ = 0;
+        mysql_stmt_free_result(stmt_); //上一次没读完的结果
+        if (!param_binds_.empty() && mysql_stmt_bind_param(stmt_, param_binds_.data()) != 0)
+        {
+            return setError();
+        }
+        if (mysql_stmt_execute(stmt_) != 0)
+        {
+            return setError();
+        }
+
+        if (!meta_)
+        {
+            affected_rows_ = mysql_stmt_affected_rows(stmt_);
+            return 0;
+        }
+
+        if (mysql_stmt_bind_result(stmt_, result_binds_.data()) != 0 || mysql_stmt_store_result(stmt_) != 0)
+        {
+            return setError();
+        }
+        has_result_ = true;
+        return 0;
+    }
+
+    uint64_t affectedRows() const
+    {
+        return affected_rows_;
+    }
+
+    //结果集的行数，execute之后有效
+    uint64_t rowCount() const
+    {
+        return has_result_ ? mysql_stmt_num_rows(stmt_) : 0;
+    }
+
+    /*
+    * @fun:读取下一行到绑定的缓冲区
+    * @return true：有数据；false：已经读完或出错(errorCode()不为0)
+    */
+    bool next()
+    {
+        if (!has_result_)
+        {
+            return false;
+        }
+
+        int rc = mysql_stmt_fetch(stmt_);
+        if (rc == MYSQL_DATA_TRUNCATED)
+        {
+            rc = fetchTruncated();
+        }
+        if (rc != 0)
+        {
+            if (rc != MYSQL_NO_DATA)
+            {
+                setError();
+            }
+            has_result_ = false;
+            return false;
+        }
+
+        for (auto &c : cols_)
+        {
+            if (c.kind == E_COL_STRING && !c.is_null)
+            {
+                c.buf[c.length] = '\0';
+            }
+        }
+        return true;
+    }
+
+    uint32_t findColumn(const char *name) const
+    {
+        for (size_t i = 0; i < cols_.size(); i++)
+        {
+            if (strcasecmp(cols_[i].name.c_str(), name) == 0)
+            {
+                return static_cast<uint32_t>(i + 1);
+            }
+        }
+        return 0;
+    }
+
+    uint32_t columnCount() const
+    {
+        return static_cast<uint32_t>(cols_.size());
+    }
+
+    bool isNull(uint32_t idx) const
+    {
+        const Column *c = column(idx);
+        return !c || c->is_null;
+    }
+
+    int32_t getInt(uint32_t idx) const
+    {
+        return static_cast<int32_t>(getInt64(idx));
+    }
+
+    uint32_t getUInt(uint32_t idx) const
+    {
+        return static_cast<uint32_t>(getUInt64(idx));
+    }
+
+    int64_t getInt64(uint32_t idx) const
+    {
+        const Column *c = column(idx);
+        if (!c || c->is_null)
+        {
+            return 0;
+        }
+        switch (c->kind)
+        {
+        case E_COL_INTEGER:
+            return c->i;
+        case E_COL_DOUBLE:
+            return static_cast<int64_t>(c->d);
+        default:
+            return strtoll(c->buf.data(), nullptr, 10);
+        }
+    }
+
+    uint64_t getUInt64(uint32_t idx) const
+    {
+        const Column *c = column(idx);
+        if (!c || c->is_null)
+        {
+            return 0;
+        }
+        switch (c->kind)
+        {
+        case E_COL_INTEGER:
+            return static_cast<uint64_t>(c->i);
+        case E_COL_DOUBLE:
+            return static_cast<uint64_t>(c->d);
+        default:
+            return strtoull(c->buf.data(), nullptr, 10);
+        }
+    }
+
+    double getDouble(uint32_t idx) const
+    {
+        const Column *c = column(idx);
+        if (!c || c->is_null)
+        {
+            return 0;
+        }
+        switch (c->kind)
+        {
+        case E_COL_INTEGER:
+            return c->is_unsigned ? static_cast<double>(static_cast<uint64_t>(c->i)) : static_cast<double>(c->i);
+        case E_COL_DOUBLE:
+            return c->d;
+        default:
+            return strtod(c->buf.data(), nullptr);
+        }
+    }
+
+    /*
+    * @fun:读取字符串列，返回的StrRef指向列缓冲区，读取下一行后失效；数值列格式化成文本
+    */
+    StrRef getString(uint32_t idx) const
+    {
+        const Column *c = column(idx);
+        if (!c || c->is_null)
+        {
+            return StrRef();
+        }
+        if (c->kind == E_COL_STRING)
+        {
+            return StrRef(c->buf.data(), c->length);
+        }
+
+        char tmp[64];
+        int len = 0;
+        if (c->kind == E_COL_DOUBLE)
+        {
+            len = snprintf(tmp, sizeof(tmp), "%.17g", c->d);
+        }
+        else if (c->is_unsigned)
+        {
+            len = snprintf(tmp, sizeof(tmp), "%llu", static_cast<unsigned long long>(c->i));
+        }
+        else
+        {
+            len = snprintf(tmp, sizeof(tmp), "%lld", static_cast<long long>(c->i));
+        }
+        c->text.assign(tmp, len);
+        return StrRef(c->text.data(), c->text.size());
+    }
+
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    const std::string &errorMsg() const
+    {
+        return error_msg_;
+    }
+
+  private:
+    enum E_COLUMN_KIND
+    {
+        E_COL_INTEGER = 0,
+        E_COL_DOUBLE = 1,
+        E_COL_STRING = 2,
+    };
+
+    struct Column
+    {
+        std::string name;
+        E_COLUMN_KIND kind = E_COL_STRING;
+        bool is_unsigned = false;
+        int64_t i = 0;
+        double d = 0;
+        std::vector<char> buf; //文本缓冲区，最后留一个字节放'\0'
+        mutable std::string text; //数值列getString时的文本
+        unsigned long length = 0;
+        NATIVE_BOOL is_null = 0;
+        NATIVE_BOOL error = 0;
+    };
+
+    struct Param
+    {
+        union
+        {
+            int64_t i;
+            double d;
+        };
+        std::string s;
+        unsigned long length = 0;
+    };
+
+    //字符串列的初始缓冲区，更长的值用mysql_stmt_fetch_column补读
+    static constexpr unsigned long initialStringBuffer()
+    {
+        return 256;
+    }
+
+    void prepareColumns()
+    {
+        uint32_t count = mysql_num_fields(meta_);
+        MYSQL_FIELD *fields = mysql_fetch_fields(meta_);
+        cols_.resize(count);
+        result_binds_.resize(count);
+        memset(result_binds_.data(), 0, result_binds_.size() * sizeof(MYSQL_BIND));
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Column &c = cols_[i];
+            MYSQL_BIND &b = result_binds_[i];
+            c.name.assign(fields[i].name, fields[i].name_length);
+            switch (fields[i].type)
+            {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_LONGLONG:
+            case MYSQL_TYPE_YEAR:
+                c.kind = E_COL_INTEGER;
+                c.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+                b.buffer_type = MYSQL_TYPE_LONGLONG; //客户端库负责把窄的整数扩展到8字节
+                b.buffer = &c.i;
+                b.is_unsigned = c.is_unsigned;
+                break;
+            case MYSQL_TYPE_FLOAT:
+            case MYSQL_TYPE_DOUBLE:
+                c.kind = E_COL_DOUBLE;
+                b.buffer_type = MYSQL_TYPE_DOUBLE;
+                b.buffer = &c.d;
+                break;
+            default:
+                c.kind = E_COL_STRING;
+                c.buf.resize(std::min<unsigned long>(fields[i].length, initialStringBuffer()) + 1);
+                b.buffer_type = MYSQL_TYPE_STRING;
+                b.buffer = c.buf.data();
+                b.buffer_length = c.buf.size() - 1;
+                break;
+            }
+            b.length = &c.length;
+            b.is_null = &c.is_null;
+            b.error = &c.error;
+        }
+    }
+
+    //有字符串列比缓冲区长时，加长缓冲区后单独重新读取这些列
+    int fetchTruncated()
+    {
+        bool rebind = false;
+        for (size_t i = 0; i < cols_.size(); i++)
+        {
+            Column &c = cols_[i];
+            if (c.kind != E_COL_STRING || c.is_null || c.length < c.buf.size())
+            {
+                continue;
+            }
+            c.buf.resize(c.length + 1);
+            result_binds_[i].buffer = c.buf.data();
+            result_binds_[i].buffer_length = c.length;
+            if (mysql_stmt_fetch_column(stmt_, &result_binds_[i], static_cast<unsigned int>(i), 0) != 0)
+            {
+                return 1;
+            }
+            rebind = true;
+        }
+        if (rebind && mysql_stmt_bind_result(stmt_, result_binds_.data()) != 0)
+        {
+            return 1;
+        }
+        return 0;
+    }
+
+    MYSQL_BIND *paramBind(uint32_t idx)
+    {
+        if (idx == 0 || idx > param_binds_.size())
+        {
+            bad_param_ = true; //在execute时报错，bind本身不返回错误码
+            return nullptr;
+        }
+        return &param_binds_[idx - 1];
+    }
+
+    void bindInteger(uint32_t idx, int64_t v, bool is_unsigned)
+    {
+        MYSQL_BIND *b = paramBind(idx);
+        if (b)
+        {
+            params_[idx - 1].i = v;
+            b->buffer_type = MYSQL_TYPE_LONGLONG;
+            b->buffer = &params_[idx - 1].i;
+            b->is_unsigned = is_unsigned;
+        }
+    }
+
+    const Column *column(uint32_t idx) const
+    {
+        return idx > 0 && idx <= cols_.size() ? &cols_[idx - 1] : nullptr;
+    }
+
+    int setError()
+    {
+        error_code_ = mysql_stmt_errno(stmt_);
+        error_msg_ = mysql_stmt_error(stmt_);
+        return error_code_ > 0 ? error_code_ : -1;
+    }
+
+    MYSQL *mysql_ = nullptr;
+    MYSQL_STMT *stmt_ = nullptr;
+    MYSQL_RES *meta_ = nullptr;
+    std::vector<Param> params_;
+    std::vector<MYSQL_BIND> param_binds_;
+    std::vector<Column> cols_;
+    std::vector<MYSQL_BIND> result_binds_;
+    bool has_result_ = false;
+    bool bad_param_ = false;
+    uint64_t affected_rows_ = 0;
+    int error_code_ = 0;
+    std::string error_msg_;
+};
+
+class NativeDriver
+{
+  public:
+    using STATEMENT = NativeStatement;
+
+    NativeDriver() = default;
+    NativeDriver(const NativeDriver &) = delete;
+    NativeDriver &operator=(const NativeDriver &) = delete;
+
+    ~NativeDriver()
+    {
+        close();
+    }
+
+    /*
+    * @fun:建立连接
+    * @return 0：成功；>0：mysql错误码；-1：初始化失败
+    */
+    int connect(const DriverOptions &opt)
+    {
+        static std::once_flag init_flag;
+        std::call_once(init_flag, []() { mysql_library_init(0, nullptr, nullptr); }); //mysql_init本身不是线程安全的
+
+        opt_ = opt;
+        close();
+        mysql_ = mysql_init(nullptr);
+        if (!mysql_)
+        {
+            error_code_ = -1;
+            error_msg_ = "mysql_init failed";
+            return -1;
+        }
+
+        unsigned int timeout = opt.connect_timeout_s;
+        mysql_options(mysql_, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+        if (opt.read_timeout_s > 0)
+        {
+            timeout = opt.read_timeout_s;
+            mysql_options(mysql_, MYSQL_OPT_READ_TIMEOUT, &timeout);
+        }
+        if (opt.write_timeout_s > 0)
+        {
+            timeout = opt.write_timeout_s;
+            mysql_options(mysql_, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+        }
+        mysql_options(mysql_, MYSQL_SET_CHARSET_NAME, opt.charset.c_str());
+
+        if (!mysql_real_connect(mysql_, opt.host.c_str(), opt.user.c_str(), opt.password.c_str(),
+                                opt.schema.empty() ? nullptr : opt.schema.c_str(), opt.port, nullptr, 0))
+        {
+            int err = setError();
+            close();
+            return err;
+        }
+        return 0;
+    }
+
+    //不使用MYSQL_OPT_RECONNECT(8.0里已废弃)，断线后由调用者重连
+    int reconnect()
+    {
+        return connect(opt_);
+    }
+
+    bool ping()
+    {
+        return mysql_ && mysql_ping(mysql_) == 0;
+    }
+
+    int execute(const std::string &sql, uint64_t *affected_rows = nullptr)
+    {
+        if (!mysql_)
+        {
+            return -2;
+        }
+        if (mysql_real_query(mysql_, sql.data(), sql.size()) != 0)
+        {
+            return setError();
+        }
+
+        uint64_t affected = 0;
+        bool first = true;
+        int status = 0;
+        do
+        { //读完所有结果集，否则连接不能再执行其他语句
+            MYSQL_RES *res = mysql_store_result(mysql_);
+            if (res)
+            {
+                mysql_free_result(res);
+            }
+            else if (mysql_field_count(mysql_) != 0)
+            {
+                return setError();
+            }
+            else if (first)
+            {
+                affected = mysql_affected_rows(mysql_);
+            }
+            first = false;
+        } while ((status = mysql_next_result(mysql_)) == 0);
+        if (status > 0)
+        {
+            return setError();
+        }
+
+        if (affected_rows)
+        {
+            *affected_rows = affected;
+        }
+        return 0;
+    }
+
+    std::unique_ptr<NativeStatement> prepare(const std::string &sql)
+    {
+        std::unique_ptr<NativeStatement> stmt(new NativeStatement(mysql_));
+        int err = stmt->prepare(sql);
+        if (err != 0)
+        {
+            error_code_ = err;
+            error_msg_ = stmt->errorMsg();
+            return nullptr;
+        }
+        return stmt;
+    }
+
+    //转义后拼进文本协议的sql
+    std::string escape(const std::string &s) const
+    {
+        if (!mysql_)
+        {
+            return s;
+        }
+        std::string out(s.size() * 2 + 1, '\0');
+        unsigned long len = mysql_real_escape_string(mysql_, &out[0], s.data(), s.size());
+        out.resize(len);
+        return out;
+    }
+
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    const std::string &errorMsg() const
+    {
+        return error_msg_;
+    }
+
+    MYSQL *handle()
+    {
+        return mysql_;
+    }
+
+    void close()
+    {
+        if (mysql_)
+        {
+            mysql_close(mysql_);
+            mysql_ = nullptr;
+        }
+    }
+
+  private:
+    int setError()
+    {
+        error_code_ = mysql_errno(mysql_);
+        error_msg_ = mysql_error(mysql_);
+        return error_code_ > 0 ? error_code_ : -1;
+    }
+
+    DriverOptions opt_;
+    MYSQL *mysql_ = nullptr;
+    int error_code_ = 0;
+    std::string error_msg_;
+};
+#endif
@@ -0,0 +1,333 @@
+#ifndef PARALLEL_SCAN_H_
+#define PARALLEL_SCAN_H_
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include "conn_provider.h"
+#include "db_table.h"
+#include "table_scanner.h"
+
+/*
+* 并行扫描整张表：把主键范围切成K段，每段在自己的连接上用KeysetScanner分块读取，
+* 读到的块交给调用线程里的consumer处理。ordered为false时哪段先读到就先处理，
+* 为true时按段的顺序处理，即按主键有序(后面的段最多预读queue_chunks块后等待)。用法:
+*   ParallelScanner<T_TSRecord> scanner(leaseConnectionProvider, "T_TSRecord", "id", 8);
+*   scanner.where("status=1");
+*   int64_t rows = scanner.run([](std::vector<T_TSRecord> &chunk) { 处理chunk; });
+*/
+template <typename T>
+class ParallelScanner
+{
+  public:
+    using CONSUMER = std::function<void(std::vector<T> &)>;
+
+    /*
+    * @param[in] provider 连接提供者，扫描期间每段占用一个连接，连接池至少要有partitions个空闲连接
+    * @param[in] table 表名
+    * @param[in] key_field 整数主键字段
+    * @param[in] partitions 分段数，即并发数
+    * @param[in] chunk_rows 每块的行数
+    * @param[in] queue_chunks 每个队列最多缓存的块数，consumer处理不过来时扫描线程等待
+    */
+    ParallelScanner(const CONN_PROVIDER &provider, const std::string &table, const std::string &key_field,
+                    size_t partitions = 4, size_t chunk_rows = 1000, size_t queue_chunks = 4)
+        : proto_(table, key_field, chunk_rows)
+    {
+        provider_ = provider;
+        table_name_ = table;
+        key_field_ = key_field;
+        partitions_ = partitions > 0 ? partitions : 1;
+        queue_chunks_ = queue_chunks > 0 ? queue_chunks : 1;
+    }
+
+    ParallelScanner(const ParallelScanner &) = delete;
+    ParallelScanner &operator=(const ParallelScanner &) = delete;
+
+    //额外的过滤条件，直接写表达式
+    ParallelScanner &where(const std::string &expr)
+    {
+        wheres_.emplace_back(expr);
+        proto_.where(expr);
+        return *this;
+    }
+
+    //查询的字段，默认"*"，必须包含主键字段
+    template <typename... FIELDS>
+    ParallelScanner &fields(FIELDS... f)
+    {
+        proto_.fields(f...);
+        return *this;
+    }
+
+    /*
+    * @fun:指定分段的边界，主键分布不均匀时使用(例如事先采样得到)，不指定时按MIN/MAX平均切分
+    * @param[in] splits 升序的边界，n个边界切成n+1段：(-∞, s0], (s0, s1] ... (sn-1, +∞)
+    */
+    ParallelScanner &boundaries(const std::vector<int64_t> &splits)
+    {
+        splits_ = splits;
+        std::sort(splits_.begin(), splits_.end());
+        splits_.erase(std::unique(splits_.begin(), splits_.end()), splits_.end());
+        return *this;
+    }
+
+    /*
+    * @fun:执行扫描，返回前所有扫描线程都已结束
+    * @param[in] consumer 在调用线程里依次被调用，不需要加锁
+    * @param[in] ordered 是否按主键顺序交给consumer
+    * @return 扫描的总行数；-1：取不到连接或者查询边界失败；-2：某一段重试后仍然失败，已处理的行不会回退
+    */
+    int64_t run(const CONSUMER &consumer, bool ordered = false)
+    {
+        std::vector<std::pair<int64_t, int64_t>> ranges;
+        if (!splitRanges(ranges))
+        {
+            return -1;
+        }
+        if (ranges.empty())
+        { //空表
+            return 0;
+        }
+
+        //无序时所有段共用一个队列，有序时每段一个队列
+        channels_.clear();
+        channels_.resize(ordered ? ranges.size() : 1);
+        for (auto &c : channels_)
+        {
+            c.reset(new Channel());
+            c->producers = ordered ? 1 : ranges.size();
+        }
+
+        failed_atm_ = false;
+        stop_atm_ = false;
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            Channel *c = channels_[ordered ? i : 0].get();
+            workers.emplace_back(&ParallelScanner::scanRange, this, ranges[i].first, ranges[i].second, c);
+        }
+
+        int64_t total = 0;
+        for (auto &c : channels_)
+        {
+            std::vector<T> chunk;
+            while (pop(*c, chunk))
+            {
+                total += chunk.size();
+                consumer(chunk);
+            }
+            if (failed_atm_)
+            {
+                break;
+            }
+        }
+
+        stop_atm_ = true;
+        for (auto &c : channels_)
+        {
+            std::lock_guard<std::mutex> lck(c->mutex);
+            c->space_cv.notify_all();
+        }
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+        channels_.clear();
+        return failed_atm_ ? -2 : total;
+    }
+
+  private:
+    struct Channel
+    {
+        std::mutex mutex;
+        std::condition_variable data_cv;
+        std::condition_variable space_cv;
+        std::deque<std::vector<T>> chunks;
+        size_t producers = 0; //还在扫描的段数
+    };
+
+    //按边界或者MIN/MAX得到每段的 (after_key, max_key]
+    bool splitRanges(std::vector<std::pair<int64_t, int64_t>> &ranges)
+    {
+        const int64_t lowest = std::numeric_limits<int64_t>::min();
+        const int64_t highest = std::numeric_limits<int64_t>::max();
+        if (!splits_.empty())
+        {
+            int64_t after = lowest;
+            for (int64_t s : splits_)
+            {
+                ranges.emplace_back(after, s);
+                after = s;
+            }
+            ranges.emplace_back(after, highest);
+            return true;
+        }
+
+        int64_t min_key = 0;
+        int64_t max_key = 0;
+        int ret = queryKeyBounds(min_key, max_key);
+        if (ret <= 0)
+        {
+            return ret == 0;
+        }
+
+        //用无符号数计算跨度，避免溢出
+        uint64_t span = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key) + 1;
+        uint64_t parts = std::min<uint64_t>(partitions_, span > 0 ? span : partitions_);
+        uint64_t step = span / parts;
+        uint64_t rest = span % parts;
+        int64_t after = min_key > lowest ? min_key - 1 : lowest;
+        uint64_t offset = 0;
+        for (uint64_t i = 0; i < parts; i++)
+        {
+            offset += step + (i < rest ? 1 : 0);
+            int64_t last = i + 1 == parts ? max_key : static_cast<int64_t>(static_cast<uint64_t>(min_key) + offset - 1);
+            ranges.emplace_back(after, last);
+            after = last;
+        }
+        return true;
+    }
+
+    //return 1：成功；0：没有数据；-1：失败
+    int queryKeyBounds(int64_t &min_key, int64_t &max_key)
+    {
+        std::shared_ptr<sql::Connection> conn = provider_();
+        if (!conn)
+        {
+            return -1;
+        }
+
+        Table table(table_name_);
+        table.setConn(conn);
+        table.select("MIN(" + key_field_ + ")", "MAX(" + key_field_ + ")");
+        for (const auto &w : wheres_)
+        {
+            table.whereOrg(w);
+        }
+
+        std::shared_ptr<sql::ResultSet> res = table.executeQuery();
+        if (!res)
+        {
+            return -1;
+        }
+
+        try
+        {
+            if (!res->next() || res->isNull(1))
+            {
+                return 0;
+            }
+            min_key = res->getInt64(1);
+            max_key = res->getInt64(2);
+        }
+        catch (sql::SQLException &)
+        {
+            return -1;
+        }
+        return 1;
+    }
+
+    void scanRange(int64_t after_key, int64_t max_key, Channel *c)
+    {
+        KeysetScanner<T> scanner(proto_);
+        scanner.range(after_key, max_key);
+        std::shared_ptr<sql::Connection> conn;
+        int retry = 3;
+        while (!stop_atm_ && !scanner.done())
+        {
+            if (!conn)
+            {
+                conn = provider_();
+            }
+
+            std::vector<T> chunk;
+            int ret = conn ? scanner.next(conn, chunk) : -1;
+            if (ret < 0)
+            { //检查点不变，换一个连接重试
+                conn.reset();
+                if (--retry <= 0)
+                {
+                    fail();
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            retry = 3;
+            if (ret > 0 && !push(*c, std::move(chunk)))
+            {
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lck(c->mutex);
+        c->producers--;
+        c->data_cv.notify_all();
+    }
+
+    //consumer可能在等其他段的队列，全部唤醒
+    void fail()
+    {
+        failed_atm_ = true;
+        for (auto &c : channels_)
+        {
+            std::lock_guard<std::mutex> lck(c->mutex);
+            c->data_cv.notify_all();
+        }
+    }
+
+    bool push(Channel &c, std::vector<T> &&chunk)
+    {
+        std::unique_lock<std::mutex> lck(c.mutex);
+        c.space_cv.wait(lck, [this, &c]() {
+            return stop_atm_ || c.chunks.size() < queue_chunks_;
+        });
+        if (stop_atm_)
+        {
+            return false;
+        }
+        c.chunks.emplace_back(std::move(chunk));
+        c.data_cv.notify_one();
+        return true;
+    }
+
+    //队列空并且生产者都结束时返回false，有段失败时也立即返回false
+    bool pop(Channel &c, std::vector<T> &chunk)
+    {
+        std::unique_lock<std::mutex> lck(c.mutex);
+        c.data_cv.wait(lck, [this, &c]() {
+            return failed_atm_ || !c.chunks.empty() || c.producers == 0;
+        });
+        if (failed_atm_ || c.chunks.empty())
+        {
+            return false;
+        }
+        chunk = std::move(c.chunks.front());
+        c.chunks.pop_front();
+        c.space_cv.notify_one();
+        return true;
+    }
+
+    CONN_PROVIDER provider_;
+    std::string table_name_;
+    std::string key_field_;
+    size_t partitions_;
+    size_t queue_chunks_;
+    KeysetScanner<T> proto_; //每段复制一份
+    std::vector<std::string> wheres_;
+    std::vector<int64_t> splits_;
+    std::vector<std::unique_ptr<Channel>> channels_;
+    std::atomic<bool> failed_atm_{false};
+    std::atomic<bool> stop_atm_{false};
+};
+#endif
@@ -0,0 +1,63 @@
+#ifndef PREPARED_EXEC_H_
+#define PREPARED_EXEC_H_
+#include <memory>
+#include <string>
+#include <utility>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "sql_param.h"
+#include "sql_exec.h"
+#include "query_cache.h"
+#include "query_context.h"
+
+/*
+* @fun:预处理方式执行查询，参数按顺序绑定到占位符。和Table一样按默认策略重试、受QueryDeadline限制，
+*      开启跟踪和I/O统计时记录
+* @param[in] table 表名，用于跟踪和统计
+* @return nullptr：连接无效或执行出错；非nullptr：结果集
+*/
+template <typename... ARGS>
+std::shared_ptr<sql::ResultSet> preparedQuery(const std::shared_ptr<sql::Connection> &conn, const std::string &table, const std::string &sql,
+                                              ARGS &&... args)
+{
+    std::shared_ptr<sql::ResultSet> res;
+    runTrackedSql(conn, traceSqlOp(sql), table, sql, RetryPolicy(), [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+        std::shared_ptr<sql::PreparedStatement> pstmt;
+        pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(applyDeadlineHint(sql)); }));
+        bindParams(pstmt.get(), 1, args...); //重试时重新绑定，不能转移参数
+        res.reset(IoScope::roundTrip(0, [&]() { return pstmt->executeQuery(); }));
+        return res->rowsCount();
+    });
+    return res;
+}
+
+/*
+* @fun:预处理方式执行UPDATE/INSERT/DELETE，不重试；有QueryDeadline时由QueryWatchdog超时取消。
+*      成功后让目标表的查询缓存失效
+* @param[in] table 表名，用于跟踪和统计
+* @return 影响行数；-1：执行出错；-2：连接无效；-3：主键冲突；-4：超时
+*/
+template <typename... ARGS>
+int preparedUpdate(const std::shared_ptr<sql::Connection> &conn, const std::string &table, const std::string &sql, ARGS &&... args)
+{
+    int ret = 0;
+    int err = runTrackedSql(conn, traceSqlOp(sql), table, sql, RetryPolicy::none(), [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+        WatchdogGuard guard(conn);
+        std::shared_ptr<sql::PreparedStatement> pstmt;
+        pstmt.reset(IoScope::roundTrip(sql.size(), [&]() { return conn->prepareStatement(sql); }));
+        bindParams(pstmt.get(), 1, std::forward<ARGS>(args)...);
+        ret = IoScope::roundTrip(0, [&]() { return pstmt->executeUpdate(); });
+        return ret;
+    });
+    if (err == 0)
+    {
+        TableVersions::bumpSql(sql); //让查询缓存失效
+        return ret;
+    }
+    else if (err == 1062)
+    { //duplicate key
+        return -3;
+    }
+    return err < 0 ? err : -1;
+}
+#endif
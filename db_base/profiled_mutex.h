@@ -0,0 +1,327 @@
+#ifndef PROFILED_MUTEX_H_
+#define PROFILED_MUTEX_H_
+#include <map>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+/*
+* 锁的等待/持有时间统计。连接池的锁在编译时定义DB_LOCK_PROFILING才换成ProfiledMutex，
+* 不定义时就是原来的std::recursive_mutex，没有任何开销；定义后还要LockProfiler::setEnabled(true)才开始计时，
+* 关闭时每次加锁只多一次relaxed读。用法:
+*   g++ -DDB_LOCK_PROFILING ...
+*   LockProfiler::setEnabled(true);
+*   ...压测...
+*   std::cout << LockProfiler::instance().report();
+*/
+
+//纳秒的2的幂分桶，第i个桶是[2^i, 2^(i+1))，第0个桶包括0
+class LockHistogram
+{
+  public:
+    static constexpr size_t bucket_count = 40;
+
+    void record(uint64_t ns)
+    {
+        size_t b = 0;
+        while (b + 1 < bucket_count && (ns >> (b + 1)) > 0)
+        {
+            b++;
+        }
+        buckets_[b].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = max_ns_.load(std::memory_order_relaxed);
+        while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sumNs() const
+    {
+        return sum_ns_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t maxNs() const
+    {
+        return max_ns_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bucket(size_t i) const
+    {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    //百分位的上界估计
+    uint64_t percentileNs(double p) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(p * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            seen += bucket(i);
+            if (seen > target)
+            {
+                return std::min<uint64_t>((2ULL << i) - 1, maxNs());
+            }
+        }
+        return maxNs();
+    }
+
+    void reset()
+    {
+        for (auto &b : buckets_)
+        {
+            b.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_ns_.store(0, std::memory_order_relaxed);
+        max_ns_.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
+
+//同名的锁共用一份统计，例如所有连接池实例的db_list_mutex_
+struct LockStats
+{
+    std::string name;
+    std::atomic<uint64_t> acquisitions{0}; //最外层加锁的次数，递归加锁不算
+    std::atomic<uint64_t> contended{0};    //try_lock失败需要等待的次数
+    LockHistogram wait;                    //只记录需要等待的加锁
+    LockHistogram hold;
+};
+
+class LockProfiler
+{
+  public:
+    static LockProfiler &instance()
+    {
+        static LockProfiler profiler;
+        return profiler;
+    }
+
+    static bool enabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enable)
+    {
+        enabledFlag().store(enable, std::memory_order_relaxed);
+    }
+
+    //取得名字对应的统计，没有就创建
+    std::shared_ptr<LockStats> stats(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lck(stats_mutex_);
+        std::shared_ptr<LockStats> &s = stats_[name];
+        if (!s)
+        {
+            s = std::make_shared<LockStats>();
+            s->name = name;
+        }
+        return s;
+    }
+
+    std::vector<std::shared_ptr<LockStats>> allStats()
+    {
+        std::vector<std::shared_ptr<LockStats>> all;
+        std::lock_guard<std::mutex> lck(stats_mutex_);
+        for (const auto &kv : stats_)
+        {
+            all.push_back(kv.second);
+        }
+        return all;
+    }
+
+    //清零所有统计，比较两种方案时每轮压测前调用
+    void reset()
+    {
+        for (const auto &s : allStats())
+        {
+            s->acquisitions.store(0, std::memory_order_relaxed);
+            s->contended.store(0, std::memory_order_relaxed);
+            s->wait.reset();
+            s->hold.reset();
+        }
+    }
+
+    /*
+    * @fun:文本报表，每个锁一行，时间单位微秒：
+    *      加锁次数、需要等待的比例、等待的p50/p99/max及总和、持有的p50/p99/max及总和
+    */
+    std::string report()
+    {
+        std::string out;
+        char line[512];
+        snprintf(line, sizeof(line), "%-32s %12s %9s %10s %10s %12s %14s %10s %10s %12s %14s\n", "lock", "acquires", "contend%",
+                 "wait_p50", "wait_p99", "wait_max", "wait_total", "hold_p50", "hold_p99", "hold_max", "hold_total");
+        out += line;
+        for (const auto &s : allStats())
+        {
+            uint64_t acquires = s->acquisitions.load(std::memory_order_relaxed);
+            uint64_t contended = s->contended.load(std::memory_order_relaxed);
+            snprintf(line, sizeof(line), "%-32s %12llu %8.2f%% %10.2f %10.2f %12.2f %14.2f %10.2f %10.2f %12.2f %14.2f\n",
+                     s->name.c_str(), static_cast<unsigned long long>(acquires),
+                     acquires > 0 ? 100.0 * contended / acquires : 0.0,
+                     s->wait.percentileNs(0.5) / 1e3, s->wait.percentileNs(0.99) / 1e3, s->wait.maxNs() / 1e3, s->wait.sumNs() / 1e3,
+                     s->hold.percentileNs(0.5) / 1e3, s->hold.percentileNs(0.99) / 1e3, s->hold.maxNs() / 1e3, s->hold.sumNs() / 1e3);
+            out += line;
+        }
+        return out;
+    }
+
+  private:
+    static std::atomic<bool> &enabledFlag()
+    {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    std::mutex stats_mutex_;
+    std::map<std::string, std::shared_ptr<LockStats>> stats_;
+};
+
+/*
+* 带统计的互斥锁，满足Lockable，可以直接用于lock_guard/unique_lock，MUTEX可以是递归锁。
+* 计时相关的成员只在持有锁时访问，不需要额外同步
+*/
+template <typename MUTEX>
+class ProfiledMutex
+{
+  public:
+    using CLOCK = std::chrono::steady_clock;
+
+    //没有名字的锁不统计，直到setName
+    ProfiledMutex() = default;
+
+    explicit ProfiledMutex(const std::string &name)
+    {
+        stats_ = LockProfiler::instance().stats(name);
+    }
+
+    ProfiledMutex(const ProfiledMutex &) = delete;
+    ProfiledMutex &operator=(const ProfiledMutex &) = delete;
+
+    //不能在持有锁的时候调用
+    void setName(const std::string &name)
+    {
+        stats_ = LockProfiler::instance().stats(name);
+    }
+
+    void lock()
+    {
+        if (!LockProfiler::enabled() || !stats_)
+        {
+            mutex_.lock();
+            onAcquired(false, false, CLOCK::time_point());
+            return;
+        }
+
+        if (mutex_.try_lock())
+        {
+            onAcquired(true, false, CLOCK::time_point());
+            return;
+        }
+        auto begin = CLOCK::now();
+        mutex_.lock();
+        onAcquired(true, true, begin);
+    }
+
+    bool try_lock()
+    {
+        if (!mutex_.try_lock())
+        {
+            return false;
+        }
+        onAcquired(LockProfiler::enabled() && stats_, false, CLOCK::time_point());
+        return true;
+    }
+
+    void unlock()
+    {
+        if (--depth_ == 0 && timed_)
+        {
+            timed_ = false;
+            stats_->hold.record(elapsedNs(acquired_, CLOCK::now()));
+        }
+        mutex_.unlock();
+    }
+
+  private:
+    void onAcquired(bool timed, bool waited, CLOCK::time_point wait_begin)
+    {
+        if (depth_++ > 0)
+        { //递归加锁，只统计最外层
+            return;
+        }
+        timed_ = timed;
+        if (!timed)
+        {
+            return;
+        }
+
+        acquired_ = CLOCK::now();
+        stats_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (waited)
+        {
+            stats_->contended.fetch_add(1, std::memory_order_relaxed);
+            stats_->wait.record(elapsedNs(wait_begin, acquired_));
+        }
+    }
+
+    static uint64_t elapsedNs(CLOCK::time_point begin, CLOCK::time_point end)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+
+    MUTEX mutex_;
+    std::shared_ptr<LockStats> stats_;
+    uint32_t depth_ = 0;
+    bool timed_ = false;
+    CLOCK::time_point acquired_;
+};
+
+//连接池的锁类型，由DB_LOCK_PROFILING决定
+#ifdef DB_LOCK_PROFILING
+template <typename MUTEX>
+using POOL_MUTEX = ProfiledMutex<MUTEX>;
+#else
+template <typename MUTEX>
+using POOL_MUTEX = MUTEX;
+#endif
+
+//给锁起名字，普通的锁什么都不做
+template <typename MUTEX>
+inline void nameMutex(MUTEX &, const std::string &)
+{
+}
+
+template <typename MUTEX>
+inline void nameMutex(ProfiledMutex<MUTEX> &m, const std::string &name)
+{
+    m.setName(name);
+}
+#endif
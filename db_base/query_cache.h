@@ -0,0 +1,533 @@
+#ifndef QUERY_CACHE_H_
+#define QUERY_CACHE_H_
+#include <list>
+#include <mutex>
+#include <bitset>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#include <strings.h>
+#include <unordered_map>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+
+/*
+* 表的写版本号，进程内任何对某张表的写操作都会增加它的版本号，
+* 缓存的结果记录填充时的版本号，版本号变了就失效。按表名哈希到固定的槽上，冲突只会多失效一些
+*/
+class TableVersions
+{
+  public:
+    static uint64_t get(const std::string &table)
+    {
+        return slots()[slotIndex(table)].load(std::memory_order_acquire);
+    }
+
+    static void bump(const std::string &table)
+    {
+        size_t idx = slotIndex(table);
+        slots()[idx].fetch_add(1, std::memory_order_acq_rel);
+        if (Deferred::current())
+        {
+            Deferred::current()->slots_.set(idx);
+        }
+    }
+
+    //认不出写了哪张表时用，所有表的缓存都失效
+    static void bumpAll()
+    {
+        for (size_t i = 0; i < 256; i++)
+        {
+            slots()[i].fetch_add(1, std::memory_order_acq_rel);
+        }
+        if (Deferred::current())
+        {
+            Deferred::current()->slots_.set();
+        }
+    }
+
+    /*
+    * @fun:按写语句的目标表bump，给直接执行sql文本的地方用(组提交、写后缓冲、多语句批量)。
+    *      SELECT等只读语句不处理；多表UPDATE/DELETE或者认不出的语句让所有表失效
+    * @param[in] sql 一条语句，可以来自Table::get_sql()或CompiledQuery::render()
+    */
+    static void bumpSql(const std::string &sql)
+    {
+        std::string table;
+        if (!writeTarget(sql, table))
+        {
+            return;
+        }
+        if (table.empty())
+        {
+            bumpAll();
+            return;
+        }
+        bump(table);
+    }
+
+    /*
+    * @fun:写语句的目标表
+    * @param[out] table 单表INSERT/REPLACE/UPDATE/DELETE的表名；多表或者认不出的语句为空
+    * @return false：SELECT等只读语句
+    */
+    static bool writeTarget(const std::string &sql, std::string &table)
+    {
+        table.clear();
+        size_t pos = 0;
+        std::string word = nextWord(sql, pos);
+        if (word == "SELECT" || word == "SHOW" || word == "DESC" || word == "DESCRIBE" || word == "EXPLAIN" || word == "SET" ||
+            word == "BEGIN" || word == "START" || word == "COMMIT" || word == "ROLLBACK" || word.empty())
+        {
+            return false;
+        }
+        if (word != "INSERT" && word != "REPLACE" && word != "UPDATE" && word != "DELETE")
+        {
+            return true;
+        }
+
+        std::string name;
+        while (pos < sql.size())
+        {
+            size_t table_pos = sql.find_first_not_of(" \t\r\n", pos);
+            word = nextWord(sql, pos);
+            if (word != "LOW_PRIORITY" && word != "DELAYED" && word != "HIGH_PRIORITY" && word != "IGNORE" && word != "QUICK" &&
+                word != "INTO" && word != "FROM")
+            {
+                size_t end = table_pos == std::string::npos ? sql.size() : sql.find_first_of(" \t\r\n(,;", table_pos);
+                name = sql.substr(table_pos, end == std::string::npos ? std::string::npos : end - table_pos);
+                pos = end == std::string::npos ? sql.size() : end;
+                break;
+            }
+        }
+        name.erase(std::remove(name.begin(), name.end(), '`'), name.end());
+
+        size_t next = sql.find_first_not_of(" \t\r\n", pos);
+        word = nextWord(sql, pos);
+        if (name.empty() || (next != std::string::npos && sql[next] == ',') || word == "JOIN" || word == "INNER" ||
+            word == "LEFT" || word == "RIGHT" || word == "CROSS" || word == "STRAIGHT_JOIN" || word == "FROM")
+        { //多表
+            return true;
+        }
+        table = name;
+        return true;
+    }
+
+    /*
+    * 事务里的写在执行时就bump了，但提交前其他连接读到的还是旧数据，这期间填进缓存的旧结果带着新的版本号，
+    * 提交后也不会失效。Deferred存在期间本线程bump过的表，在finish()(事务提交或回滚后)时再bump一次。
+    * Transaction自动使用，嵌套时只登记到最内层
+    */
+    class Deferred
+    {
+      public:
+        Deferred()
+        {
+            prev_ = current();
+            current() = this;
+        }
+
+        ~Deferred()
+        {
+            finish();
+            current() = prev_;
+        }
+
+        Deferred(const Deferred &) = delete;
+        Deferred &operator=(const Deferred &) = delete;
+
+        void finish()
+        {
+            for (size_t i = 0; i < slots_.size(); i++)
+            {
+                if (slots_.test(i))
+                {
+                    slots()[i].fetch_add(1, std::memory_order_acq_rel);
+                }
+            }
+            slots_.reset();
+        }
+
+      private:
+        friend class TableVersions;
+
+        static Deferred *&current()
+        {
+            static thread_local Deferred *d = nullptr;
+            return d;
+        }
+
+        std::bitset<256> slots_;
+        Deferred *prev_ = nullptr;
+    };
+
+  private:
+    //从pos开始取下一个由字母、数字和下划线组成的单词，转成大写
+    static std::string nextWord(const std::string &sql, size_t &pos)
+    {
+        while (pos < sql.size() && !isalnum(static_cast<unsigned char>(sql[pos])) && sql[pos] != '_')
+        {
+            pos++;
+        }
+        std::string word;
+        while (pos < sql.size() && (isalnum(static_cast<unsigned char>(sql[pos])) || sql[pos] == '_'))
+        {
+            word += static_cast<char>(toupper(static_cast<unsigned char>(sql[pos++])));
+        }
+        return word;
+    }
+
+    static size_t slotIndex(const std::string &table)
+    {
+        return std::hash<std::string>()(table) & 255;
+    }
+
+    static std::atomic<uint64_t> *slots()
+    {
+        static std::atomic<uint64_t> slots[256] = {};
+        return slots;
+    }
+};
+
+/*
+* 物化后的结果集数据，只读，可以被多个线程共享
+*/
+class CachedResult
+{
+  public:
+    /*
+    * @fun:读取结果集剩余的所有行
+    * @param[in] res 结果集
+    */
+    explicit CachedResult(sql::ResultSet &res)
+    {
+        sql::ResultSetMetaData *meta = res.getMetaData();
+        uint32_t count = meta->getColumnCount();
+        for (uint32_t i = 1; i <= count; i++)
+        {
+            labels_.emplace_back(meta->getColumnLabel(i).asStdString());
+            bytes_ += labels_.back().size() + sizeof(std::string);
+        }
+
+        while (res.next())
+        {
+            rows_.emplace_back(count);
+            std::vector<Cell> &row = rows_.back();
+            for (uint32_t i = 1; i <= count; i++)
+            {
+                if (res.isNull(i))
+                {
+                    row[i - 1].is_null = true;
+                }
+                else
+                {
+                    row[i - 1].value = res.getString(i).asStdString();
+                }
+                bytes_ += row[i - 1].value.size() + sizeof(Cell);
+            }
+        }
+    }
+
+    size_t bytes() const
+    {
+        return bytes_;
+    }
+
+    size_t rowsCount() const
+    {
+        return rows_.size();
+    }
+
+    size_t columnCount() const
+    {
+        return labels_.size();
+    }
+
+  private:
+    friend class CachedResultSet;
+    struct Cell
+    {
+        std::string value;
+        bool is_null = false;
+    };
+
+    std::vector<std::string> labels_;
+    std::vector<std::vector<Cell>> rows_;
+    size_t bytes_ = 0;
+};
+
+/*
+* 物化结果的游标，接口和sql::ResultSet的常用部分一致，可以直接用RowMapper解码，列下标从1开始
+*/
+class CachedResultSet
+{
+  public:
+    explicit CachedResultSet(const std::shared_ptr<const CachedResult> &result)
+    {
+        result_ = result;
+    }
+
+    bool next()
+    {
+        if (row_ + 1 >= static_cast<int64_t>(result_->rows_.size()))
+        {
+            row_ = result_->rows_.size();
+            return false;
+        }
+        row_++;
+        return true;
+    }
+
+    size_t rowsCount() const
+    {
+        return result_->rows_.size();
+    }
+
+    //和MySQL一样不区分大小写，找不到返回0
+    uint32_t findColumn(const sql::SQLString &label) const
+    {
+        for (size_t i = 0; i < result_->labels_.size(); i++)
+        {
+            if (strcasecmp(result_->labels_[i].c_str(), label.c_str()) == 0)
+            {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    bool isNull(uint32_t idx) const
+    {
+        return cell(idx).is_null;
+    }
+
+    std::string getString(uint32_t idx) const
+    {
+        return cell(idx).value;
+    }
+
+    int32_t getInt(uint32_t idx) const
+    {
+        return static_cast<int32_t>(strtol(cell(idx).value.c_str(), nullptr, 10));
+    }
+
+    uint32_t getUInt(uint32_t idx) const
+    {
+        return static_cast<uint32_t>(strtoul(cell(idx).value.c_str(), nullptr, 10));
+    }
+
+    int64_t getInt64(uint32_t idx) const
+    {
+        return strtoll(cell(idx).value.c_str(), nullptr, 10);
+    }
+
+    uint64_t getUInt64(uint32_t idx) const
+    {
+        return strtoull(cell(idx).value.c_str(), nullptr, 10);
+    }
+
+    double getDouble(uint32_t idx) const
+    {
+        return strtod(cell(idx).value.c_str(), nullptr);
+    }
+
+  private:
+    const CachedResult::Cell &cell(uint32_t idx) const
+    {
+        static const CachedResult::Cell empty;
+        if (row_ < 0 || row_ >= static_cast<int64_t>(result_->rows_.size()) || idx == 0 || idx > result_->labels_.size())
+        {
+            return empty;
+        }
+        return result_->rows_[row_][idx - 1];
+    }
+
+    std::shared_ptr<const CachedResult> result_;
+    int64_t row_ = -1;
+};
+
+/*
+* 进程内的查询结果缓存，按规范化后的sql(参数已经在sql里)缓存，有过期时间和内存上限，
+* 同一张表有写操作后对应的缓存自动失效。只缓存通过Table::executeCachedQuery执行的查询
+*/
+class QueryCache
+{
+  public:
+    /*
+    * @param[in] max_bytes 内存上限，超过后按LRU淘汰
+    * @param[in] ttl_ms 过期时间
+    */
+    QueryCache(size_t max_bytes = 64 * 1024 * 1024, uint32_t ttl_ms = 1000)
+    {
+        max_bytes_ = max_bytes;
+        ttl_ms_ = ttl_ms;
+    }
+
+    QueryCache(const QueryCache &) = delete;
+    QueryCache &operator=(const QueryCache &) = delete;
+
+    //连续的空白合并成一个空格，引号里的内容不动
+    static std::string normalize(const std::string &sql)
+    {
+        std::string out;
+        out.reserve(sql.size());
+        char quote = 0;
+        bool space = false;
+        for (size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (quote)
+            {
+                out += c;
+                if (c == '\\' && i + 1 < sql.size())
+                {
+                    out += sql[++i];
+                }
+                else if (c == quote)
+                {
+                    quote = 0;
+                }
+                continue;
+            }
+
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            {
+                space = !out.empty();
+                continue;
+            }
+            if (space)
+            {
+                out += ' ';
+                space = false;
+            }
+            if (c == '\'' || c == '"' || c == '`')
+            {
+                quote = c;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    /*
+    * @fun:查找缓存
+    * @param[in] key normalize后的sql
+    * @param[in] table 查询的表
+    * @return nullptr：没有、过期或者表已经被写过；非nullptr：新的游标
+    */
+    std::shared_ptr<CachedResultSet> get(const std::string &key, const std::string &table)
+    {
+        uint64_t version = TableVersions::get(table);
+        std::lock_guard<std::mutex> lck(entries_mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end())
+        {
+            misses_++;
+            return nullptr;
+        }
+
+        Entry &e = *(it->second);
+        if (e.version != version || std::chrono::steady_clock::now() >= e.expire_time)
+        {
+            erase(it);
+            misses_++;
+            return nullptr;
+        }
+
+        lru_.splice(lru_.begin(), lru_, it->second);
+        hits_++;
+        return std::make_shared<CachedResultSet>(e.result);
+    }
+
+    /*
+    * @fun:放入缓存
+    * @param[in] version 执行查询之前读到的表版本号，执行期间有写操作时这条结果直接作废
+    */
+    void put(const std::string &key, const std::string &table, uint64_t version, const std::shared_ptr<const CachedResult> &result)
+    {
+        size_t bytes = result->bytes() + key.size() + sizeof(Entry);
+        if (bytes > max_bytes_ || version != TableVersions::get(table))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(entries_mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            erase(it);
+        }
+
+        while (used_bytes_ + bytes > max_bytes_ && !lru_.empty())
+        {
+            erase(entries_.find(lru_.back().key));
+        }
+
+        Entry e;
+        e.key = key;
+        e.version = version;
+        e.bytes = bytes;
+        e.expire_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttl_ms_);
+        e.result = result;
+        lru_.emplace_front(std::move(e));
+        entries_[key] = lru_.begin();
+        used_bytes_ += bytes;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lck(entries_mutex_);
+        entries_.clear();
+        lru_.clear();
+        used_bytes_ = 0;
+    }
+
+    size_t usedBytes()
+    {
+        std::lock_guard<std::mutex> lck(entries_mutex_);
+        return used_bytes_;
+    }
+
+    uint64_t hits() const
+    {
+        return hits_;
+    }
+
+    uint64_t misses() const
+    {
+        return misses_;
+    }
+
+  private:
+    struct Entry
+    {
+        std::string key;
+        uint64_t version = 0;
+        size_t bytes = 0;
+        std::chrono::steady_clock::time_point expire_time;
+        std::shared_ptr<const CachedResult> result;
+    };
+    using ENTRY_LIST = std::list<Entry>;
+
+    void erase(std::unordered_map<std::string, ENTRY_LIST::iterator>::iterator it)
+    {
+        used_bytes_ -= it->second->bytes;
+        lru_.erase(it->second);
+        entries_.erase(it);
+    }
+
+    size_t max_bytes_;
+    uint32_t ttl_ms_;
+    std::mutex entries_mutex_;
+    ENTRY_LIST lru_;
+    std::unordered_map<std::string, ENTRY_LIST::iterator> entries_;
+    size_t used_bytes_ = 0;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+#endif
@@ -0,0 +1,469 @@
+#ifndef QUERY_CAPTURE_H_
+#define QUERY_CAPTURE_H_
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include "query_trace.h"
+
+/*
+* 查询录制文件格式，所有整数都是varint，有符号的先做zigzag：
+*   文件头 "QCAP1\n"，随后是varint的录制开始时间(system_clock微秒)
+*   记录 = 类型(1字节) + 内容
+*     E_CAPTURE_TABLE       表id、表名
+*     E_CAPTURE_FINGERPRINT 指纹hash、指纹
+*     E_CAPTURE_QUERY       相对录制开始的微秒数、耗时微秒、连接序号、op、错误码、行数、表id、指纹hash、sql
+* 表名和指纹在第一次出现时写一次，连接按出现顺序编号为1,2,3...
+*/
+enum E_CAPTURE_RECORD
+{
+    E_CAPTURE_TABLE = 1,
+    E_CAPTURE_FINGERPRINT = 2,
+    E_CAPTURE_QUERY = 3
+};
+
+struct CapturedQuery
+{
+    uint64_t offset_us = 0; //相对录制开始
+    uint64_t latency_us = 0;
+    uint64_t conn = 0; //录制时的连接序号
+    int op = 0;
+    int error_code = 0;
+    int64_t rows = -1;
+    uint64_t fingerprint_hash = 0;
+    std::string table;
+    std::string sql; //参数已经代入
+};
+
+namespace capture_codec
+{
+inline void putVarint(std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline void putSigned(std::string &out, int64_t v)
+{
+    putVarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+}
+
+inline void putString(std::string &out, const std::string &s)
+{
+    putVarint(out, s.size());
+    out += s;
+}
+
+//return false：文件结束或者数据不完整
+inline bool getVarint(FILE *fp, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(fp);
+        if (c == EOF)
+        {
+            return false;
+        }
+        v |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool getSigned(FILE *fp, int64_t &v)
+{
+    uint64_t u = 0;
+    if (!getVarint(fp, u))
+    {
+        return false;
+    }
+    v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+    return true;
+}
+
+inline bool getString(FILE *fp, std::string &s)
+{
+    uint64_t len = 0;
+    if (!getVarint(fp, len) || len > (64U << 20))
+    {
+        return false;
+    }
+    s.resize(len);
+    return len == 0 || fread(&s[0], 1, len, fp) == len;
+}
+} // namespace capture_codec
+
+/*
+* 通过QueryTracer的钩子录制Table执行的语句，会开启QueryTracer。用法:
+*   auto capture = std::make_shared<QueryCapture>("/data/capture.qcap", 512 << 20);
+*   capture->start();
+*   ...
+*   capture->stop();
+* 钩子里只把事件放进队列，由后台线程编码写文件(带1M的缓冲)，执行语句的线程不会等磁盘；
+* 队列满(写盘跟不上)时丢弃并计数，超过max_bytes后自动停止录制
+*/
+class QueryCapture : public std::enable_shared_from_this<QueryCapture>
+{
+  public:
+    /*
+    * @param[in] path 录制文件
+    * @param[in] max_bytes 文件大小上限，0表示不限制
+    * @param[in] max_pending 等待写盘的最大语句数
+    */
+    QueryCapture(const std::string &path, uint64_t max_bytes = 0, size_t max_pending = 100000)
+    {
+        path_ = path;
+        max_bytes_ = max_bytes;
+        max_pending_ = max_pending > 0 ? max_pending : 1;
+        running_atm_ = false;
+        exit_atm_ = false;
+    }
+
+    QueryCapture(const QueryCapture &) = delete;
+    QueryCapture &operator=(const QueryCapture &) = delete;
+
+    virtual ~QueryCapture()
+    {
+        stop();
+    }
+
+    //return 0：成功；-1：已经在录制；-2：打开文件失败
+    int start()
+    {
+        std::lock_guard<std::mutex> lck(control_mutex_);
+        if (running_atm_)
+        {
+            return -1;
+        }
+        stopWriter(); //超过max_bytes自动停止后，写线程还在
+        fp_ = fopen(path_.c_str(), "wb");
+        if (!fp_)
+        {
+            return -2;
+        }
+        setvbuf(fp_, nullptr, _IOFBF, 1 << 20);
+
+        start_time_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        std::string header = "QCAP1\n";
+        capture_codec::putVarint(header, start_time_us_);
+        fwrite(header.data(), 1, header.size(), fp_);
+        bytes_ = header.size();
+        tables_.clear();
+        fingerprints_.clear();
+        conns_.clear();
+        records_ = 0;
+        dropped_ = 0;
+
+        exit_atm_ = false;
+        writer_thread_ = std::make_shared<std::thread>(std::bind(&QueryCapture::writerThread, this));
+
+        if (!hooked_)
+        { //钩子不能移除，只装一次，停止后由running_atm_屏蔽
+            std::weak_ptr<QueryCapture> weak_capture = shared_from_this();
+            QueryTracer::instance().addHook(nullptr, [weak_capture](const QueryTraceEvent &e) {
+                std::shared_ptr<QueryCapture> capture = weak_capture.lock();
+                if (capture)
+                {
+                    capture->onQuery(e);
+                }
+            });
+            hooked_ = true;
+        }
+        QueryTracer::instance().enable(true);
+        running_atm_ = true;
+        return 0;
+    }
+
+    //队列里的语句写完后关闭文件
+    void stop()
+    {
+        std::lock_guard<std::mutex> lck(control_mutex_);
+        running_atm_ = false;
+        stopWriter();
+    }
+
+    bool running() const
+    {
+        return running_atm_;
+    }
+
+    //已经录制的语句数
+    uint64_t records() const
+    {
+        return records_;
+    }
+
+    //写盘跟不上、队列满时丢弃的语句数
+    uint64_t dropped() const
+    {
+        return dropped_;
+    }
+
+  private:
+    void onQuery(const QueryTraceEvent &e)
+    {
+        if (!running_atm_ || e.sql.empty())
+        {
+            return;
+        }
+
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> lck(queue_mutex_);
+            if (queue_.size() >= max_pending_)
+            {
+                dropped_++;
+                return;
+            }
+            queue_.push_back(e);
+            notify = queue_.size() == 1;
+        }
+        if (notify)
+        {
+            queue_cv_.notify_one();
+        }
+    }
+
+    void stopWriter()
+    {
+        if (!writer_thread_)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lck(queue_mutex_);
+            exit_atm_ = true;
+        }
+        queue_cv_.notify_one();
+        writer_thread_->join();
+        writer_thread_.reset();
+        if (fp_)
+        {
+            fclose(fp_);
+            fp_ = nullptr;
+        }
+    }
+
+    //fp_、bytes_和编码用的表只在写线程里访问，start/stop在线程启动前和join后才碰它们
+    void writerThread()
+    {
+        std::deque<QueryTraceEvent> batch;
+        std::string buf;
+        while (1)
+        {
+            {
+                std::unique_lock<std::mutex> lck(queue_mutex_);
+                queue_cv_.wait(lck, [this]() {
+                    return exit_atm_ || !queue_.empty();
+                });
+                if (queue_.empty())
+                { //退出前已经写完
+                    break;
+                }
+                batch.swap(queue_);
+            }
+
+            for (const auto &e : batch)
+            {
+                if (!fp_)
+                {
+                    break;
+                }
+                buf.clear();
+                encode(e, buf);
+                fwrite(buf.data(), 1, buf.size(), fp_);
+                bytes_ += buf.size();
+                records_++;
+                if (max_bytes_ > 0 && bytes_ >= max_bytes_)
+                {
+                    running_atm_ = false;
+                    fclose(fp_);
+                    fp_ = nullptr;
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    void encode(const QueryTraceEvent &e, std::string &buf)
+    {
+        auto table_it = tables_.find(e.table);
+        if (table_it == tables_.end())
+        {
+            table_it = tables_.emplace(e.table, tables_.size() + 1).first;
+            buf += static_cast<char>(E_CAPTURE_TABLE);
+            capture_codec::putVarint(buf, table_it->second);
+            capture_codec::putString(buf, e.table);
+        }
+        if (fingerprints_.insert(e.fingerprint_hash).second)
+        {
+            buf += static_cast<char>(E_CAPTURE_FINGERPRINT);
+            capture_codec::putVarint(buf, e.fingerprint_hash);
+            capture_codec::putString(buf, e.fingerprint);
+        }
+        auto conn_it = conns_.find(e.conn_key);
+        if (conn_it == conns_.end())
+        {
+            conn_it = conns_.emplace(e.conn_key, conns_.size() + 1).first;
+        }
+
+        buf += static_cast<char>(E_CAPTURE_QUERY);
+        capture_codec::putVarint(buf, e.start_time_us > start_time_us_ ? e.start_time_us - start_time_us_ : 0);
+        capture_codec::putVarint(buf, e.latency_us);
+        capture_codec::putVarint(buf, conn_it->second);
+        capture_codec::putSigned(buf, e.op);
+        capture_codec::putSigned(buf, e.error_code);
+        capture_codec::putSigned(buf, e.rows);
+        capture_codec::putVarint(buf, table_it->second);
+        capture_codec::putVarint(buf, e.fingerprint_hash);
+        capture_codec::putString(buf, e.sql);
+    }
+
+    std::string path_;
+    uint64_t max_bytes_;
+    size_t max_pending_;
+    std::atomic<bool> running_atm_;
+    bool hooked_ = false;
+    std::mutex control_mutex_; //start/stop
+
+    std::shared_ptr<std::thread> writer_thread_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<QueryTraceEvent> queue_;
+    std::atomic<bool> exit_atm_;
+
+    FILE *fp_ = nullptr;
+    uint64_t start_time_us_ = 0;
+    uint64_t bytes_ = 0;
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::unordered_map<std::string, uint64_t> tables_;
+    std::set<uint64_t> fingerprints_;
+    std::unordered_map<uint64_t, uint64_t> conns_;
+};
+
+/*
+* 顺序读取录制文件
+*/
+class QueryCaptureReader
+{
+  public:
+    QueryCaptureReader() = default;
+
+    QueryCaptureReader(const QueryCaptureReader &) = delete;
+    QueryCaptureReader &operator=(const QueryCaptureReader &) = delete;
+
+    virtual ~QueryCaptureReader()
+    {
+        if (fp_)
+        {
+            fclose(fp_);
+        }
+    }
+
+    //return 0：成功；-1：打开失败；-2：不是录制文件
+    int open(const std::string &path)
+    {
+        fp_ = fopen(path.c_str(), "rb");
+        if (!fp_)
+        {
+            return -1;
+        }
+        char magic[6];
+        if (fread(magic, 1, sizeof(magic), fp_) != sizeof(magic) || memcmp(magic, "QCAP1\n", sizeof(magic)) != 0 ||
+            !capture_codec::getVarint(fp_, start_time_us_))
+        {
+            return -2;
+        }
+        return 0;
+    }
+
+    //录制开始时间，system_clock微秒
+    uint64_t startTimeUs() const
+    {
+        return start_time_us_;
+    }
+
+    /*
+    * @fun:读下一条语句
+    * @return 1：读到；0：文件结束；-1：文件损坏
+    */
+    int next(CapturedQuery &q)
+    {
+        while (true)
+        {
+            int type = fgetc(fp_);
+            if (type == EOF)
+            {
+                return 0;
+            }
+
+            uint64_t id = 0;
+            std::string text;
+            if (type == E_CAPTURE_TABLE || type == E_CAPTURE_FINGERPRINT)
+            {
+                if (!capture_codec::getVarint(fp_, id) || !capture_codec::getString(fp_, text))
+                {
+                    return -1;
+                }
+                (type == E_CAPTURE_TABLE ? tables_ : fingerprints_)[id] = text;
+                continue;
+            }
+            if (type != E_CAPTURE_QUERY)
+            {
+                return -1;
+            }
+
+            int64_t op = 0, error_code = 0;
+            uint64_t table_id = 0;
+            if (!capture_codec::getVarint(fp_, q.offset_us) || !capture_codec::getVarint(fp_, q.latency_us) ||
+                !capture_codec::getVarint(fp_, q.conn) || !capture_codec::getSigned(fp_, op) ||
+                !capture_codec::getSigned(fp_, error_code) || !capture_codec::getSigned(fp_, q.rows) ||
+                !capture_codec::getVarint(fp_, table_id) || !capture_codec::getVarint(fp_, q.fingerprint_hash) ||
+                !capture_codec::getString(fp_, q.sql))
+            {
+                return -1;
+            }
+            q.op = static_cast<int>(op);
+            q.error_code = static_cast<int>(error_code);
+            q.table = tables_[table_id];
+            return 1;
+        }
+    }
+
+    //已经读到的指纹
+    std::string fingerprint(uint64_t hash) const
+    {
+        auto it = fingerprints_.find(hash);
+        return it == fingerprints_.end() ? "" : it->second;
+    }
+
+  private:
+    FILE *fp_ = nullptr;
+    uint64_t start_time_us_ = 0;
+    std::map<uint64_t, std::string> tables_;
+    std::map<uint64_t, std::string> fingerprints_;
+};
+#endif
@@ -0,0 +1,472 @@
+#ifndef QUERY_CONTEXT_H_
+#define QUERY_CONTEXT_H_
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <strings.h>
+#include <condition_variable>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "conn_provider.h"
+#include "io_accounting.h"
+
+/*
+* 当前线程的查询截止时间，作用域内执行的所有查询都受它限制，嵌套时取更早的那个。
+* 跨线程传递时在新线程里用QueryDeadline(deadline)重新建立。用法:
+*   QueryDeadline deadline(200); //本次请求的查询最多200ms
+*   auto res = table.select("*").where("id", "=", id).executeQuery();
+*/
+class QueryDeadline
+{
+  public:
+    using CLOCK = std::chrono::steady_clock;
+
+    explicit QueryDeadline(uint32_t timeout_ms)
+        : QueryDeadline(CLOCK::now() + std::chrono::milliseconds(timeout_ms))
+    {
+    }
+
+    explicit QueryDeadline(CLOCK::time_point deadline)
+    {
+        Slot &s = slot();
+        prev_ = s;
+        if (!s.active || deadline < s.deadline)
+        {
+            s.deadline = deadline;
+        }
+        s.active = true;
+    }
+
+    ~QueryDeadline()
+    {
+        slot() = prev_;
+    }
+
+    QueryDeadline(const QueryDeadline &) = delete;
+    QueryDeadline &operator=(const QueryDeadline &) = delete;
+
+    static bool active()
+    {
+        return slot().active;
+    }
+
+    //没有截止时间时返回false
+    static bool current(CLOCK::time_point &deadline)
+    {
+        const Slot &s = slot();
+        deadline = s.deadline;
+        return s.active;
+    }
+
+    //剩余的毫秒数，没有截止时间返回-1，已经超时返回0
+    static int64_t remainingMs()
+    {
+        const Slot &s = slot();
+        if (!s.active)
+        {
+            return -1;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(s.deadline - CLOCK::now()).count();
+        return left > 0 ? left : 0;
+    }
+
+    static bool expired()
+    {
+        return remainingMs() == 0;
+    }
+
+  private:
+    struct Slot
+    {
+        bool active = false;
+        CLOCK::time_point deadline;
+    };
+
+    static Slot &slot()
+    {
+        static thread_local Slot s;
+        return s;
+    }
+
+    Slot prev_;
+};
+
+/*
+* @fun:有截止时间时给SELECT加上MAX_EXECUTION_TIME提示，超时由服务端中止查询(错误3024)，连接仍然可用
+* @return 加了提示的sql；不是SELECT或者没有截止时间时原样返回
+*/
+inline std::string applyDeadlineHint(const std::string &sql)
+{
+    int64_t left = QueryDeadline::remainingMs();
+    size_t pos = sql.find_first_not_of(" \t\r\n");
+    if (left < 0 || pos == std::string::npos || sql.size() - pos < 6 || strncasecmp(sql.c_str() + pos, "SELECT", 6) != 0)
+    {
+        return sql;
+    }
+    return sql.substr(0, pos + 6) + " /*+ MAX_EXECUTION_TIME(" + std::to_string(left > 0 ? left : 1) + ") */" + sql.substr(pos + 6);
+}
+
+/*
+* 连接id(SELECT CONNECTION_ID())的缓存，按sql::Connection的地址保存，WatchdogGuard不用每条语句都查一次。
+* 重连后id会变：显式reconnect()的地方调用forget()；OPT_RECONNECT自动重连后KILL旧id会报1094，
+* QueryWatchdog据此调用forgetId()。新建的连接可能复用已释放连接的地址，建立连接后也要forget()
+*/
+class ConnectionIds
+{
+  public:
+    //返回0表示查不到
+    static uint64_t get(const std::shared_ptr<sql::Connection> &conn)
+    {
+        {
+            std::lock_guard<std::mutex> lck(mutex());
+            auto it = ids().find(conn.get());
+            if (it != ids().end())
+            {
+                return it->second;
+            }
+        }
+
+        uint64_t id = 0;
+        try
+        {
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            std::shared_ptr<sql::ResultSet> res;
+            res.reset(IoScope::roundTrip(22, [&]() { return stmt->executeQuery("SELECT CONNECTION_ID()"); }));
+            if (res && res->next())
+            {
+                id = res->getUInt64(1);
+            }
+        }
+        catch (sql::SQLException &)
+        {
+        }
+
+        if (id > 0)
+        {
+            std::lock_guard<std::mutex> lck(mutex());
+            if (ids().size() >= 4096)
+            { //连接数一般不多，超过说明有大量短连接，全部丢掉重新查
+                ids().clear();
+            }
+            ids()[conn.get()] = id;
+        }
+        return id;
+    }
+
+    static void forget(const sql::Connection *conn)
+    {
+        std::lock_guard<std::mutex> lck(mutex());
+        ids().erase(conn);
+    }
+
+    static void forgetId(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lck(mutex());
+        for (auto it = ids().begin(); it != ids().end();)
+        {
+            if (it->second == id)
+            {
+                it = ids().erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+
+    //服务端可能重启过，所有id都不可信
+    static void clear()
+    {
+        std::lock_guard<std::mutex> lck(mutex());
+        ids().clear();
+    }
+
+  private:
+    static std::mutex &mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::unordered_map<const sql::Connection *, uint64_t> &ids()
+    {
+        static std::unordered_map<const sql::Connection *, uint64_t> m;
+        return m;
+    }
+};
+
+/*
+* 超时取消：语句执行前登记连接id和截止时间，到期还没执行完时在旁路连接上执行KILL QUERY，
+* 只中止语句，连接本身仍然可用。旁路连接在start时取好并一直持有，连接池耗尽时也能取消。
+* 进程内安装一个即可，Table在有截止时间时自动使用：
+*   auto watchdog = std::make_shared<QueryWatchdog>(provider);
+*   watchdog->start();
+*   QueryWatchdog::install(watchdog);
+*/
+class QueryWatchdog
+{
+  public:
+    explicit QueryWatchdog(const CONN_PROVIDER &provider)
+    {
+        provider_ = provider;
+        exit_atm_ = false;
+    }
+
+    QueryWatchdog(const QueryWatchdog &) = delete;
+    QueryWatchdog &operator=(const QueryWatchdog &) = delete;
+
+    virtual ~QueryWatchdog()
+    {
+        stop();
+    }
+
+    //return 0：成功；-1：已经启动；-2：取不到旁路连接
+    int start()
+    {
+        if (watch_thread_)
+        {
+            return -1;
+        }
+        side_conn_ = provider_();
+        if (!side_conn_)
+        {
+            return -2;
+        }
+        exit_atm_ = false;
+        watch_thread_ = std::make_shared<std::thread>(std::bind(&QueryWatchdog::watchThread, this));
+        return 0;
+    }
+
+    void stop()
+    {
+        if (!watch_thread_)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(timers_mutex_);
+            exit_atm_ = true;
+        }
+        timers_cv_.notify_one();
+        watch_thread_->join();
+        watch_thread_.reset();
+        side_conn_.reset();
+    }
+
+    static void install(const std::shared_ptr<QueryWatchdog> &watchdog)
+    {
+        std::lock_guard<std::mutex> lck(globalMutex());
+        globalWatchdog() = watchdog;
+    }
+
+    static std::shared_ptr<QueryWatchdog> global()
+    {
+        std::lock_guard<std::mutex> lck(globalMutex());
+        return globalWatchdog();
+    }
+
+    /*
+    * @fun:登记一条正在执行的语句
+    * @param[in] conn_id 执行语句的连接id，见ConnectionIds
+    * @return 票据，语句结束后用它disarm
+    */
+    uint64_t arm(uint64_t conn_id, QueryDeadline::CLOCK::time_point deadline)
+    {
+        uint64_t ticket = 0;
+        bool earliest = false;
+        {
+            std::lock_guard<std::mutex> lck(timers_mutex_);
+            ticket = ++next_ticket_;
+            auto it = timers_.emplace(deadline, Timer{ticket, conn_id});
+            tickets_[ticket] = it;
+            earliest = it == timers_.begin();
+        }
+        if (earliest)
+        {
+            timers_cv_.notify_one();
+        }
+        return ticket;
+    }
+
+    //语句已经结束；正在KILL时会等KILL执行完，保证不会误杀这条连接上的下一条语句
+    void disarm(uint64_t ticket)
+    {
+        std::unique_lock<std::mutex> lck(timers_mutex_);
+        auto it = tickets_.find(ticket);
+        if (it != tickets_.end())
+        {
+            timers_.erase(it->second);
+            tickets_.erase(it);
+            return;
+        }
+        killed_cv_.wait(lck, [this, ticket]() {
+            return killing_.count(ticket) == 0;
+        });
+    }
+
+    uint64_t kills() const
+    {
+        return kills_;
+    }
+
+  private:
+    struct Timer
+    {
+        uint64_t ticket;
+        uint64_t conn_id;
+    };
+    using TIMERS = std::multimap<QueryDeadline::CLOCK::time_point, Timer>;
+
+    static std::mutex &globalMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::shared_ptr<QueryWatchdog> &globalWatchdog()
+    {
+        static std::shared_ptr<QueryWatchdog> watchdog;
+        return watchdog;
+    }
+
+    void watchThread()
+    {
+        std::unique_lock<std::mutex> lck(timers_mutex_);
+        while (!exit_atm_)
+        {
+            if (timers_.empty())
+            {
+                timers_cv_.wait(lck);
+                continue;
+            }
+
+            auto now = QueryDeadline::CLOCK::now();
+            auto deadline = timers_.begin()->first;
+            if (now < deadline)
+            {
+                timers_cv_.wait_until(lck, deadline);
+                continue;
+            }
+
+            //取出所有到期的，标记为正在KILL后解锁执行，KILL要一次网络往返，不能挡住arm/disarm
+            std::vector<Timer> expired;
+            while (!timers_.empty() && timers_.begin()->first <= now)
+            {
+                Timer t = timers_.begin()->second;
+                tickets_.erase(t.ticket);
+                timers_.erase(timers_.begin());
+                killing_.insert(t.ticket);
+                expired.push_back(t);
+            }
+
+            lck.unlock();
+            for (const auto &t : expired)
+            {
+                killQuery(t.conn_id);
+            }
+            lck.lock();
+
+            for (const auto &t : expired)
+            {
+                killing_.erase(t.ticket);
+            }
+            killed_cv_.notify_all();
+        }
+    }
+
+    void killQuery(uint64_t conn_id)
+    {
+        for (int retry = 0; retry < 2; retry++)
+        {
+            try
+            {
+                std::shared_ptr<sql::Statement> stmt;
+                stmt.reset(side_conn_->createStatement());
+                stmt->execute("KILL QUERY " + std::to_string(conn_id));
+                kills_++;
+                return;
+            }
+            catch (sql::SQLException &e)
+            {
+                if (e.getErrorCode() == 1094)
+                { //Unknown thread id，连接已经不在了，可能是自动重连过，缓存的id作废
+                    ConnectionIds::forgetId(conn_id);
+                    return;
+                }
+                if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
+                {
+                    ConnectionIds::clear();
+                    side_conn_->reconnect();
+                }
+            }
+        }
+    }
+
+    CONN_PROVIDER provider_;
+    std::shared_ptr<sql::Connection> side_conn_;
+    std::shared_ptr<std::thread> watch_thread_;
+    std::mutex timers_mutex_;
+    std::condition_variable timers_cv_;
+    TIMERS timers_;
+    std::map<uint64_t, TIMERS::iterator> tickets_;
+    std::set<uint64_t> killing_; //已到期正在KILL的票据，disarm要等它们结束
+    std::condition_variable killed_cv_;
+    uint64_t next_ticket_ = 0;
+    std::atomic<uint64_t> kills_{0};
+    std::atomic<bool> exit_atm_;
+};
+
+/*
+* 在作用域内为一条语句登记超时取消，没有截止时间或者没有安装QueryWatchdog时什么都不做。
+* 每个连接第一次使用时多一次SELECT CONNECTION_ID()(见ConnectionIds)，只给不能用MAX_EXECUTION_TIME的语句使用
+*/
+class WatchdogGuard
+{
+  public:
+    explicit WatchdogGuard(const std::shared_ptr<sql::Connection> &conn)
+    {
+        QueryDeadline::CLOCK::time_point deadline;
+        if (!conn || !QueryDeadline::current(deadline))
+        {
+            return;
+        }
+        watchdog_ = QueryWatchdog::global();
+        if (!watchdog_)
+        {
+            return;
+        }
+
+        uint64_t conn_id = ConnectionIds::get(conn);
+        if (conn_id > 0)
+        {
+            ticket_ = watchdog_->arm(conn_id, deadline);
+        }
+    }
+
+    ~WatchdogGuard()
+    {
+        if (ticket_ > 0)
+        {
+            watchdog_->disarm(ticket_);
+        }
+    }
+
+    WatchdogGuard(const WatchdogGuard &) = delete;
+    WatchdogGuard &operator=(const WatchdogGuard &) = delete;
+
+  private:
+    std::shared_ptr<QueryWatchdog> watchdog_;
+    uint64_t ticket_ = 0;
+};
+#endif
@@ -0,0 +1,612 @@
+#ifndef QUERY_TRACE_H_
+#define QUERY_TRACE_H_
+#include <list>
+#include <mutex>
+#include <array>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <strings.h>
+#include <functional>
+#include <unordered_map>
+
+/*
+* @fun:sql指纹，去掉字面值，同一种查询得到同一个指纹：
+*      数字和引号里的字符串换成?，连续空白合并，IN (?,?,?)合并成IN (?)，多行VALUES (?),(?)合并成一行
+*/
+inline std::string sqlFingerprint(const std::string &sql)
+{
+    std::string out;
+    out.reserve(sql.size());
+    auto isIdent = [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$';
+    };
+    auto endsWith = [&out](const char *s) {
+        size_t n = strlen(s);
+        return out.size() >= n && out.compare(out.size() - n, n, s) == 0;
+    };
+    auto putParam = [&]() {
+        if (endsWith("?,"))
+        {
+            out.pop_back();
+        }
+        else
+        {
+            out += '?';
+        }
+    };
+
+    bool space = false;
+    for (size_t i = 0; i < sql.size(); i++)
+    {
+        char c = sql[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            space = !out.empty();
+            continue;
+        }
+        if (space)
+        {
+            if (c != ',' && c != ')' && !endsWith("(") && !endsWith(","))
+            {
+                out += ' ';
+            }
+            space = false;
+        }
+
+        if (c == '\'' || c == '"')
+        {
+            for (i++; i < sql.size(); i++)
+            {
+                if (sql[i] == '\\')
+                {
+                    i++;
+                }
+                else if (sql[i] == c)
+                {
+                    if (i + 1 < sql.size() && sql[i + 1] == c)
+                    { //''转义
+                        i++;
+                        continue;
+                    }
+                    break;
+                }
+            }
+            putParam();
+        }
+        else if (c >= '0' && c <= '9' && (out.empty() || !isIdent(out.back())))
+        {
+            while (i + 1 < sql.size() && (isIdent(sql[i + 1]) || sql[i + 1] == '.'))
+            {
+                i++;
+            }
+            putParam();
+        }
+        else if (c == ')' && endsWith("(?),(?"))
+        { //多行VALUES
+            out.resize(out.size() - 3); //去掉",(?"，保留前一行的")"
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+//FNV-1a
+inline uint64_t fingerprintHash(const std::string &fingerprint)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : fingerprint)
+    {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+//E_MYSQL_OP的名字，用于日志和指标
+inline const char *traceOpName(int op)
+{
+    static const char *names[] = {"none", "select", "update", "insert", "delete", "upsert"};
+    return op >= 0 && op < static_cast<int>(sizeof(names) / sizeof(names[0])) ? names[op] : "unknown";
+}
+
+//按语句的第一个关键字得到E_MYSQL_OP的值，给直接执行sql文本的地方用(预处理执行、组提交、多语句批量)，认不出时返回0
+inline int traceSqlOp(const std::string &sql)
+{
+    static const char *words[] = {"SELECT", "UPDATE", "INSERT", "DELETE", "REPLACE"};
+    static const int ops[] = {1, 2, 3, 4, 3};
+    size_t pos = sql.find_first_not_of(" \t\r\n(");
+    for (size_t i = 0; pos != std::string::npos && i < sizeof(words) / sizeof(words[0]); i++)
+    {
+        size_t len = strlen(words[i]);
+        if (sql.size() - pos >= len && strncasecmp(sql.c_str() + pos, words[i], len) == 0)
+        {
+            return ops[i];
+        }
+    }
+    return 0;
+}
+
+/*
+* 一次执行的记录，op是E_MYSQL_OP的值
+*/
+struct QueryTraceEvent
+{
+    int op = 0;
+    std::string table;
+    std::string sql;
+    std::string fingerprint;
+    uint64_t fingerprint_hash = 0;
+    int64_t rows = -1;      //返回或影响的行数，-1表示未知
+    uint64_t latency_us = 0; //包括重试
+    int error_code = 0;      //0成功，>0 mysql错误码，<0 和runSql的返回值一致
+    uint64_t start_time_us = 0; //system_clock
+    uint64_t conn_key = 0;      //执行的连接(sql::Connection的地址)，同一时刻不同连接的值不同，0表示未知
+};
+
+/*
+* 每个指纹的延迟直方图，第i个桶是 [2^i, 2^(i+1)) 微秒
+*/
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t bucket_count = 32;
+
+    void record(uint64_t latency_us)
+    {
+        size_t b = 0;
+        while (b + 1 < bucket_count && (latency_us >> (b + 1)) > 0)
+        {
+            b++;
+        }
+        buckets_[b].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(latency_us, std::memory_order_relaxed);
+        uint64_t max = max_us_.load(std::memory_order_relaxed);
+        while (latency_us > max && !max_us_.compare_exchange_weak(max, latency_us, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t sumUs() const
+    {
+        return sum_us_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t maxUs() const
+    {
+        return max_us_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t bucket(size_t i) const
+    {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    //百分位的上界估计，例如percentileUs(0.99)
+    uint64_t percentileUs(double p) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(p * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            seen += bucket(i);
+            if (seen > target)
+            {
+                return (2ULL << i) - 1;
+            }
+        }
+        return maxUs();
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+};
+
+//微秒格式化成毫秒，例如1234 -> "1.234ms"
+inline std::string formatUs(uint64_t us)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3fms", us / 1e3);
+    return buf;
+}
+
+//一行的延迟摘要：p50/p90/p99/max/avg，给工具输出用
+inline std::string latencySummary(const LatencyHistogram &h)
+{
+    return "p50=" + formatUs(h.percentileUs(0.5)) + " p90=" + formatUs(h.percentileUs(0.9)) +
+           " p99=" + formatUs(h.percentileUs(0.99)) + " max=" + formatUs(h.maxUs()) +
+           " avg=" + formatUs(h.count() > 0 ? h.sumUs() / h.count() : 0);
+}
+
+/*
+* 定长的无锁环形缓冲，保存最近的执行记录，写满后覆盖最旧的。
+* 每个槽用序号做seqlock，写的时候序号为奇数，读的时候序号前后不一致就丢弃这个槽
+*/
+class TraceRing
+{
+  public:
+    struct Record
+    {
+        int op;
+        int error_code;
+        int64_t rows;
+        uint64_t latency_us;
+        uint64_t start_time_us;
+        uint64_t fingerprint_hash;
+        char table[64];
+        char fingerprint[256]; //超长截断
+    };
+
+    explicit TraceRing(size_t capacity = 4096)
+    {
+        size_t n = 1;
+        while (n < capacity)
+        {
+            n <<= 1;
+        }
+        slots_.reset(new Slot[n]);
+        mask_ = n - 1;
+    }
+
+    void push(const QueryTraceEvent &e)
+    {
+        uint64_t pos = write_pos_.fetch_add(1, std::memory_order_relaxed);
+        Slot &s = slots_[pos & mask_];
+        s.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.record.op = e.op;
+        s.record.error_code = e.error_code;
+        s.record.rows = e.rows;
+        s.record.latency_us = e.latency_us;
+        s.record.start_time_us = e.start_time_us;
+        s.record.fingerprint_hash = e.fingerprint_hash;
+        copyText(s.record.table, sizeof(s.record.table), e.table);
+        copyText(s.record.fingerprint, sizeof(s.record.fingerprint), e.fingerprint);
+        s.seq.store(2 * pos + 2, std::memory_order_release);
+    }
+
+    //按时间顺序取出当前缓冲里完整的记录
+    std::vector<Record> snapshot() const
+    {
+        std::vector<Record> records;
+        uint64_t end = write_pos_.load(std::memory_order_acquire);
+        uint64_t begin = end > mask_ + 1 ? end - mask_ - 1 : 0;
+        records.reserve(end - begin);
+        for (uint64_t pos = begin; pos < end; pos++)
+        {
+            const Slot &s = slots_[pos & mask_];
+            uint64_t seq = s.seq.load(std::memory_order_acquire);
+            if (seq != 2 * pos + 2)
+            { //正在写或者已经被覆盖
+                continue;
+            }
+            Record r;
+            memcpy(&r, &s.record, sizeof(r));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) == seq)
+            {
+                records.push_back(r);
+            }
+        }
+        return records;
+    }
+
+  private:
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{0};
+        Record record;
+    };
+
+    static void copyText(char *dst, size_t size, const std::string &src)
+    {
+        size_t n = src.size() < size - 1 ? src.size() : size - 1;
+        memcpy(dst, src.data(), n);
+        dst[n] = 0;
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    uint64_t mask_;
+    std::atomic<uint64_t> write_pos_{0};
+};
+
+/*
+* 查询跟踪，进程内一个。没有开启时执行路径上只多一次原子读。用法:
+*   QueryTracer::instance().setSlowThresholdMs(100);
+*   QueryTracer::instance().enable(true);
+*   QueryTracer::instance().addHook(nullptr, [](const QueryTraceEvent &e) { 上报e; });
+*   auto slow = QueryTracer::instance().slowQueries();
+*/
+class QueryTracer
+{
+  public:
+    using HOOK = std::function<void(const QueryTraceEvent &)>;
+
+    struct FingerprintStats
+    {
+        std::string fingerprint;
+        std::shared_ptr<LatencyHistogram> histogram;
+    };
+
+    //按 表+操作 统计
+    struct TableStats
+    {
+        std::string table;
+        int op = 0;
+        std::shared_ptr<LatencyHistogram> histogram;
+        std::shared_ptr<std::atomic<uint64_t>> errors;
+        std::shared_ptr<std::atomic<uint64_t>> timeouts; //超过QueryDeadline(-4)，也算在errors里
+    };
+
+    static QueryTracer &instance()
+    {
+        static QueryTracer tracer;
+        return tracer;
+    }
+
+    void enable(bool on)
+    {
+        enabled_.store(on, std::memory_order_release);
+    }
+
+    bool enabled() const
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /*
+    * @fun:添加钩子，可以在运行中添加
+    * @param[in] begin 执行前调用，此时只有op、table、sql、指纹和开始时间
+    * @param[in] end 执行后调用
+    */
+    void addHook(const HOOK &begin, const HOOK &end)
+    {
+        std::lock_guard<std::mutex> lck(hooks_mutex_);
+        auto old_hooks = std::atomic_load(&hooks_);
+        auto hooks = std::make_shared<std::vector<std::pair<HOOK, HOOK>>>(old_hooks ? *old_hooks : std::vector<std::pair<HOOK, HOOK>>());
+        hooks->emplace_back(begin, end);
+        std::atomic_store(&hooks_, std::shared_ptr<const std::vector<std::pair<HOOK, HOOK>>>(hooks));
+    }
+
+    void setSlowThresholdMs(uint32_t ms)
+    {
+        slow_threshold_us_ = static_cast<uint64_t>(ms) * 1000;
+    }
+
+    //慢查询日志最多保留的条数
+    void setSlowLogCapacity(size_t n)
+    {
+        std::lock_guard<std::mutex> lck(slow_mutex_);
+        slow_capacity_ = n;
+        while (slow_log_.size() > slow_capacity_)
+        {
+            slow_log_.pop_front();
+        }
+    }
+
+    void begin(QueryTraceEvent &e)
+    {
+        e.fingerprint = sqlFingerprint(e.sql);
+        e.fingerprint_hash = fingerprintHash(e.fingerprint);
+        e.start_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+        auto hooks = currentHooks();
+        if (hooks)
+        {
+            for (const auto &h : *hooks)
+            {
+                if (h.first)
+                {
+                    h.first(e);
+                }
+            }
+        }
+    }
+
+    void end(const QueryTraceEvent &e)
+    {
+        ring_.push(e);
+        histogram(e.fingerprint_hash, e.fingerprint)->record(e.latency_us);
+        const TableStats &ts = tableStats(e.table, e.op);
+        ts.histogram->record(e.latency_us);
+        if (e.error_code != 0)
+        {
+            ts.errors->fetch_add(1, std::memory_order_relaxed);
+        }
+        if (e.error_code == -4)
+        {
+            ts.timeouts->fetch_add(1, std::memory_order_relaxed);
+        }
+        if (slow_threshold_us_ > 0 && e.latency_us >= slow_threshold_us_)
+        {
+            std::lock_guard<std::mutex> lck(slow_mutex_);
+            slow_log_.push_back(e);
+            if (slow_log_.size() > slow_capacity_)
+            {
+                slow_log_.pop_front();
+            }
+        }
+
+        auto hooks = currentHooks();
+        if (hooks)
+        {
+            for (const auto &h : *hooks)
+            {
+                if (h.second)
+                {
+                    h.second(e);
+                }
+            }
+        }
+    }
+
+    //最近的执行记录
+    std::vector<TraceRing::Record> recent() const
+    {
+        return ring_.snapshot();
+    }
+
+    std::vector<QueryTraceEvent> slowQueries()
+    {
+        std::lock_guard<std::mutex> lck(slow_mutex_);
+        return std::vector<QueryTraceEvent>(slow_log_.begin(), slow_log_.end());
+    }
+
+    //所有指纹的直方图
+    std::vector<FingerprintStats> fingerprintStats()
+    {
+        std::vector<FingerprintStats> stats;
+        for (auto &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lck(shard.mutex);
+            for (const auto &kv : shard.stats)
+            {
+                stats.push_back(kv.second);
+            }
+        }
+        return stats;
+    }
+
+    //所有 表+操作 的直方图、错误数和超时数
+    std::vector<TableStats> tableStats()
+    {
+        std::vector<TableStats> stats;
+        for (auto &shard : table_shards_)
+        {
+            std::lock_guard<std::mutex> lck(shard.mutex);
+            for (const auto &kv : shard.stats)
+            {
+                stats.push_back(kv.second);
+            }
+        }
+        return stats;
+    }
+
+  private:
+    QueryTracer()
+    {
+    }
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, FingerprintStats> stats;
+    };
+
+    struct TableShard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, TableStats> stats;
+    };
+
+    //返回的引用在进程内一直有效，unordered_map的元素地址不会因为插入改变
+    const TableStats &tableStats(const std::string &table, int op)
+    {
+        std::string key = table + '\1' + std::to_string(op);
+        TableShard &shard = table_shards_[std::hash<std::string>()(key) % table_shards_.size()];
+        std::lock_guard<std::mutex> lck(shard.mutex);
+        TableStats &s = shard.stats[key];
+        if (!s.histogram)
+        {
+            s.table = table;
+            s.op = op;
+            s.histogram = std::make_shared<LatencyHistogram>();
+            s.errors = std::make_shared<std::atomic<uint64_t>>(0);
+            s.timeouts = std::make_shared<std::atomic<uint64_t>>(0);
+        }
+        return s;
+    }
+
+    std::shared_ptr<const std::vector<std::pair<HOOK, HOOK>>> currentHooks() const
+    {
+        return std::atomic_load(&hooks_);
+    }
+
+    std::shared_ptr<LatencyHistogram> histogram(uint64_t hash, const std::string &fingerprint)
+    {
+        Shard &shard = shards_[hash % shards_.size()];
+        std::lock_guard<std::mutex> lck(shard.mutex);
+        FingerprintStats &s = shard.stats[hash];
+        if (!s.histogram)
+        {
+            s.fingerprint = fingerprint;
+            s.histogram = std::make_shared<LatencyHistogram>();
+        }
+        return s.histogram;
+    }
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<uint64_t> slow_threshold_us_{0};
+    std::mutex hooks_mutex_; //只保护添加，读取用atomic_load
+    std::shared_ptr<const std::vector<std::pair<HOOK, HOOK>>> hooks_;
+    TraceRing ring_;
+    std::array<Shard, 16> shards_;
+    std::array<TableShard, 16> table_shards_;
+    std::mutex slow_mutex_;
+    std::deque<QueryTraceEvent> slow_log_;
+    size_t slow_capacity_ = 1000;
+};
+
+/*
+* 跟踪一次执行，没有开启跟踪时什么都不做
+*/
+class QueryTraceScope
+{
+  public:
+    QueryTraceScope(int op, const std::string &table, const std::string &sql, uint64_t conn_key = 0)
+    {
+        active_ = QueryTracer::instance().enabled();
+        if (!active_)
+        {
+            return;
+        }
+        event_.op = op;
+        event_.table = table;
+        event_.sql = sql;
+        event_.conn_key = conn_key;
+        QueryTracer::instance().begin(event_);
+        start_ = std::chrono::steady_clock::now();
+    }
+
+    void finish(int64_t rows, int error_code)
+    {
+        if (!active_)
+        {
+            return;
+        }
+        event_.rows = rows;
+        event_.error_code = error_code;
+        event_.latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+        QueryTracer::instance().end(event_);
+        active_ = false;
+    }
+
+  private:
+    bool active_ = false;
+    QueryTraceEvent event_;
+    std::chrono::steady_clock::time_point start_;
+};
+#endif
@@ -0,0 +1,163 @@
+#ifndef RETRY_POLICY_H_
+#define RETRY_POLICY_H_
+#include <memory>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "query_context.h"
+
+/*
+* 重试策略：最多执行max_attempts次，两次之间等待指数增长的随机时间(上限max_backoff_ms)，
+* 从第一次执行开始超过deadline_ms或者超过当前的QueryDeadline后不再重试
+*/
+struct RetryPolicy
+{
+    uint32_t max_attempts = 3;
+    uint32_t base_backoff_ms = 20;
+    uint32_t max_backoff_ms = 500;
+    uint32_t deadline_ms = 3000;
+
+    //只执行一次
+    static RetryPolicy none()
+    {
+        RetryPolicy policy;
+        policy.max_attempts = 1;
+        return policy;
+    }
+};
+
+//连接断开或者主从切换时的错误，换连接/重连后再执行可能成功
+inline bool isConnectionError(int error_code)
+{
+    return error_code == 2006 || error_code == 2013 || error_code == 2003 || error_code == 2055;
+}
+
+//值得重试的错误：连接类错误，以及死锁(1213)被选为牺牲者
+inline bool isRetryableError(int error_code)
+{
+    return isConnectionError(error_code) || error_code == 1213;
+}
+
+namespace retry_detail
+{
+/*
+* @fun:重试循环，attempt执行一次并返回错误码(0：成功；>0：mysql错误码；<0：不重试直接返回)，
+*      连接类错误先调用reconnect再重试
+*/
+template <typename ATTEMPT, typename RECONNECT>
+int retryLoop(const RetryPolicy &policy, bool in_txn, ATTEMPT &&attempt_fn, RECONNECT &&reconnect)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(policy.deadline_ms);
+    QueryDeadline::CLOCK::time_point ctx_deadline;
+    bool has_ctx_deadline = QueryDeadline::current(ctx_deadline);
+    if (has_ctx_deadline && ctx_deadline < deadline)
+    {
+        deadline = ctx_deadline;
+    }
+    uint32_t backoff_ms = std::max<uint32_t>(policy.base_backoff_ms, 1);
+    for (uint32_t attempt = 1;; attempt++)
+    {
+        if (QueryDeadline::expired())
+        {
+            return -4;
+        }
+
+        int error_code = attempt_fn();
+        if (error_code <= 0)
+        {
+            return error_code;
+        }
+
+        if (error_code == 3024 || (error_code == 1317 && has_ctx_deadline))
+        { //MAX_EXECUTION_TIME超时或者被QueryWatchdog中止
+            return -4;
+        }
+
+        if (isConnectionError(error_code))
+        {
+            reconnect();
+        }
+
+        if (in_txn || !isRetryableError(error_code) || attempt >= policy.max_attempts)
+        {
+            return error_code;
+        }
+
+        //full jitter，避免大量调用者同时重试
+        static thread_local std::minstd_rand rand_engine(std::random_device{}());
+        std::uniform_int_distribution<uint32_t> dist(0, backoff_ms);
+        auto wake_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(dist(rand_engine));
+        if (wake_time >= deadline)
+        {
+            return error_code;
+        }
+        std::this_thread::sleep_until(wake_time);
+        backoff_ms = std::min(backoff_ms * 2, std::max<uint32_t>(policy.max_backoff_ms, 1));
+    }
+}
+} // namespace retry_detail
+
+/*
+* @fun:按策略执行fn，fn出错时抛出sql::SQLException；连接类错误先重连再重试。
+*      连接处于事务中时不重试，重连后事务已经丢失，只能由调用者整体重做
+* @param[in] policy 重试策略
+* @param[in] conn 连接
+* @param[in] fn 执行体，参数为conn，每次重试都重新执行整个fn
+* @return 0：成功；>0：最后一次的mysql错误码；-1：客户端错误(没有mysql错误码)；-2：连接无效；-4：超过QueryDeadline，语句未执行或者已被中止
+*/
+template <typename FN>
+int runWithRetry(const RetryPolicy &policy, const std::shared_ptr<sql::Connection> &conn, FN &&fn)
+{
+    if (!conn)
+    {
+        return -2;
+    }
+
+    bool in_txn = false;
+    try
+    {
+        in_txn = !conn->getAutoCommit();
+    }
+    catch (sql::SQLException &)
+    {
+    }
+
+    return retry_detail::retryLoop(policy, in_txn,
+                                   [&]() -> int {
+                                       try
+                                       {
+                                           fn(conn);
+                                           return 0;
+                                       }
+                                       catch (sql::SQLException &e)
+                                       { //客户端抛出的异常(连接已关闭、列名不存在等)没有错误码，不能当成成功
+                                           return e.getErrorCode() > 0 ? e.getErrorCode() : -1;
+                                       }
+                                   },
+                                   [&]() {
+                                       ConnectionIds::forget(conn.get());
+                                       try
+                                       {
+                                           conn->reconnect();
+                                       }
+                                       catch (sql::SQLException &)
+                                       {
+                                       }
+                                   });
+}
+
+/*
+* @fun:runWithRetry的驱动版本(见db_driver.h)，fn(driver)返回驱动的错误码，不抛异常。
+*      驱动不知道连接是否在事务中，事务里的语句要传RetryPolicy::none()
+* @return 同runWithRetry
+*/
+template <typename DRIVER, typename FN>
+int runDriverWithRetry(const RetryPolicy &policy, DRIVER &driver, FN &&fn)
+{
+    return retry_detail::retryLoop(policy, false, [&]() -> int { return fn(driver); }, [&]() { driver.reconnect(); });
+}
+#endif
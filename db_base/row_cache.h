@@ -0,0 +1,357 @@
+#ifndef ROW_CACHE_H_
+#define ROW_CACHE_H_
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+
+enum E_ROW_CACHE_RESULT
+{
+    E_ROW_CACHE_MISS = 0,         //没有缓存，需要查库
+    E_ROW_CACHE_HIT = 1,          //命中
+    E_ROW_CACHE_NEGATIVE_HIT = 2  //命中了"不存在"的缓存，不需要查库
+};
+
+/*
+* 一个分片：LRU链表 + 哈希表，有自己的锁
+*/
+template <typename KEY, typename VAL>
+class LruShard
+{
+  public:
+    using CLOCK = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        KEY key;
+        VAL value;
+        CLOCK::time_point expire_time;
+    };
+
+    explicit LruShard(size_t capacity)
+    {
+        capacity_ = capacity > 0 ? capacity : 1;
+    }
+
+    //找到并且没过期时拷贝出值，返回true
+    bool get(const KEY &key, VAL &value, CLOCK::time_point now)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end())
+        {
+            return false;
+        }
+
+        if (now >= it->second->expire_time)
+        {
+            lru_.erase(it->second);
+            entries_.erase(it);
+            return false;
+        }
+
+        lru_.splice(lru_.begin(), lru_, it->second);
+        value = it->second->value;
+        return true;
+    }
+
+    //返回被淘汰的个数
+    size_t put(const KEY &key, const VAL &value, CLOCK::time_point expire_time)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            it->second->value = value;
+            it->second->expire_time = expire_time;
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return 0;
+        }
+
+        size_t evicted = 0;
+        while (entries_.size() >= capacity_ && !lru_.empty())
+        {
+            entries_.erase(lru_.back().key);
+            lru_.pop_back();
+            evicted++;
+        }
+
+        lru_.push_front(Entry{key, value, expire_time});
+        entries_[key] = lru_.begin();
+        return evicted;
+    }
+
+    void erase(const KEY &key)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end())
+        {
+            lru_.erase(it->second);
+            entries_.erase(it);
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        entries_.clear();
+        lru_.clear();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        return entries_.size();
+    }
+
+  private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<Entry> lru_;
+    std::unordered_map<KEY, typename std::list<Entry>::iterator> entries_;
+};
+
+/*
+* 分片的行缓存，存放解码后的记录结构体，放在数据库层前面。
+* 支持二级索引(例如按stream_id找T_TaskRecord)指向同一条记录，支持缓存"不存在"，统计命中率。用法:
+*   RowCache<T_TaskRecord> cache(100000, 60000);
+*   cache.put(record.task_id, std::make_shared<const T_TaskRecord>(record), {{"stream_id", record.stream_id}});
+*   std::shared_ptr<const T_TaskRecord> r;
+*   if (cache.getBy("stream_id", stream_id, r) == E_ROW_CACHE_MISS) { 查库后put或putNegativeBy }
+*/
+template <typename V, typename K = std::string>
+class RowCache
+{
+  public:
+    using VALUE_PTR = std::shared_ptr<const V>;
+    using ALIASES = std::vector<std::pair<std::string, std::string>>; //<索引名, 二级键>
+
+    /*
+    * @param[in] capacity 最多缓存的记录数
+    * @param[in] ttl_ms 记录的过期时间
+    * @param[in] negative_ttl_ms "不存在"的过期时间，一般比ttl_ms短
+    * @param[in] shard_count 分片数
+    */
+    RowCache(size_t capacity, uint32_t ttl_ms = 60000, uint32_t negative_ttl_ms = 1000, size_t shard_count = 16)
+    {
+        ttl_ = std::chrono::milliseconds(ttl_ms);
+        negative_ttl_ = std::chrono::milliseconds(negative_ttl_ms);
+        shard_count = shard_count > 0 ? shard_count : 1;
+        size_t per_shard = (capacity + shard_count - 1) / shard_count;
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            shards_.emplace_back(new LruShard<K, ROW_PTR>(per_shard));
+            alias_shards_.emplace_back(new LruShard<std::string, Alias>(per_shard));
+        }
+    }
+
+    RowCache(const RowCache &) = delete;
+    RowCache &operator=(const RowCache &) = delete;
+
+    /*
+    * @fun:按主键查找
+    * @param[out] value 命中时的记录
+    */
+    E_ROW_CACHE_RESULT get(const K &key, VALUE_PTR &value)
+    {
+        ROW_PTR row;
+        if (!shard(key).get(key, row, LruShard<K, ROW_PTR>::CLOCK::now()))
+        {
+            misses_++;
+            return E_ROW_CACHE_MISS;
+        }
+        return hit(*row, value);
+    }
+
+    /*
+    * @fun:按二级索引查找
+    * @param[in] index 索引名，例如"stream_id"
+    * @param[in] skey 二级键
+    * @param[out] value 命中时的记录
+    */
+    E_ROW_CACHE_RESULT getBy(const std::string &index, const std::string &skey, VALUE_PTR &value)
+    {
+        std::string alias_key = aliasKey(index, skey);
+        auto now = LruShard<K, ROW_PTR>::CLOCK::now();
+        Alias alias;
+        if (!aliasShard(alias_key).get(alias_key, alias, now))
+        {
+            misses_++;
+            return E_ROW_CACHE_MISS;
+        }
+
+        if (alias.negative)
+        {
+            negative_hits_++;
+            return E_ROW_CACHE_NEGATIVE_HIT;
+        }
+
+        ROW_PTR row;
+        if (!shard(alias.key).get(alias.key, row, now) || !hasAlias(*row, alias_key))
+        { //主记录被淘汰或者二级键已经变了
+            aliasShard(alias_key).erase(alias_key);
+            misses_++;
+            return E_ROW_CACHE_MISS;
+        }
+        return hit(*row, value);
+    }
+
+    /*
+    * @fun:放入记录
+    * @param[in] aliases 这条记录的二级键
+    */
+    void put(const K &key, const VALUE_PTR &value, const ALIASES &aliases = ALIASES())
+    {
+        std::shared_ptr<Row> row = std::make_shared<Row>();
+        row->value = value;
+        auto now = LruShard<K, ROW_PTR>::CLOCK::now();
+        for (const auto &a : aliases)
+        {
+            row->aliases.emplace_back(aliasKey(a.first, a.second));
+            Alias alias;
+            alias.key = key;
+            aliasShard(row->aliases.back()).put(row->aliases.back(), alias, now + ttl_);
+        }
+        evictions_ += shard(key).put(key, row, now + ttl_);
+    }
+
+    //记录不存在
+    void putNegative(const K &key)
+    {
+        ROW_PTR row = std::make_shared<const Row>();
+        evictions_ += shard(key).put(key, row, LruShard<K, ROW_PTR>::CLOCK::now() + negative_ttl_);
+    }
+
+    void putNegativeBy(const std::string &index, const std::string &skey)
+    {
+        std::string alias_key = aliasKey(index, skey);
+        Alias alias;
+        alias.negative = true;
+        aliasShard(alias_key).put(alias_key, alias, LruShard<K, ROW_PTR>::CLOCK::now() + negative_ttl_);
+    }
+
+    //记录被修改或删除后调用，二级键在查找时校验，不需要单独删除
+    void erase(const K &key)
+    {
+        shard(key).erase(key);
+    }
+
+    void eraseBy(const std::string &index, const std::string &skey)
+    {
+        std::string alias_key = aliasKey(index, skey);
+        aliasShard(alias_key).erase(alias_key);
+    }
+
+    void clear()
+    {
+        for (auto &s : shards_)
+        {
+            s->clear();
+        }
+        for (auto &s : alias_shards_)
+        {
+            s->clear();
+        }
+    }
+
+    size_t size()
+    {
+        size_t n = 0;
+        for (auto &s : shards_)
+        {
+            n += s->size();
+        }
+        return n;
+    }
+
+    uint64_t hits() const
+    {
+        return hits_;
+    }
+
+    uint64_t misses() const
+    {
+        return misses_;
+    }
+
+    uint64_t negativeHits() const
+    {
+        return negative_hits_;
+    }
+
+    uint64_t evictions() const
+    {
+        return evictions_;
+    }
+
+  private:
+    struct Row
+    {
+        VALUE_PTR value; //nullptr表示不存在
+        std::vector<std::string> aliases;
+    };
+    using ROW_PTR = std::shared_ptr<const Row>; //命中时只拷贝指针
+
+    struct Alias
+    {
+        K key;
+        bool negative = false;
+    };
+
+    E_ROW_CACHE_RESULT hit(const Row &row, VALUE_PTR &value)
+    {
+        if (!row.value)
+        {
+            negative_hits_++;
+            return E_ROW_CACHE_NEGATIVE_HIT;
+        }
+        hits_++;
+        value = row.value;
+        return E_ROW_CACHE_HIT;
+    }
+
+    static bool hasAlias(const Row &row, const std::string &alias_key)
+    {
+        for (const auto &a : row.aliases)
+        {
+            if (a == alias_key)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::string aliasKey(const std::string &index, const std::string &skey)
+    {
+        return index + '\1' + skey;
+    }
+
+    LruShard<K, ROW_PTR> &shard(const K &key)
+    {
+        return *shards_[std::hash<K>()(key) % shards_.size()];
+    }
+
+    LruShard<std::string, Alias> &aliasShard(const std::string &alias_key)
+    {
+        return *alias_shards_[std::hash<std::string>()(alias_key) % alias_shards_.size()];
+    }
+
+    std::chrono::milliseconds ttl_;
+    std::chrono::milliseconds negative_ttl_;
+    std::vector<std::unique_ptr<LruShard<K, ROW_PTR>>> shards_;
+    std::vector<std::unique_ptr<LruShard<std::string, Alias>>> alias_shards_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> negative_hits_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
+#endif
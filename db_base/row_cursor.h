@@ -0,0 +1,139 @@
+#ifndef ROW_CURSOR_H_
+#define ROW_CURSOR_H_
+#include <memory>
+#include <vector>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "row_mapper.h"
+
+/*
+* 流式行游标，结果集以TYPE_FORWARD_ONLY方式执行(mysql_use_result)，
+* 服务端逐行推送，客户端不缓存整个结果集，内存占用与结果集大小无关。
+* 注意：游标未读完或未关闭之前，同一个连接上不能再执行其他语句。
+*/
+class RowCursor
+{
+  public:
+    RowCursor(std::shared_ptr<sql::Statement> stmt, std::shared_ptr<sql::ResultSet> res, size_t fetch_size)
+    {
+        stmt_ = stmt;
+        res_ = res;
+        fetch_size_ = fetch_size > 0 ? fetch_size : 1;
+    }
+
+    RowCursor(const RowCursor &) = delete;
+    RowCursor &operator=(const RowCursor &) = delete;
+
+    virtual ~RowCursor()
+    {
+        close();
+    }
+
+    /*
+    * @fun:移动到下一行
+    * @return true：有数据；false：已经读完或出错
+    */
+    bool next()
+    {
+        if (!res_)
+        {
+            return false;
+        }
+
+        try
+        {
+            if (res_->next())
+            {
+                return true;
+            }
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode();
+        }
+        close();
+        return false;
+    }
+
+    //当前行，用于按列读取
+    const std::shared_ptr<sql::ResultSet> &row() const
+    {
+        return res_;
+    }
+
+    /*
+    * @fun:读取下一批数据，每批最多fetch_size行，T需要有ROW_MAPPING映射
+    * @param[out] rows 读到的行，会先清空，vector的容量复用
+    * @return 本批读到的行数，0表示已经读完
+    */
+    template <typename T>
+    size_t fetch(std::vector<T> &rows)
+    {
+        rows.clear(); //不复用上一批的元素，结果集里没有的列保持默认值
+        size_t count = 0;
+        if (res_)
+        {
+            RowMapper<T> mapper(*res_); //列下标每批解析一次
+            while (count < fetch_size_ && next())
+            {
+                rows.emplace_back();
+                mapper.decode(*res_, rows.back());
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /*
+    * @fun:同fetch，StrRef字段放在arena里；arena由调用者在处理完一批后reset
+    * @param[out] rows 读到的行，会先清空，vector的容量复用
+    * @return 本批读到的行数，0表示已经读完
+    */
+    template <typename T>
+    size_t fetch(std::vector<T> &rows, Arena &arena)
+    {
+        rows.clear();
+        size_t count = 0;
+        if (res_)
+        {
+            RowMapper<T> mapper(*res_);
+            while (count < fetch_size_ && next())
+            {
+                rows.emplace_back();
+                mapper.decode(*res_, rows.back(), arena);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    size_t fetchSize() const
+    {
+        return fetch_size_;
+    }
+
+    //读取过程中的错误码，0表示没有错误
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    bool eof() const
+    {
+        return res_ == nullptr;
+    }
+
+    //提前关闭，未读完的行由驱动丢弃
+    void close()
+    {
+        res_.reset();
+        stmt_.reset();
+    }
+
+  private:
+    std::shared_ptr<sql::Statement> stmt_;
+    std::shared_ptr<sql::ResultSet> res_;
+    size_t fetch_size_ = 1;
+    int error_code_ = 0;
+};
+#endif
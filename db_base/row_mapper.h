@@ -0,0 +1,262 @@
+#ifndef ROW_MAPPER_H_
+#define ROW_MAPPER_H_
+#include <array>
+#include <tuple>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "arena.h"
+
+/*
+* 记录结构体与结果集字段的映射，字段下标在每个结果集上只解析一次，之后按下标解码。
+* 用法:
+*   ROW_MAPPING(T_CourseRecord,
+*       ROW_FIELD(T_CourseRecord, id),
+*       ROW_FIELD(T_CourseRecord, uid));
+*   RowMapper<T_CourseRecord> mapper(*res);
+*   while (res->next()) { mapper.decode(*res, record); }
+*/
+
+template <typename T, typename M>
+struct RowField
+{
+    const char *name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr RowField<T, M> rowField(const char *name, M T::*member)
+{
+    return RowField<T, M>{name, member};
+}
+
+template <typename T>
+struct RowMapping; //每个记录结构体特化一次，见ROW_MAPPING
+
+#define ROW_FIELD(T, F) rowField(#F, &T::F)
+
+#define ROW_MAPPING(T, ...)                                         \
+    template <>                                                     \
+    struct RowMapping<T>                                            \
+    {                                                               \
+        static const auto &fields()                                 \
+        {                                                           \
+            static const auto fields_ = std::make_tuple(__VA_ARGS__); \
+            return fields_;                                         \
+        }                                                           \
+    }
+
+inline void assignColumnString(std::string &out, const sql::SQLString &s)
+{
+    out.assign(s.c_str(), s.length()); //复用out已有的容量
+}
+
+inline void assignColumnString(std::string &out, std::string &&s)
+{
+    out = std::move(s);
+}
+
+inline void assignColumnString(std::string &out, const StrRef &s)
+{
+    out.assign(s.data, s.size); //NativeDriver的结果直接指向绑定的缓冲区
+}
+
+inline StrRef columnView(const sql::SQLString &s)
+{
+    return StrRef(s.c_str(), s.length());
+}
+
+inline StrRef columnView(const std::string &s)
+{
+    return StrRef(s.data(), s.size());
+}
+
+inline StrRef columnView(const StrRef &s)
+{
+    return s;
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, int32_t &out)
+{
+    out = res.getInt(idx);
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, uint32_t &out)
+{
+    out = res.getUInt(idx);
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, int64_t &out)
+{
+    out = res.getInt64(idx);
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, uint64_t &out)
+{
+    out = res.getUInt64(idx);
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, double &out)
+{
+    out = static_cast<double>(res.getDouble(idx));
+}
+
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, std::string &out)
+{
+    assignColumnString(out, res.getString(idx));
+}
+
+//带Arena的解码：StrRef字段的内容复制到arena里，其他类型与普通解码相同
+template <typename RS, typename M>
+void readColumn(const RS &res, uint32_t idx, M &out, Arena &)
+{
+    readColumn(res, idx, out);
+}
+
+/*
+* 注意：sql::ResultSet::getString按值返回SQLString，Connector/C++没有不复制的接口，
+* 所以在sql::ResultSet上每个StrRef字段仍有一次临时分配，只是记录本身不再持有std::string。
+* 要完全去掉逐字段分配，用NativeDriver的NativeStatement(getString直接返回指向绑定缓冲区的StrRef)。
+*/
+template <typename RS>
+void readColumn(const RS &res, uint32_t idx, StrRef &out, Arena &arena)
+{
+    const auto &s = res.getString(idx);
+    StrRef view = columnView(s);
+    out = arenaString(arena, view.data, view.size);
+}
+
+template <typename T, typename RS = sql::ResultSet>
+class RowMapper
+{
+  public:
+    using FIELDS = typename std::decay<decltype(RowMapping<T>::fields())>::type;
+    static constexpr size_t field_count = std::tuple_size<FIELDS>::value;
+
+    /*
+    * @fun:按结果集解析每个字段的列下标，结果集中没有的字段解码时跳过
+    * @param[in] res 结果集
+    */
+    explicit RowMapper(const RS &res)
+    {
+        resolve(res, std::make_index_sequence<field_count>());
+    }
+
+    //按下标解码当前行
+    void decode(const RS &res, T &out) const
+    {
+        decode(res, out, std::make_index_sequence<field_count>());
+    }
+
+    //按下标解码当前行，StrRef字段的内容放在arena里，与arena同生命周期
+    void decode(const RS &res, T &out, Arena &arena) const
+    {
+        decode(res, out, arena, std::make_index_sequence<field_count>());
+    }
+
+    /*
+    * @fun:读取结果集剩余的所有行
+    * @param[out] rows 解码后的记录，追加在末尾
+    * @return 读取的行数
+    */
+    size_t decodeAll(RS &res, std::vector<T> &rows) const
+    {
+        size_t count = 0;
+        while (res.next())
+        {
+            rows.emplace_back();
+            decode(res, rows.back());
+            count++;
+        }
+        return count;
+    }
+
+    /*
+    * @fun:读取结果集剩余的所有行，变长字段全部放在arena里，整批用完后arena.reset()一次释放
+    * @param[out] rows 解码后的记录，追加在末尾
+    * @return 读取的行数
+    */
+    size_t decodeAll(RS &res, std::vector<T> &rows, Arena &arena) const
+    {
+        size_t count = 0;
+        while (res.next())
+        {
+            rows.emplace_back();
+            decode(res, rows.back(), arena);
+            count++;
+        }
+        return count;
+    }
+
+    //字段在结果集中的列下标，0表示结果集中没有该字段
+    uint32_t columnIndex(size_t field) const
+    {
+        return idx_[field];
+    }
+
+  private:
+    template <size_t... I>
+    void resolve(const RS &res, std::index_sequence<I...>)
+    {
+        const FIELDS &fields = RowMapping<T>::fields();
+        idx_ = {{res.findColumn(std::get<I>(fields).name)...}};
+    }
+
+    template <size_t... I>
+    void decode(const RS &res, T &out, std::index_sequence<I...>) const
+    {
+        const FIELDS &fields = RowMapping<T>::fields();
+        int expand[] = {0, (idx_[I] > 0 ? (readColumn(res, idx_[I], out.*(std::get<I>(fields).member)), 0) : 0)...};
+        (void)expand;
+    }
+
+    template <size_t... I>
+    void decode(const RS &res, T &out, Arena &arena, std::index_sequence<I...>) const
+    {
+        const FIELDS &fields = RowMapping<T>::fields();
+        int expand[] = {0, (idx_[I] > 0 ? (readColumn(res, idx_[I], out.*(std::get<I>(fields).member), arena), 0) : 0)...};
+        (void)expand;
+    }
+
+    std::array<uint32_t, field_count> idx_;
+};
+
+/*
+* @fun:读取结果集剩余的所有行并解码成记录
+* @return 解码后的记录，结果集为空时返回空数组
+*/
+template <typename T, typename RS>
+std::vector<T> mapRows(const std::shared_ptr<RS> &res)
+{
+    std::vector<T> rows;
+    if (res)
+    {
+        RowMapper<T, RS> mapper(*res);
+        mapper.decodeAll(*res, rows);
+    }
+    return rows;
+}
+
+//同mapRows，StrRef字段放在arena里，arena必须比返回的记录活得久
+template <typename T, typename RS>
+std::vector<T> mapRows(const std::shared_ptr<RS> &res, Arena &arena)
+{
+    std::vector<T> rows;
+    if (res)
+    {
+        RowMapper<T, RS> mapper(*res);
+        mapper.decodeAll(*res, rows, arena);
+    }
+    return rows;
+}
+#endif
@@ -0,0 +1,136 @@
+#ifndef SINGLE_FLIGHT_H_
+#define SINGLE_FLIGHT_H_
+#include <mutex>
+#include <future>
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "conn_provider.h"
+#include "query_cache.h"
+#include "query_context.h"
+
+/*
+* 并发的相同请求合并：同一个key同时只有一个调用真正执行，其他调用等待并共享它的结果
+*/
+template <typename V>
+class SingleFlight
+{
+  public:
+    SingleFlight()
+    {
+    }
+
+    SingleFlight(const SingleFlight &) = delete;
+    SingleFlight &operator=(const SingleFlight &) = delete;
+
+    /*
+    * @fun:执行或者等待正在执行的相同调用
+    * @param[in] key 请求的key，例如规范化后的sql
+    * @param[in] fn 真正的执行函数，抛出的异常会传给所有等待者
+    * @param[out] shared 非空时返回结果是否来自别的调用
+    */
+    V doCall(const std::string &key, const std::function<V()> &fn, bool *shared = nullptr)
+    {
+        std::promise<V> promise;
+        {
+            std::unique_lock<std::mutex> lck(calls_mutex_);
+            auto it = calls_.find(key);
+            if (it != calls_.end())
+            {
+                std::shared_future<V> f = it->second;
+                lck.unlock();
+                if (shared)
+                {
+                    *shared = true;
+                }
+                return f.get();
+            }
+            calls_.emplace(key, promise.get_future().share());
+        }
+
+        if (shared)
+        {
+            *shared = false;
+        }
+
+        try
+        {
+            V v = fn();
+            promise.set_value(v);
+            forget(key);
+            return v;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            forget(key);
+            throw;
+        }
+    }
+
+    //正在执行的调用数
+    size_t inflight()
+    {
+        std::lock_guard<std::mutex> lck(calls_mutex_);
+        return calls_.size();
+    }
+
+  private:
+    void forget(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lck(calls_mutex_);
+        calls_.erase(key);
+    }
+
+    std::mutex calls_mutex_;
+    std::unordered_map<std::string, std::shared_future<V>> calls_;
+};
+
+using QUERY_FLIGHT = SingleFlight<std::shared_ptr<const CachedResult>>;
+
+/*
+* @fun:合并并发的相同查询，只有真正执行的调用才从连接池借连接
+* @param[in] flight 合并器
+* @param[in] provider 连接提供者
+* @param[in] sql 查询语句
+* @return nullptr：取不到连接或执行出错；非nullptr：结果游标，可以用RowMapper解码
+*/
+inline std::shared_ptr<CachedResultSet> sharedQuery(QUERY_FLIGHT &flight, const CONN_PROVIDER &provider, const std::string &sql)
+{
+    std::shared_ptr<const CachedResult> result = flight.doCall(QueryCache::normalize(sql), [&]() {
+        std::shared_ptr<const CachedResult> r;
+        std::shared_ptr<sql::Connection> conn = provider();
+        if (!conn)
+        {
+            return r;
+        }
+
+        try
+        {
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            std::shared_ptr<sql::ResultSet> res;
+            res.reset(stmt->executeQuery(sql));
+            r = std::make_shared<const CachedResult>(*res);
+        }
+        catch (sql::SQLException &e)
+        {
+            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
+            {
+                ConnectionIds::forget(conn.get());
+                conn->reconnect();
+            }
+        }
+        return r;
+    });
+
+    if (!result)
+    {
+        return nullptr;
+    }
+    return std::make_shared<CachedResultSet>(result);
+}
+#endif
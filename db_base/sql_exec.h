@@ -0,0 +1,36 @@
+#ifndef SQL_EXEC_H_
+#define SQL_EXEC_H_
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "retry_policy.h"
+#include "query_trace.h"
+#include "io_accounting.h"
+
+/*
+* @fun:在conn上执行一次操作，出错时按重试策略重连、退避后重新执行，开启跟踪时记录这次执行(慢日志、抓包)，
+*      开启I/O统计时统计。Table、预处理执行(CompiledQuery、StaticQuery)、多语句批量和组提交都经过这里
+* @param[in] conn 连接
+* @param[in] op E_MYSQL_OP的值，和table、sql一起用于跟踪和统计
+* @param[in] policy 重试策略，不幂等的写操作传RetryPolicy::none()，事务中的连接不会重试
+* @param[in] fn 执行体，参数为连接，返回结果或影响的行数，未知时返回-1；出错时抛出sql::SQLException，
+*            和服务端往返的驱动调用用IoScope::roundTrip包住
+* @param[in] sample_io 是否参与I/O统计的服务端字节数采样，结果集留到返回后流式读取时传false
+* @return 0：成功；>0：mysql错误码；-1：客户端错误；-2：连接无效；-4：超过QueryDeadline
+*/
+template <typename FN>
+int runTrackedSql(const std::shared_ptr<sql::Connection> &conn, int op, const std::string &table, const std::string &sql,
+                  const RetryPolicy &policy, FN &&fn, bool sample_io = true)
+{
+    QueryTraceScope trace(op, table, sql, reinterpret_cast<uintptr_t>(conn.get()));
+    IoScope io(op, table, conn, sample_io);
+    int64_t rows = -1;
+    int err = runWithRetry(policy, conn, [&](const std::shared_ptr<sql::Connection> &c) {
+        rows = fn(c);
+    });
+    trace.finish(err == 0 ? rows : -1, err);
+    return err;
+}
+#endif
@@ -0,0 +1,186 @@
+#ifndef SQL_PARAM_H_
+#define SQL_PARAM_H_
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#include "mysql/cppconn/prepared_statement.h"
+
+/*
+* @fun:按参数类型绑定到预处理语句的占位符上
+* @param[in] pstmt 预处理语句
+* @param[in] idx 占位符下标，从1开始
+* @param[in] v 参数值
+*/
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+bindParam(sql::PreparedStatement *pstmt, unsigned int idx, T v)
+{
+    if (sizeof(T) <= sizeof(int32_t))
+    {
+        pstmt->setInt(idx, static_cast<int32_t>(v));
+    }
+    else
+    {
+        pstmt->setInt64(idx, static_cast<int64_t>(v));
+    }
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+bindParam(sql::PreparedStatement *pstmt, unsigned int idx, T v)
+{
+    if (sizeof(T) <= sizeof(uint32_t))
+    {
+        pstmt->setUInt(idx, static_cast<uint32_t>(v));
+    }
+    else
+    {
+        pstmt->setUInt64(idx, static_cast<uint64_t>(v));
+    }
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+bindParam(sql::PreparedStatement *pstmt, unsigned int idx, T v)
+{
+    pstmt->setDouble(idx, static_cast<double>(v));
+}
+
+inline void bindParam(sql::PreparedStatement *pstmt, unsigned int idx, const std::string &v)
+{
+    pstmt->setString(idx, v);
+}
+
+inline void bindParam(sql::PreparedStatement *pstmt, unsigned int idx, const char *v)
+{
+    pstmt->setString(idx, v);
+}
+
+/*
+* @fun:把参数转成sql字面量，字符串会转义并加上单引号，用于需要拼接sql文本的场景(如多语句批量执行)
+*/
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value, std::string>::type
+sqlLiteral(T v)
+{
+    return std::to_string(v);
+}
+
+//浮点数用%.17g，能原样还原；std::to_string固定6位小数，1e-7会变成0.000000
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, std::string>::type
+sqlLiteral(T v)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", static_cast<double>(v));
+    return buf;
+}
+
+//枚举按底层整数
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value, std::string>::type
+sqlLiteral(T v)
+{
+    return sqlLiteral(static_cast<typename std::underlying_type<T>::type>(v));
+}
+
+inline std::string sqlLiteral(const std::string &v)
+{
+    std::string out;
+    out.reserve(v.size() + 2);
+    out += '\'';
+    for (char c : v)
+    {
+        switch (c)
+        {
+        case '\0':
+            out += "\\0";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\x1a':
+            out += "\\Z";
+            break;
+        case '\'':
+        case '"':
+        case '\\':
+            out += '\\';
+            out += c;
+            break;
+        default:
+            out += c;
+        }
+    }
+    out += '\'';
+    return out;
+}
+
+inline std::string sqlLiteral(const char *v)
+{
+    return sqlLiteral(std::string(v));
+}
+
+/*
+* @fun:把sql中的占位符依次替换成字面量，引号里的?不算占位符
+* @return 替换后的sql，占位符和字面量个数不一致时返回空串
+*/
+inline std::string renderSql(const std::string &sql, const std::vector<std::string> &literals)
+{
+    std::string out;
+    out.reserve(sql.size() + 16 * literals.size());
+    size_t n = 0;
+    char quote = 0;
+    for (size_t i = 0; i < sql.size(); i++)
+    {
+        char c = sql[i];
+        if (quote)
+        {
+            out += c;
+            if (c == '\\' && i + 1 < sql.size())
+            {
+                out += sql[++i];
+            }
+            else if (c == quote)
+            {
+                quote = 0;
+            }
+        }
+        else if (c == '\'' || c == '"' || c == '`')
+        {
+            quote = c;
+            out += c;
+        }
+        else if (c == '?')
+        {
+            if (n >= literals.size())
+            {
+                return "";
+            }
+            out += literals[n++];
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return n == literals.size() ? out : "";
+}
+
+inline void bindParams(sql::PreparedStatement *, unsigned int)
+{
+}
+
+template <typename T, typename... REST>
+void bindParams(sql::PreparedStatement *pstmt, unsigned int idx, T &&v, REST &&... rest)
+{
+    bindParam(pstmt, idx, std::forward<T>(v));
+    bindParams(pstmt, idx + 1, std::forward<REST>(rest)...);
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef STATEMENT_BATCH_H_
+#define STATEMENT_BATCH_H_
+#include <memory>
+#include <string>
+#include <vector>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "sql_exec.h"
+#include "query_cache.h"
+#include "query_context.h"
+
+struct BatchResult
+{
+    bool executed = false;                //前面的语句出错时，后面的语句不会被执行
+    int error_code = 0;                   //0：成功；>0：mysql错误码；-1：客户端错误；-4：超时
+    int64_t update_count = -1;            //UPDATE/INSERT/DELETE影响的行数，查询语句为-1
+    std::shared_ptr<sql::ResultSet> res;  //查询语句的结果集
+};
+
+/*
+* 多条语句一次网络往返执行，连接需要打开CLIENT_MULTI_STATEMENTS选项。这个选项只在单独的连接池上打开，
+* 普通连接池不打开，否则whereOrg等拼接原始文本的接口可能被注入多条语句。
+* 语句可以来自Table::get_sql()或CompiledQuery::render()。用法:
+*   auto batch_pool = std::make_shared<MySqlConnPool<CourseRecordDB>>([]() { return std::make_shared<CourseRecordDB>(true); });
+*   batch_pool->init(1, 4);
+*   StatementBatch batch;
+*   batch.add(table->update().set("status", 3).where("task_id", "=", task_id).get_sql());
+*   batch.add(kInsertLog.render(task_id, 3));
+*   std::vector<BatchResult> results = batch.execute(leaseConnection(batch_pool));
+*/
+class StatementBatch
+{
+  public:
+    StatementBatch()
+    {
+    }
+
+    //空语句忽略，返回是否加入
+    bool add(const std::string &sql)
+    {
+        if (sql.empty())
+        {
+            return false;
+        }
+        sqls_.emplace_back(sql);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return sqls_.size();
+    }
+
+    void clear()
+    {
+        sqls_.clear();
+    }
+
+    /*
+    * @fun:一次往返执行所有语句，遇到出错的语句服务端会停止执行后面的语句。不重试，跟踪和I/O统计里记为一次执行
+    * @param[in] conn 连接
+    * @return 每条语句的结果，顺序和add的顺序一致；连接无效或者已经超过QueryDeadline时所有语句executed为false
+    */
+    std::vector<BatchResult> execute(const std::shared_ptr<sql::Connection> &conn) const
+    {
+        std::vector<BatchResult> results(sqls_.size());
+        if (!conn || sqls_.empty())
+        {
+            return results;
+        }
+
+        std::string multi_sql;
+        int op = traceSqlOp(sqls_.front());
+        for (const auto &s : sqls_)
+        {
+            multi_sql += s;
+            multi_sql += ";";
+            if (traceSqlOp(s) != op)
+            { //不同类型的语句混在一起
+                op = 0;
+            }
+        }
+
+        size_t i = 0;
+        bool started = false;
+        int err = runTrackedSql(conn, op, "", multi_sql, RetryPolicy::none(), [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+            WatchdogGuard guard(conn);
+            started = true;
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            bool is_result = IoScope::roundTrip(multi_sql.size(), [&]() { return stmt->execute(multi_sql); });
+            int64_t rows = 0;
+            for (i = 0; i < sqls_.size(); i++)
+            {
+                if (i > 0)
+                { //后面的结果已经在路上，不算新的往返
+                    IoScope::ServerWait wait;
+                    is_result = stmt->getMoreResults();
+                }
+
+                BatchResult &r = results[i];
+                if (is_result)
+                {
+                    r.res.reset(stmt->getResultSet());
+                }
+                else
+                {
+                    r.update_count = static_cast<int64_t>(stmt->getUpdateCount());
+                    rows += r.update_count;
+                }
+                r.executed = true;
+            }
+            return rows;
+        });
+        if (err != 0 && started && i < results.size())
+        {
+            results[i].executed = true;
+            results[i].error_code = err;
+        }
+
+        for (i = 0; i < results.size(); i++)
+        { //让查询缓存失效，出错的语句也可能已经写了一部分
+            if (results[i].executed)
+            {
+                TableVersions::bumpSql(sqls_[i]);
+            }
+        }
+        return results;
+    }
+
+  private:
+    std::vector<std::string> sqls_;
+};
+#endif
@@ -0,0 +1,255 @@
+#ifndef STATIC_QUERY_H_
+#define STATIC_QUERY_H_
+#include <memory>
+#include <string>
+#include <utility>
+#include <type_traits>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "prepared_exec.h"
+
+/*
+* 编译期生成sql的查询模板，适用于形状固定的查询，sql文本和占位符个数在编译期确定，
+* 运行时只需要绑定参数。用法:
+*   SQL_NAME(TaskRecordTbl, "T_TaskRecord");
+*   SQL_NAME(ColStatus, "status");
+*   SQL_NAME(ColTaskId, "task_id");
+*   using TaskStatusByTaskId = StaticSelect<TaskRecordTbl, Columns<ColStatus>, Where<Cond<ColTaskId, SqlEq>>>;
+*   auto res = TaskStatusByTaskId::executeQuery(table->getConn(), task_id);
+*   //TaskStatusByTaskId::sql() == "SELECT status FROM T_TaskRecord WHERE task_id=?"
+*/
+
+//定义一个编译期名字(表名、字段名、操作符)
+#define SQL_NAME(NAME, STR)                                        \
+    struct NAME                                                    \
+    {                                                              \
+        static constexpr const char *str() { return STR; }         \
+        static constexpr size_t size() { return sizeof(STR) - 1; } \
+    }
+
+template <char... Cs>
+struct SqlText
+{
+    static constexpr char value[sizeof...(Cs) + 1] = {Cs..., '\0'};
+    static constexpr size_t size = sizeof...(Cs);
+};
+
+template <char... Cs>
+constexpr char SqlText<Cs...>::value[sizeof...(Cs) + 1];
+
+template <typename... S>
+struct SqlConcat;
+
+template <>
+struct SqlConcat<>
+{
+    using type = SqlText<>;
+};
+
+template <char... A>
+struct SqlConcat<SqlText<A...>>
+{
+    using type = SqlText<A...>;
+};
+
+template <char... A, char... B, typename... REST>
+struct SqlConcat<SqlText<A...>, SqlText<B...>, REST...>
+{
+    using type = typename SqlConcat<SqlText<A..., B...>, REST...>::type;
+};
+
+template <typename NAME, typename IDX>
+struct SqlNameText;
+
+template <typename NAME, size_t... I>
+struct SqlNameText<NAME, std::index_sequence<I...>>
+{
+    using type = SqlText<NAME::str()[I]...>;
+};
+
+template <typename NAME>
+using SqlTextOf = typename SqlNameText<NAME, std::make_index_sequence<NAME::size()>>::type;
+
+//用分隔符连接多个SqlText
+template <typename SEP, typename... S>
+struct SqlJoin;
+
+template <typename SEP>
+struct SqlJoin<SEP>
+{
+    using type = SqlText<>;
+};
+
+template <typename SEP, typename S>
+struct SqlJoin<SEP, S>
+{
+    using type = S;
+};
+
+template <typename SEP, typename S, typename... REST>
+struct SqlJoin<SEP, S, REST...>
+{
+    using type = typename SqlConcat<S, SEP, typename SqlJoin<SEP, REST...>::type>::type;
+};
+
+//操作符，自带占位符
+SQL_NAME(SqlEq, "=?");
+SQL_NAME(SqlNe, "<>?");
+SQL_NAME(SqlLt, "<?");
+SQL_NAME(SqlLe, "<=?");
+SQL_NAME(SqlGt, ">?");
+SQL_NAME(SqlGe, ">=?");
+SQL_NAME(SqlLike, " LIKE ?");
+
+SQL_NAME(SqlKwSelect, "SELECT ");
+SQL_NAME(SqlKwFrom, " FROM ");
+SQL_NAME(SqlKwWhere, " WHERE ");
+SQL_NAME(SqlKwAnd, " AND ");
+SQL_NAME(SqlKwUpdate, "UPDATE ");
+SQL_NAME(SqlKwSet, " SET ");
+SQL_NAME(SqlKwInsert, "INSERT INTO ");
+SQL_NAME(SqlKwValues, ") VALUES(");
+SQL_NAME(SqlKwDelete, "DELETE FROM ");
+SQL_NAME(SqlComma, ",");
+SQL_NAME(SqlLParen, "(");
+SQL_NAME(SqlRParen, ")");
+SQL_NAME(SqlPlaceholder, "?");
+
+template <typename COL, typename OP>
+struct Cond
+{
+    using text = typename SqlConcat<SqlTextOf<COL>, SqlTextOf<OP>>::type;
+};
+
+template <typename... COLS>
+struct Columns
+{
+};
+
+template <typename... CONDS>
+struct Where
+{
+};
+
+template <typename WHERE>
+struct SqlWhereClause;
+
+template <>
+struct SqlWhereClause<Where<>>
+{
+    using type = SqlText<>;
+};
+
+template <typename... CONDS>
+struct SqlWhereClause<Where<CONDS...>>
+{
+    using type = typename SqlConcat<SqlTextOf<SqlKwWhere>,
+                                    typename SqlJoin<SqlTextOf<SqlKwAnd>, typename CONDS::text...>::type>::type;
+};
+
+template <typename TABLE, typename TEXT, size_t PARAMS>
+struct StaticQuery
+{
+    using text = TEXT;
+    static constexpr size_t param_count = PARAMS;
+
+    static constexpr const char *sql()
+    {
+        return TEXT::value;
+    }
+
+    static constexpr const char *table()
+    {
+        return TABLE::str();
+    }
+
+    /*
+    * @fun:执行查询，见preparedQuery
+    * @return nullptr：连接无效或执行出错；非nullptr：结果集
+    */
+    template <typename... ARGS>
+    static std::shared_ptr<sql::ResultSet> executeQuery(const std::shared_ptr<sql::Connection> &conn, ARGS &&... args)
+    {
+        static_assert(sizeof...(ARGS) == PARAMS, "parameter count mismatch");
+        return preparedQuery(conn, table(), sql(), std::forward<ARGS>(args)...);
+    }
+
+    /*
+    * @fun:执行UPDATE/INSERT/DELETE，见preparedUpdate
+    * @return 影响行数；-1：执行出错；-2：连接无效；-3：主键冲突；-4：超时
+    */
+    template <typename... ARGS>
+    static int executeUpdate(const std::shared_ptr<sql::Connection> &conn, ARGS &&... args)
+    {
+        static_assert(sizeof...(ARGS) == PARAMS, "parameter count mismatch");
+        return preparedUpdate(conn, table(), sql(), std::forward<ARGS>(args)...);
+    }
+};
+
+template <typename TABLE, typename TEXT, size_t PARAMS>
+constexpr size_t StaticQuery<TABLE, TEXT, PARAMS>::param_count;
+
+template <typename TABLE, typename COLS, typename WHERE>
+struct StaticSelect;
+
+template <typename TABLE, typename... COLS, typename... CONDS>
+struct StaticSelect<TABLE, Columns<COLS...>, Where<CONDS...>>
+    : StaticQuery<TABLE,
+                  typename SqlConcat<SqlTextOf<SqlKwSelect>,
+                                     typename SqlJoin<SqlTextOf<SqlComma>, SqlTextOf<COLS>...>::type,
+                                     SqlTextOf<SqlKwFrom>,
+                                     SqlTextOf<TABLE>,
+                                     typename SqlWhereClause<Where<CONDS...>>::type>::type,
+                  sizeof...(CONDS)>
+{
+    static_assert(sizeof...(COLS) > 0, "select needs at least one column");
+};
+
+template <typename TABLE, typename SETS, typename WHERE>
+struct StaticUpdate;
+
+template <typename TABLE, typename... SETS, typename... CONDS>
+struct StaticUpdate<TABLE, Columns<SETS...>, Where<CONDS...>>
+    : StaticQuery<TABLE,
+                  typename SqlConcat<SqlTextOf<SqlKwUpdate>,
+                                     SqlTextOf<TABLE>,
+                                     SqlTextOf<SqlKwSet>,
+                                     typename SqlJoin<SqlTextOf<SqlComma>, typename Cond<SETS, SqlEq>::text...>::type,
+                                     typename SqlWhereClause<Where<CONDS...>>::type>::type,
+                  sizeof...(SETS) + sizeof...(CONDS)>
+{
+    static_assert(sizeof...(SETS) > 0, "update needs at least one column");
+};
+
+template <typename TABLE, typename COLS>
+struct StaticInsert;
+
+template <typename TABLE, typename... COLS>
+struct StaticInsert<TABLE, Columns<COLS...>>
+    : StaticQuery<TABLE,
+                  typename SqlConcat<SqlTextOf<SqlKwInsert>,
+                                     SqlTextOf<TABLE>,
+                                     SqlTextOf<SqlLParen>,
+                                     typename SqlJoin<SqlTextOf<SqlComma>, SqlTextOf<COLS>...>::type,
+                                     SqlTextOf<SqlKwValues>,
+                                     typename SqlJoin<SqlTextOf<SqlComma>, typename std::conditional<true, SqlTextOf<SqlPlaceholder>, COLS>::type...>::type,
+                                     SqlTextOf<SqlRParen>>::type,
+                  sizeof...(COLS)>
+{
+    static_assert(sizeof...(COLS) > 0, "insert needs at least one column");
+};
+
+template <typename TABLE, typename WHERE>
+struct StaticDelete;
+
+template <typename TABLE, typename... CONDS>
+struct StaticDelete<TABLE, Where<CONDS...>>
+    : StaticQuery<TABLE,
+                  typename SqlConcat<SqlTextOf<SqlKwDelete>,
+                                     SqlTextOf<TABLE>,
+                                     typename SqlWhereClause<Where<CONDS...>>::type>::type,
+                  sizeof...(CONDS)>
+{
+    static_assert(sizeof...(CONDS) > 0, "delete without where is not allowed"); //不能全部删
+};
+#endif
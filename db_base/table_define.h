@@ -1,164 +1,274 @@
-#ifndef _TYPE_DEF_H_
-#define _TYPE_DEF_H_
-#include <tuple>
-#include <iostream>
-#include <sstream>
-#include <boost/any.hpp>
-#include "json/json.h"
-
-enum
-{
-	RECORD_STAUS_INIT = 0,
-	RECORD_STATUS_START = 1,
-	RECORD_STATUS_START_SUCCESS = 2,
-	RECORD_STATUS_STOP = 3,
-	RECORD_STATUS_STOP_SUCCESS = 4,
-
-	RECORD_STATUS_START_ERROR = -2,
-	RECORD_STATUS_STOP_ERROR = -4,
-	RECORD_STATUS_CONVERT_ERROR = -5,
-};
-
-struct T_TaskRecord
-{ //录制任务记录格式
-	uint32_t id;
-	std::string stream_id;
-	uint64_t uid;
-	uint64_t sid;
-	uint32_t channel_id;
-	std::string audio_stream_name;
-	std::string video_stream_name;
-	uint32_t live_type; //0
-	std::string task_id;
-	int32_t status;			  //0：未开始，1：开始，2：失败，其他：未定义
-	uint32_t start_by_switch; //0：非切换原因，1：切换生成的任务
-	uint32_t stop_by_switch;
-	uint64_t start_timestamp;	//操作时间戳
-	uint64_t stop_timestamp;	 //操作时间戳
-	std::string yy_record_file;  //yy录制生成的MP4文件
-	uint32_t yy_gen_mp4;		 //yy是否生成了Mp4
-	std::string ago_record_path; //声网生成文件路径
-	std::string ago_bs2_file;	//上传到bs2上的文件
-	uint32_t ago_gen_mp4;		 //是否合成完mp4并上传bs2
-	uint32_t ago_gen_time;		 //声网合成完成时间
-	std::string record_server_ip;//录制任务执行的服务器ip，用于判断声网的任务在本机
-
-	T_TaskRecord()
-	{
-	}
-
-	operator std::string() const 
-	{
-		std::ostringstream oss;
-		oss << "id=" << id << "&stream_id=" << stream_id << "&uid=" << uid << "&sid=" << sid 
-			<< "&channel_id=" << channel_id << "&live_type=" << live_type << "&task_id=" << task_id
-			<< "&status=" << status;
-		return oss.str();
-	}
-
-	T_TaskRecord(const std::shared_ptr<sql::ResultSet> &res)
-	{
-		id = res->getUInt("id");
-		stream_id = res->getString("stream_id");
-		uid = res->getUInt64("uid");
-		sid = res->getUInt64("sid");
-		channel_id = res->getUInt("channel_id");
-		audio_stream_name = res->getString("audio_stream_name");
-		video_stream_name = res->getString("video_stream_name");
-		live_type = res->getUInt("live_type");
-		task_id = res->getString("task_id");
-		status = res->getInt("status");
-		start_by_switch = res->getUInt("start_by_switch");
-		stop_by_switch = res->getUInt("stop_by_switch");
-		start_timestamp = res->getUInt64("start_timestamp");
-		stop_timestamp = res->getUInt64("stop_timestamp");
-		yy_record_file = res->getString("yy_record_file");
-		yy_gen_mp4 = res->getUInt("yy_gen_mp4");
-		ago_record_path = res->getString("ago_record_path");
-		ago_bs2_file = res->getString("ago_bs2_file");
-		ago_gen_mp4 = res->getUInt("ago_gen_mp4");
-		ago_gen_time = res->getUInt("ago_gen_time");
-		record_server_ip = res->getString("record_server_ip");
-	}
-
-	T_TaskRecord &operator=(const std::shared_ptr<sql::ResultSet> &res)
-	{
-		id = res->getUInt("id");
-		stream_id = res->getString("stream_id");
-		uid = res->getUInt64("uid");
-		sid = res->getUInt64("sid");
-		channel_id = res->getUInt("channel_id");
-		audio_stream_name = res->getString("audio_stream_name");
-		video_stream_name = res->getString("video_stream_name");
-		live_type = res->getUInt("live_type");
-		task_id = res->getString("task_id");
-		status = res->getInt("status");
-		start_by_switch = res->getUInt("start_by_switch");
-		stop_by_switch = res->getUInt("stop_by_switch");
-		start_timestamp = res->getUInt64("start_timestamp");
-		stop_timestamp = res->getUInt64("stop_timestamp");
-		yy_record_file = res->getString("yy_record_file");
-		yy_gen_mp4 = res->getUInt("yy_gen_mp4");
-		ago_record_path = res->getString("ago_record_path");
-		ago_bs2_file = res->getString("ago_bs2_file");
-		ago_gen_mp4 = res->getUInt("ago_gen_mp4");
-		ago_gen_time = res->getUInt("ago_gen_time");
-		record_server_ip = res->getString("record_server_ip");
-		return *this;
-	}
-};
-
-struct T_CourseRecord
-{ //录制任务记录格式
-	uint32_t id;
-	uint64_t uid;
-	uint64_t sid;
-	int32_t status;
-	uint32_t channel_id;
-	std::string mp4_file;
-	int32_t create_timestamp;
-	int32_t update_timestamp;
-};
-
-struct T_TSRecord
-{
-	int64_t id;
-	uint32_t sort;
-	uint32_t appid;
-	std::string task_id;
-	int64_t video_file_id;
-	std::string video_address;
-	uint32_t file_size;
-	int64_t start_time;
-	uint32_t start_dts;
-	uint32_t duration;
-	uint64_t offset;
-	std::string sps_pps;
-	uint32_t tc;
-	std::string extension;
-	uint32_t status;
-	uint32_t timestamp;
-};
-
-struct T_Bs2Record
-{
-	int64_t file_id;
-	uint32_t appid;
-	std::string task_id;
-	int64_t start_time;
-	int64_t end_time;
-	int64_t file_size;
-	int64_t duration;
-	std::string file_name;
-	uint32_t state;
-	std::string source_ip;
-	std::string ext_info;
-	int64_t upload_id;
-	std::string upload_zone;
-	std::string bucket_name;
-	std::string bs2_key;
-	std::string bs2_secret;
-	int32_t timestamp;
-};
-
-#endif
+#ifndef _TYPE_DEF_H_
+#define _TYPE_DEF_H_
+#include <tuple>
+#include <iostream>
+#include <sstream>
+#include <boost/any.hpp>
+#include "json/json.h"
+#include "row_mapper.h"
+
+enum
+{
+	RECORD_STAUS_INIT = 0,
+	RECORD_STATUS_START = 1,
+	RECORD_STATUS_START_SUCCESS = 2,
+	RECORD_STATUS_STOP = 3,
+	RECORD_STATUS_STOP_SUCCESS = 4,
+
+	RECORD_STATUS_START_ERROR = -2,
+	RECORD_STATUS_STOP_ERROR = -4,
+	RECORD_STATUS_CONVERT_ERROR = -5,
+};
+
+struct T_TaskRecord
+{ //录制任务记录格式
+	uint32_t id = 0;
+	std::string stream_id;
+	uint64_t uid = 0;
+	uint64_t sid = 0;
+	uint32_t channel_id = 0;
+	std::string audio_stream_name;
+	std::string video_stream_name;
+	uint32_t live_type = 0; //0
+	std::string task_id;
+	int32_t status = 0;			  //0：未开始，1：开始，2：失败，其他：未定义
+	uint32_t start_by_switch = 0; //0：非切换原因，1：切换生成的任务
+	uint32_t stop_by_switch = 0;
+	uint64_t start_timestamp = 0;	//操作时间戳
+	uint64_t stop_timestamp = 0;	 //操作时间戳
+	std::string yy_record_file;  //yy录制生成的MP4文件
+	uint32_t yy_gen_mp4 = 0;		 //yy是否生成了Mp4
+	std::string ago_record_path; //声网生成文件路径
+	std::string ago_bs2_file;	//上传到bs2上的文件
+	uint32_t ago_gen_mp4 = 0;		 //是否合成完mp4并上传bs2
+	uint32_t ago_gen_time = 0;		 //声网合成完成时间
+	std::string record_server_ip;//录制任务执行的服务器ip，用于判断声网的任务在本机
+
+	T_TaskRecord()
+	{
+	}
+
+	operator std::string() const 
+	{
+		std::ostringstream oss;
+		oss << "id=" << id << "&stream_id=" << stream_id << "&uid=" << uid << "&sid=" << sid 
+			<< "&channel_id=" << channel_id << "&live_type=" << live_type << "&task_id=" << task_id
+			<< "&status=" << status;
+		return oss.str();
+	}
+
+	T_TaskRecord(const std::shared_ptr<sql::ResultSet> &res);
+	T_TaskRecord &operator=(const std::shared_ptr<sql::ResultSet> &res);
+};
+
+ROW_MAPPING(T_TaskRecord,
+	ROW_FIELD(T_TaskRecord, id),
+	ROW_FIELD(T_TaskRecord, stream_id),
+	ROW_FIELD(T_TaskRecord, uid),
+	ROW_FIELD(T_TaskRecord, sid),
+	ROW_FIELD(T_TaskRecord, channel_id),
+	ROW_FIELD(T_TaskRecord, audio_stream_name),
+	ROW_FIELD(T_TaskRecord, video_stream_name),
+	ROW_FIELD(T_TaskRecord, live_type),
+	ROW_FIELD(T_TaskRecord, task_id),
+	ROW_FIELD(T_TaskRecord, status),
+	ROW_FIELD(T_TaskRecord, start_by_switch),
+	ROW_FIELD(T_TaskRecord, stop_by_switch),
+	ROW_FIELD(T_TaskRecord, start_timestamp),
+	ROW_FIELD(T_TaskRecord, stop_timestamp),
+	ROW_FIELD(T_TaskRecord, yy_record_file),
+	ROW_FIELD(T_TaskRecord, yy_gen_mp4),
+	ROW_FIELD(T_TaskRecord, ago_record_path),
+	ROW_FIELD(T_TaskRecord, ago_bs2_file),
+	ROW_FIELD(T_TaskRecord, ago_gen_mp4),
+	ROW_FIELD(T_TaskRecord, ago_gen_time),
+	ROW_FIELD(T_TaskRecord, record_server_ip));
+
+inline T_TaskRecord::T_TaskRecord(const std::shared_ptr<sql::ResultSet> &res)
+{
+	RowMapper<T_TaskRecord>(*res).decode(*res, *this);
+}
+
+inline T_TaskRecord &T_TaskRecord::operator=(const std::shared_ptr<sql::ResultSet> &res)
+{
+	RowMapper<T_TaskRecord>(*res).decode(*res, *this);
+	return *this;
+}
+
+struct T_TaskRecordView
+{ //T_TaskRecord的只读视图，字符串字段指向Arena，批量读取时不再逐字段分配内存
+	uint32_t id = 0;
+	StrRef stream_id;
+	uint64_t uid = 0;
+	uint64_t sid = 0;
+	uint32_t channel_id = 0;
+	StrRef audio_stream_name;
+	StrRef video_stream_name;
+	uint32_t live_type = 0;
+	StrRef task_id;
+	int32_t status = 0;
+	uint32_t start_by_switch = 0;
+	uint32_t stop_by_switch = 0;
+	uint64_t start_timestamp = 0;
+	uint64_t stop_timestamp = 0;
+	StrRef yy_record_file;
+	uint32_t yy_gen_mp4 = 0;
+	StrRef ago_record_path;
+	StrRef ago_bs2_file;
+	uint32_t ago_gen_mp4 = 0;
+	uint32_t ago_gen_time = 0;
+	StrRef record_server_ip;
+
+	//需要在arena释放后继续使用时，转换成拥有内存的T_TaskRecord
+	T_TaskRecord toRecord() const
+	{
+		T_TaskRecord r;
+		r.id = id;
+		r.stream_id = stream_id.str();
+		r.uid = uid;
+		r.sid = sid;
+		r.channel_id = channel_id;
+		r.audio_stream_name = audio_stream_name.str();
+		r.video_stream_name = video_stream_name.str();
+		r.live_type = live_type;
+		r.task_id = task_id.str();
+		r.status = status;
+		r.start_by_switch = start_by_switch;
+		r.stop_by_switch = stop_by_switch;
+		r.start_timestamp = start_timestamp;
+		r.stop_timestamp = stop_timestamp;
+		r.yy_record_file = yy_record_file.str();
+		r.yy_gen_mp4 = yy_gen_mp4;
+		r.ago_record_path = ago_record_path.str();
+		r.ago_bs2_file = ago_bs2_file.str();
+		r.ago_gen_mp4 = ago_gen_mp4;
+		r.ago_gen_time = ago_gen_time;
+		r.record_server_ip = record_server_ip.str();
+		return r;
+	}
+};
+
+ROW_MAPPING(T_TaskRecordView,
+	ROW_FIELD(T_TaskRecordView, id),
+	ROW_FIELD(T_TaskRecordView, stream_id),
+	ROW_FIELD(T_TaskRecordView, uid),
+	ROW_FIELD(T_TaskRecordView, sid),
+	ROW_FIELD(T_TaskRecordView, channel_id),
+	ROW_FIELD(T_TaskRecordView, audio_stream_name),
+	ROW_FIELD(T_TaskRecordView, video_stream_name),
+	ROW_FIELD(T_TaskRecordView, live_type),
+	ROW_FIELD(T_TaskRecordView, task_id),
+	ROW_FIELD(T_TaskRecordView, status),
+	ROW_FIELD(T_TaskRecordView, start_by_switch),
+	ROW_FIELD(T_TaskRecordView, stop_by_switch),
+	ROW_FIELD(T_TaskRecordView, start_timestamp),
+	ROW_FIELD(T_TaskRecordView, stop_timestamp),
+	ROW_FIELD(T_TaskRecordView, yy_record_file),
+	ROW_FIELD(T_TaskRecordView, yy_gen_mp4),
+	ROW_FIELD(T_TaskRecordView, ago_record_path),
+	ROW_FIELD(T_TaskRecordView, ago_bs2_file),
+	ROW_FIELD(T_TaskRecordView, ago_gen_mp4),
+	ROW_FIELD(T_TaskRecordView, ago_gen_time),
+	ROW_FIELD(T_TaskRecordView, record_server_ip));
+
+struct T_CourseRecord
+{ //录制任务记录格式
+	uint32_t id = 0;
+	uint64_t uid = 0;
+	uint64_t sid = 0;
+	int32_t status = 0;
+	uint32_t channel_id = 0;
+	std::string mp4_file;
+	int32_t create_timestamp = 0;
+	int32_t update_timestamp = 0;
+};
+
+ROW_MAPPING(T_CourseRecord,
+	ROW_FIELD(T_CourseRecord, id),
+	ROW_FIELD(T_CourseRecord, uid),
+	ROW_FIELD(T_CourseRecord, sid),
+	ROW_FIELD(T_CourseRecord, status),
+	ROW_FIELD(T_CourseRecord, channel_id),
+	ROW_FIELD(T_CourseRecord, mp4_file),
+	ROW_FIELD(T_CourseRecord, create_timestamp),
+	ROW_FIELD(T_CourseRecord, update_timestamp));
+
+struct T_TSRecord
+{
+	int64_t id = 0;
+	uint32_t sort = 0;
+	uint32_t appid = 0;
+	std::string task_id;
+	int64_t video_file_id = 0;
+	std::string video_address;
+	uint32_t file_size = 0;
+	int64_t start_time = 0;
+	uint32_t start_dts = 0;
+	uint32_t duration = 0;
+	uint64_t offset = 0;
+	std::string sps_pps;
+	uint32_t tc = 0;
+	std::string extension;
+	uint32_t status = 0;
+	uint32_t timestamp = 0;
+};
+
+ROW_MAPPING(T_TSRecord,
+	ROW_FIELD(T_TSRecord, id),
+	ROW_FIELD(T_TSRecord, sort),
+	ROW_FIELD(T_TSRecord, appid),
+	ROW_FIELD(T_TSRecord, task_id),
+	ROW_FIELD(T_TSRecord, video_file_id),
+	ROW_FIELD(T_TSRecord, video_address),
+	ROW_FIELD(T_TSRecord, file_size),
+	ROW_FIELD(T_TSRecord, start_time),
+	ROW_FIELD(T_TSRecord, start_dts),
+	ROW_FIELD(T_TSRecord, duration),
+	ROW_FIELD(T_TSRecord, offset),
+	ROW_FIELD(T_TSRecord, sps_pps),
+	ROW_FIELD(T_TSRecord, tc),
+	ROW_FIELD(T_TSRecord, extension),
+	ROW_FIELD(T_TSRecord, status),
+	ROW_FIELD(T_TSRecord, timestamp));
+
+struct T_Bs2Record
+{
+	int64_t file_id = 0;
+	uint32_t appid = 0;
+	std::string task_id;
+	int64_t start_time = 0;
+	int64_t end_time = 0;
+	int64_t file_size = 0;
+	int64_t duration = 0;
+	std::string file_name;
+	uint32_t state = 0;
+	std::string source_ip;
+	std::string ext_info;
+	int64_t upload_id = 0;
+	std::string upload_zone;
+	std::string bucket_name;
+	std::string bs2_key;
+	std::string bs2_secret;
+	int32_t timestamp = 0;
+};
+
+ROW_MAPPING(T_Bs2Record,
+	ROW_FIELD(T_Bs2Record, file_id),
+	ROW_FIELD(T_Bs2Record, appid),
+	ROW_FIELD(T_Bs2Record, task_id),
+	ROW_FIELD(T_Bs2Record, start_time),
+	ROW_FIELD(T_Bs2Record, end_time),
+	ROW_FIELD(T_Bs2Record, file_size),
+	ROW_FIELD(T_Bs2Record, duration),
+	ROW_FIELD(T_Bs2Record, file_name),
+	ROW_FIELD(T_Bs2Record, state),
+	ROW_FIELD(T_Bs2Record, source_ip),
+	ROW_FIELD(T_Bs2Record, ext_info),
+	ROW_FIELD(T_Bs2Record, upload_id),
+	ROW_FIELD(T_Bs2Record, upload_zone),
+	ROW_FIELD(T_Bs2Record, bucket_name),
+	ROW_FIELD(T_Bs2Record, bs2_key),
+	ROW_FIELD(T_Bs2Record, bs2_secret),
+	ROW_FIELD(T_Bs2Record, timestamp));
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef TABLE_SCANNER_H_
+#define TABLE_SCANNER_H_
+#include <memory>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "db_table.h"
+#include "row_mapper.h"
+
+/*
+* 按主键分块扫描整张表：WHERE key > last ORDER BY key LIMIT n，
+* 每次查询的代价只和块大小有关，和扫描到哪里无关；可以从检查点继续。用法:
+*   KeysetScanner<T_TSRecord> scanner("T_TSRecord", "id", 1000);
+*   scanner.resume(saved_checkpoint);
+*   std::vector<T_TSRecord> rows;
+*   while (scanner.next(conn, rows) > 0) { 处理rows; 保存scanner.checkpoint(); }
+*/
+template <typename T>
+class KeysetScanner
+{
+  public:
+    /*
+    * @param[in] table 表名
+    * @param[in] key_field 整数主键字段，必须有索引
+    * @param[in] chunk_rows 每块的行数
+    */
+    KeysetScanner(const std::string &table, const std::string &key_field, size_t chunk_rows = 1000)
+    {
+        table_name_ = table;
+        key_field_ = key_field;
+        chunk_rows_ = chunk_rows > 0 ? chunk_rows : 1;
+    }
+
+    //只扫描 (after_key, max_key] 范围内的行
+    KeysetScanner &range(int64_t after_key, int64_t max_key)
+    {
+        last_key_ = after_key;
+        max_key_ = max_key;
+        done_ = false;
+        return *this;
+    }
+
+    //额外的过滤条件，直接写表达式，例如"status=1"
+    KeysetScanner &where(const std::string &expr)
+    {
+        wheres_.emplace_back(expr);
+        return *this;
+    }
+
+    //查询的字段，默认"*"，必须包含主键字段
+    template <typename... FIELDS>
+    KeysetScanner &fields(FIELDS... f)
+    {
+        fields_ = {f...};
+        return *this;
+    }
+
+    /*
+    * @fun:读取下一块
+    * @param[in] conn 连接
+    * @param[out] rows 本块的行，会先清空
+    * @return 本块行数，0：扫描完成；-1：查询出错，检查点不变，可以重试
+    */
+    int next(const std::shared_ptr<sql::Connection> &conn, std::vector<T> &rows)
+    {
+        rows.clear();
+        if (done_)
+        {
+            return 0;
+        }
+
+        Table table(table_name_);
+        table.setConn(conn);
+        std::shared_ptr<sql::ResultSet> res = buildQuery(table).executeQuery();
+        if (!res)
+        {
+            return -1;
+        }
+
+        try
+        {
+            RowMapper<T> mapper(*res);
+            uint32_t key_idx = res->findColumn(key_field_);
+            if (key_idx == 0)
+            {
+                return -1;
+            }
+
+            int64_t last_key = last_key_;
+            while (res->next())
+            {
+                rows.emplace_back();
+                mapper.decode(*res, rows.back());
+                last_key = res->getInt64(key_idx);
+            }
+            last_key_ = last_key;
+        }
+        catch (sql::SQLException &)
+        {
+            rows.clear();
+            return -1;
+        }
+
+        if (rows.size() < chunk_rows_ || last_key_ >= max_key_)
+        {
+            done_ = true;
+        }
+        return rows.size();
+    }
+
+    //已经读到的最大主键，保存后用resume继续
+    int64_t checkpoint() const
+    {
+        return last_key_;
+    }
+
+    void resume(int64_t last_key)
+    {
+        last_key_ = last_key;
+        done_ = false;
+    }
+
+    bool done() const
+    {
+        return done_;
+    }
+
+  private:
+    Table &buildQuery(Table &table) const
+    {
+        if (fields_.empty())
+        {
+            table.select("*");
+        }
+        else
+        {
+            table.select(fields_);
+        }
+        if (last_key_ > std::numeric_limits<int64_t>::min())
+        {
+            table.where(key_field_, ">", last_key_);
+        }
+        if (max_key_ < std::numeric_limits<int64_t>::max())
+        {
+            table.where(key_field_, "<=", max_key_);
+        }
+        for (const auto &w : wheres_)
+        {
+            table.whereOrg(w);
+        }
+        return table.orderBy(key_field_).limit(chunk_rows_);
+    }
+
+    std::string table_name_;
+    std::string key_field_;
+    size_t chunk_rows_;
+    std::vector<std::string> fields_;
+    std::vector<std::string> wheres_;
+    int64_t last_key_ = std::numeric_limits<int64_t>::min();
+    int64_t max_key_ = std::numeric_limits<int64_t>::max();
+    bool done_ = false;
+};
+#endif
@@ -0,0 +1,348 @@
+#ifndef TRANSACTION_H_
+#define TRANSACTION_H_
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <vector>
+#include <condition_variable>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "conn_provider.h"
+#include "sql_exec.h"
+#include "query_cache.h"
+
+/*
+* 事务守卫，构造时开始事务，析构时如果没有提交则回滚，结束后恢复自动提交。
+* 事务期间本线程写过的表在提交或回滚后再让查询缓存失效一次，见TableVersions::Deferred
+*/
+class Transaction
+{
+  public:
+    explicit Transaction(const std::shared_ptr<sql::Connection> &conn)
+    {
+        conn_ = conn;
+        if (!conn_)
+        {
+            return;
+        }
+
+        try
+        {
+            conn_->setAutoCommit(false);
+            active_ = true;
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode();
+        }
+    }
+
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+
+    virtual ~Transaction()
+    {
+        rollback();
+    }
+
+    bool active() const
+    {
+        return active_;
+    }
+
+    int errorCode() const
+    {
+        return error_code_;
+    }
+
+    /*
+    * @fun:提交事务
+    * @return 0：成功；-1：事务未开始或已结束；-2：提交失败，事务已回滚
+    */
+    int commit()
+    {
+        if (!active_)
+        {
+            return -1;
+        }
+
+        int ret = 0;
+        try
+        {
+            conn_->commit();
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode();
+            ret = -2;
+            rollbackQuietly();
+        }
+        finish();
+        return ret;
+    }
+
+    /*
+    * @fun:回滚事务
+    * @return 0：成功；-1：事务未开始或已结束
+    */
+    int rollback()
+    {
+        if (!active_)
+        {
+            return -1;
+        }
+        rollbackQuietly();
+        finish();
+        return 0;
+    }
+
+  private:
+    void rollbackQuietly()
+    {
+        try
+        {
+            conn_->rollback();
+        }
+        catch (sql::SQLException &e)
+        {
+            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
+            {
+                ConnectionIds::forget(conn_.get());
+                conn_->reconnect();
+            }
+        }
+    }
+
+    void finish()
+    {
+        active_ = false;
+        try
+        {
+            conn_->setAutoCommit(true);
+        }
+        catch (sql::SQLException &e)
+        {
+            error_code_ = e.getErrorCode();
+        }
+        deferred_.finish();
+    }
+
+    std::shared_ptr<sql::Connection> conn_;
+    TableVersions::Deferred deferred_;
+    bool active_ = false;
+    int error_code_ = 0;
+};
+
+/*
+* 组提交：把多个线程提交的小的独立写操作，每隔几毫秒合并到一个事务里提交，减少服务端刷redo log的次数。
+* 同一批中某条语句出错只影响它自己；提交失败时整批都返回失败。
+* 死锁(1213)和锁等待超时(1205)时服务端已经回滚了整个事务或者其中的语句，剩下的部分不能再提交，整批回滚并返回失败。
+*/
+class GroupCommitter
+{
+  public:
+    /*
+    * @param[in] provider 连接提供者
+    * @param[in] window_ms 合并的时间窗口
+    * @param[in] max_batch 每批最多合并的语句数，达到后立即提交
+    */
+    GroupCommitter(const CONN_PROVIDER &provider, uint32_t window_ms = 5, size_t max_batch = 200)
+    {
+        provider_ = provider;
+        window_ms_ = window_ms;
+        max_batch_ = max_batch > 0 ? max_batch : 1;
+        exit_atm_ = false;
+        running_atm_ = false;
+    }
+
+    GroupCommitter(const GroupCommitter &) = delete;
+    GroupCommitter &operator=(const GroupCommitter &) = delete;
+
+    virtual ~GroupCommitter()
+    {
+        stop();
+    }
+
+    int start()
+    {
+        if (commit_thread_)
+        {
+            return -1;
+        }
+        exit_atm_ = false;
+        commit_thread_ = std::make_shared<std::thread>(std::bind(&GroupCommitter::commitThread, this));
+        {
+            std::lock_guard<std::mutex> lck(pending_mutex_);
+            running_atm_ = true;
+        }
+        return 0;
+    }
+
+    //停止前会把已经提交的语句全部执行完
+    void stop()
+    {
+        if (!commit_thread_)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(pending_mutex_);
+            running_atm_ = false; //之后submit直接返回-1，不会再有语句进入队列
+            exit_atm_ = true;
+        }
+        pending_cv_.notify_one();
+        commit_thread_->join();
+        commit_thread_.reset();
+    }
+
+    /*
+    * @fun:提交一条写语句
+    * @param[in] sql UPDATE/INSERT/DELETE语句，可以来自Table::get_sql()或CompiledQuery::render()
+    * @return future的值：影响行数；-1：语句执行出错或已停止；-2：取不到连接；-3：主键冲突；
+    *         -4：事务提交失败，或者同一批中有语句遇到死锁、锁等待超时，整批已回滚
+    */
+    std::future<int> submit(const std::string &sql)
+    {
+        Pending p;
+        p.sql = sql;
+        std::future<int> f = p.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lck(pending_mutex_);
+            if (!running_atm_)
+            {
+                p.promise.set_value(-1);
+                return f;
+            }
+            pending_.emplace_back(std::move(p));
+            if (pending_.size() < max_batch_)
+            {
+                return f;
+            }
+        }
+        pending_cv_.notify_one();
+        return f;
+    }
+
+  private:
+    struct Pending
+    {
+        std::string sql;
+        std::promise<int> promise;
+    };
+
+    void commitThread()
+    {
+        while (1)
+        {
+            std::list<Pending> batch;
+            {
+                std::unique_lock<std::mutex> lck(pending_mutex_);
+                pending_cv_.wait_for(lck, std::chrono::milliseconds(window_ms_), [this]() {
+                    return exit_atm_ || pending_.size() >= max_batch_;
+                });
+                batch.swap(pending_);
+            }
+
+            if (!batch.empty())
+            {
+                commitBatch(batch);
+            }
+            else if (exit_atm_)
+            {
+                break;
+            }
+        }
+    }
+
+    void commitBatch(std::list<Pending> &batch)
+    {
+        std::shared_ptr<sql::Connection> conn = provider_();
+        if (!conn)
+        {
+            for (auto &p : batch)
+            {
+                p.promise.set_value(-2);
+            }
+            return;
+        }
+
+        Transaction txn(conn);
+        if (!txn.active())
+        {
+            for (auto &p : batch)
+            {
+                p.promise.set_value(-4);
+            }
+            return;
+        }
+
+        std::vector<int> rets;
+        rets.reserve(batch.size());
+        bool lost = false;
+        for (auto &p : batch)
+        { //每条语句单独跟踪和统计，事务中不重试
+            std::string table;
+            TableVersions::writeTarget(p.sql, table);
+            int ret = -1;
+            int err = runTrackedSql(conn, traceSqlOp(p.sql), table, p.sql, RetryPolicy::none(), [&](const std::shared_ptr<sql::Connection> &conn) -> int64_t {
+                std::shared_ptr<sql::Statement> stmt;
+                stmt.reset(conn->createStatement());
+                ret = IoScope::roundTrip(p.sql.size(), [&]() { return stmt->executeUpdate(p.sql); });
+                return ret;
+            });
+            if (err == 0)
+            {
+                TableVersions::bumpSql(p.sql); //事务结束后还会再bump一次
+            }
+            else if (isConnectionError(err))
+            { //已经重连，事务丢失
+                lost = true;
+                break;
+            }
+            else if (err == 1213 || err == 1205 || err == -4)
+            { //死锁或锁等待超时，之前执行成功的语句也要回滚
+                lost = true;
+                txn.rollback();
+                break;
+            }
+            else
+            {
+                ret = err == 1062 ? -3 : -1; //duplicate key
+            }
+            rets.push_back(ret);
+        }
+
+        if (lost || txn.commit() != 0)
+        {
+            for (auto &p : batch)
+            {
+                p.promise.set_value(-4);
+            }
+            return;
+        }
+
+        size_t i = 0;
+        for (auto &p : batch)
+        {
+            p.promise.set_value(rets[i++]);
+        }
+    }
+
+    CONN_PROVIDER provider_;
+    uint32_t window_ms_ = 5;
+    size_t max_batch_ = 200;
+
+    std::shared_ptr<std::thread> commit_thread_;
+    std::mutex pending_mutex_;
+    std::condition_variable pending_cv_;
+    std::list<Pending> pending_;
+    std::atomic<bool> exit_atm_;
+    std::atomic<bool> running_atm_; //start和stop在pending_mutex_下修改，submit只看它，不访问commit_thread_
+};
+#endif
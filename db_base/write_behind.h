@@ -0,0 +1,428 @@
+#ifndef WRITE_BEHIND_H_
+#define WRITE_BEHIND_H_
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+#include "mysql/mysql_driver.h"
+#include "mysql/cppconn/prepared_statement.h"
+#include "boost/algorithm/string/join.hpp"
+#include "conn_provider.h"
+#include "sql_param.h"
+#include "transaction.h"
+
+/*
+* 写后缓冲：按 表+主键 合并同一行的多次更新，只保留每个字段最后的值，
+* 定时或者积累到一定行数后在一个事务里批量刷到数据库。队列有上限，满了以后调用者等待刷新；
+* stop()/析构时把缓冲的更新全部刷完，数据库一直不可用时放弃剩下的行，由stop()返回行数。
+* 语句本身出错(字段不存在、数据过长等)的行重试也不会成功，直接丢掉并计数(见failedRows)。
+* 丢掉的行都以UPDATE语句的形式交给onDrop()设置的回调，方便记日志或手工补写。用法:
+*   WriteBehindQueue wb(provider);
+*   wb.start();
+*   wb.update("T_TaskRecord", "task_id", task_id).set("status", 3).set("stop_timestamp", ts).commit();
+*/
+class WriteBehindQueue
+{
+  public:
+    //丢掉一行时的回调，参数为这一行的UPDATE语句和错误码：>0：mysql错误码；-1：退出时仍然刷不出去
+    using DROP_CB = std::function<void(const std::string &, int)>;
+
+    class RowUpdate
+    {
+      public:
+        RowUpdate(WriteBehindQueue *queue, const std::string &table, const std::string &key_field, const std::string &key_literal)
+        {
+            queue_ = queue;
+            table_name_ = table;
+            key_field_ = key_field;
+            key_literal_ = key_literal;
+        }
+
+        template <typename T>
+        RowUpdate &set(const std::string &field, T &&v)
+        {
+            fields_values_[field] = sqlLiteral(std::forward<T>(v));
+            return *this;
+        }
+
+        /*
+        * @fun:放入缓冲队列
+        * @return 0：成功；-1：队列已停止；-2：没有要更新的字段
+        */
+        int commit()
+        {
+            if (fields_values_.empty())
+            {
+                return -2;
+            }
+            return queue_->put(table_name_, key_field_, key_literal_, std::move(fields_values_));
+        }
+
+      private:
+        WriteBehindQueue *queue_;
+        std::string table_name_;
+        std::string key_field_;
+        std::string key_literal_;
+        std::map<std::string, std::string> fields_values_;
+    };
+
+    /*
+    * @param[in] provider 连接提供者
+    * @param[in] flush_interval_ms 定时刷新的间隔
+    * @param[in] flush_rows 积累到多少行立即刷新
+    * @param[in] max_rows 缓冲的最大行数，包括正在写的一批，超过时调用者等待
+    */
+    WriteBehindQueue(const CONN_PROVIDER &provider, uint32_t flush_interval_ms = 1000, size_t flush_rows = 500, size_t max_rows = 10000)
+    {
+        provider_ = provider;
+        flush_interval_ms_ = flush_interval_ms;
+        flush_rows_ = flush_rows > 0 ? flush_rows : 1;
+        max_rows_ = max_rows > flush_rows_ ? max_rows : flush_rows_;
+        exit_atm_ = false;
+    }
+
+    WriteBehindQueue(const WriteBehindQueue &) = delete;
+    WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+    virtual ~WriteBehindQueue()
+    {
+        stop();
+    }
+
+    //设置丢掉行时的回调，在start之前调用。回调不持有内部的锁，但不能阻塞太久，刷新线程会等它返回
+    void onDrop(const DROP_CB &cb)
+    {
+        drop_cb_ = cb;
+    }
+
+    int start()
+    {
+        if (flush_thread_)
+        {
+            return -1;
+        }
+        exit_atm_ = false;
+        dropped_rows_ = 0;
+        flush_thread_ = std::make_shared<std::thread>(std::bind(&WriteBehindQueue::flushThread, this));
+        return 0;
+    }
+
+    /*
+    * @fun:停止并把缓冲的更新全部刷完
+    * @return 连续刷新失败后放弃的行数，0表示全部刷完；放弃的行已经交给onDrop的回调
+    */
+    size_t stop()
+    {
+        if (!flush_thread_)
+        {
+            return 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(rows_mutex_);
+            exit_atm_ = true;
+        }
+        flush_cv_.notify_one();
+        space_cv_.notify_all();
+        flush_thread_->join();
+        flush_thread_.reset();
+        return dropped_rows_;
+    }
+
+    template <typename T>
+    RowUpdate update(const std::string &table, const std::string &key_field, T &&key)
+    {
+        return RowUpdate(this, table, key_field, sqlLiteral(std::forward<T>(key)));
+    }
+
+    size_t pendingRows()
+    {
+        std::lock_guard<std::mutex> lck(rows_mutex_);
+        return rows_.size();
+    }
+
+    //语句本身出错而丢掉的行数(累计)
+    uint64_t failedRows() const
+    {
+        return failed_rows_atm_.load();
+    }
+
+    /*
+    * @fun:立即刷新一批。和后台线程的刷新互斥，否则两批并发写同一行时，先取出的旧值可能后提交，
+    *      或者失败放回缓冲时落在新一批之后
+    * @return 刷到数据库的行数，不包括语句出错丢掉的行；-1：取不到连接或事务失败，更新已放回缓冲
+    */
+    int flush()
+    {
+        int ret = 0;
+        std::vector<std::pair<std::string, int>> failed;
+        {
+            std::lock_guard<std::mutex> flush_lck(flush_mutex_);
+            std::map<std::string, PendingRow> batch;
+            {
+                std::lock_guard<std::mutex> lck(rows_mutex_);
+                batch.swap(rows_);
+                inflight_rows_ = batch.size();
+            }
+
+            if (batch.empty())
+            {
+                return 0;
+            }
+
+            ret = writeBatch(batch, failed);
+            if (ret < 0)
+            { //出错的行也一起放回，下一批再试
+                restore(batch);
+                failed.clear();
+            }
+            failed_rows_atm_ += failed.size();
+            {
+                std::lock_guard<std::mutex> lck(rows_mutex_);
+                inflight_rows_ = 0;
+            }
+            space_cv_.notify_all();
+        }
+        reportDropped(failed);
+        return ret;
+    }
+
+  private:
+    struct PendingRow
+    {
+        std::string table_name;
+        std::string key_field;
+        std::string key_literal;
+        std::map<std::string, std::string> fields_values;
+    };
+
+    int put(const std::string &table, const std::string &key_field, const std::string &key_literal,
+            std::map<std::string, std::string> &&fields_values)
+    {
+        std::string key = table + '\1' + key_field + '\1' + key_literal;
+        bool need_flush = false;
+        {
+            std::unique_lock<std::mutex> lck(rows_mutex_);
+            if (exit_atm_)
+            {
+                return -1;
+            }
+            auto it = rows_.find(key);
+            if (it == rows_.end())
+            { //新的行才占用空间，已有的行直接合并。正在写的一批也算在内，失败放回后不会超过max_rows_
+                space_cv_.wait(lck, [this]() {
+                    return exit_atm_ || rows_.size() + inflight_rows_ < max_rows_;
+                });
+                if (exit_atm_)
+                {
+                    return -1;
+                }
+                PendingRow &row = rows_[key];
+                row.table_name = table;
+                row.key_field = key_field;
+                row.key_literal = key_literal;
+                row.fields_values = std::move(fields_values);
+            }
+            else
+            {
+                for (auto &fv : fields_values)
+                {
+                    it->second.fields_values[fv.first] = std::move(fv.second);
+                }
+            }
+            need_flush = rows_.size() >= flush_rows_;
+        }
+
+        if (need_flush)
+        {
+            flush_cv_.notify_one();
+        }
+        return 0;
+    }
+
+    //刷新失败时放回缓冲，缓冲里已有的是更新的值，不能被覆盖
+    void restore(std::map<std::string, PendingRow> &batch)
+    {
+        std::lock_guard<std::mutex> lck(rows_mutex_);
+        for (auto &r : batch)
+        {
+            auto it = rows_.find(r.first);
+            if (it == rows_.end())
+            {
+                rows_.emplace(r.first, std::move(r.second));
+            }
+            else
+            {
+                for (auto &fv : r.second.fields_values)
+                {
+                    it->second.fields_values.insert(fv); //已有的字段不覆盖
+                }
+            }
+        }
+    }
+
+    static std::string updateSql(const PendingRow &row)
+    {
+        std::vector<std::string> field_values_vec;
+        for (const auto &fv : row.fields_values)
+        {
+            field_values_vec.emplace_back(fv.first + "=" + fv.second);
+        }
+        return "UPDATE " + row.table_name + " SET " + boost::join(field_values_vec, ",") + " WHERE " + row.key_field + "=" +
+               row.key_literal;
+    }
+
+    //退出时仍然刷不出去的行，交给回调方便手工补写
+    void dropPending()
+    {
+        std::map<std::string, PendingRow> rows;
+        {
+            std::lock_guard<std::mutex> flush_lck(flush_mutex_);
+            std::lock_guard<std::mutex> lck(rows_mutex_);
+            rows.swap(rows_);
+        }
+        dropped_rows_ = rows.size();
+        std::vector<std::pair<std::string, int>> dropped;
+        for (const auto &r : rows)
+        {
+            dropped.emplace_back(updateSql(r.second), -1);
+        }
+        reportDropped(dropped);
+    }
+
+    void reportDropped(const std::vector<std::pair<std::string, int>> &rows)
+    {
+        if (!drop_cb_)
+        {
+            return;
+        }
+        for (const auto &r : rows)
+        {
+            drop_cb_(r.first, r.second);
+        }
+    }
+
+    /*
+    * @fun:在一个事务里写一批
+    * @param[out] failed 语句本身出错丢掉的行：UPDATE语句和mysql错误码
+    * @return 写成功的行数；-1：取不到连接或事务失败
+    */
+    int writeBatch(const std::map<std::string, PendingRow> &batch, std::vector<std::pair<std::string, int>> &failed)
+    {
+        std::shared_ptr<sql::Connection> conn = provider_();
+        if (!conn)
+        {
+            return -1;
+        }
+
+        Transaction txn(conn);
+        if (!txn.active())
+        {
+            return -1;
+        }
+
+        int count = 0;
+        try
+        {
+            std::shared_ptr<sql::Statement> stmt;
+            stmt.reset(conn->createStatement());
+            for (const auto &r : batch)
+            {
+                std::string sql = updateSql(r.second);
+                try
+                {
+                    stmt->executeUpdate(sql);
+                    TableVersions::bump(r.second.table_name); //事务结束后还会再bump一次
+                    count++;
+                }
+                catch (sql::SQLException &e)
+                { //语句本身的错误重试也不会成功，丢掉这一行，不影响同批的其他行
+                    if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013 || e.getErrorCode() == 1213 ||
+                        e.getErrorCode() == 1205)
+                    {
+                        throw;
+                    }
+                    failed.emplace_back(std::move(sql), e.getErrorCode() > 0 ? e.getErrorCode() : -1);
+                }
+            }
+        }
+        catch (sql::SQLException &e)
+        {
+            if (e.getErrorCode() == 2006 || e.getErrorCode() == 2013)
+            {
+                ConnectionIds::forget(conn.get());
+                conn->reconnect();
+            }
+            else
+            { //死锁或锁等待超时，服务端已经回滚了部分语句，整批回滚后放回缓冲重试
+                txn.rollback();
+            }
+            return -1;
+        }
+
+        if (txn.commit() != 0)
+        {
+            return -1;
+        }
+        return count;
+    }
+
+    void flushThread()
+    {
+        while (1)
+        {
+            {
+                std::unique_lock<std::mutex> lck(rows_mutex_);
+                flush_cv_.wait_for(lck, std::chrono::milliseconds(flush_interval_ms_), [this]() {
+                    return exit_atm_ || rows_.size() >= flush_rows_;
+                });
+            }
+
+            int ret = flush();
+            if (exit_atm_)
+            { //退出前刷完，连续失败就放弃，避免卡住退出
+                int retry = 3;
+                while (pendingRows() > 0 && retry > 0)
+                {
+                    if (flush() < 0)
+                    {
+                        retry--;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                }
+                dropPending();
+                break;
+            }
+
+            if (ret < 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(flush_interval_ms_));
+            }
+        }
+    }
+
+    CONN_PROVIDER provider_;
+    uint32_t flush_interval_ms_ = 1000;
+    size_t flush_rows_ = 500;
+    size_t max_rows_ = 10000;
+
+    std::shared_ptr<std::thread> flush_thread_;
+    std::mutex flush_mutex_; //保证同一时间只有一批在写，锁顺序 flush_mutex_ -> rows_mutex_
+    std::mutex rows_mutex_;
+    std::condition_variable flush_cv_;
+    std::condition_variable space_cv_;
+    std::map<std::string, PendingRow> rows_;
+    size_t inflight_rows_ = 0; //正在写的一批的行数，受rows_mutex_保护
+    std::atomic<bool> exit_atm_;
+    size_t dropped_rows_ = 0;
+    std::atomic<uint64_t> failed_rows_atm_{0};
+    DROP_CB drop_cb_;
+};
+#endif
@@ -11,9 +11,12 @@
 #include <thread>
 #include <memory>
 #include "singleton.h"
+#include "metrics_exporter.h"
 
 using namespace sox;
 #define HTTP_PORT 8082
+#define METRICS_PORT 9105
+#define QUERY_TRACE_ENV "YY_RECORD_QUERY_TRACE" //设为1时开启查询跟踪，导出按表的延迟直方图
 #define LOG_FILE "yy_record_daemon.log"
 
 void sigchild_handler(int signo) {
@@ -26,7 +29,22 @@ void sigchild_handler(int signo) {
 
 int main(char argc, char *argv[]) {
 	
-	SingleTon<MySqlConnPool<CourseRecordDB>>::getInstance()->init(10, 50);
+	auto pool = SingleTon<MySqlConnPool<CourseRecordDB>>::getInstance();
+	pool->init(10, 50);
+
+	const char *trace_env = getenv(QUERY_TRACE_ENV);
+	bool trace_on = trace_env && strcmp(trace_env, "1") == 0;
+	QueryTracer::instance().enable(trace_on);
+	MetricsExporter exporter(METRICS_PORT);
+	exporter.addCollector(poolMetrics(pool, "course_record"));
+	if(trace_on) {
+		exporter.addCollector(queryMetrics);
+	}
+	exporter.addCollector(watchdogMetrics);
+	int ret = exporter.start();
+	if(ret != 0) {
+		std::cout << "metrics exporter start failed, port:" << METRICS_PORT << " ret:" << ret << std::endl;
+	}
 	while(1) {
 		sleep(10);
 	}
@@ -0,0 +1,190 @@
+/*
+* 比较CppConnDriver(Connector/C++)和NativeDriver(libmysqlclient二进制协议)的单次调用开销。
+* 每个线程一个连接，预处理一次语句，之后循环 bind -> execute -> 逐行解码成T_TaskRecord，
+* 分别统计execute(含网络往返)和解码的耗时，输出吞吐和延迟分位数。
+*
+* 编译: g++ -std=c++14 -O2 -pthread -I. -Idb_base tools/driver_bench.cpp -lmysqlcppconn -lmysqlclient -o driver_bench
+* 运行: ./driver_bench -h 127.0.0.1 -P 3307 -u root -p pwd -D record -t 4 -n 20000 -b all
+*   -h/-P/-u/-p/-D 数据库地址、端口、用户、密码、库名，可以指向tools/fake_mysql_server
+*   -q 语句，其中的第一个?绑定为循环序号，默认按id查询t_task_record
+*   -t 线程数(连接数)  -n 每个线程执行的次数  -b cppconn|native|all
+*/
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <functional>
+#include <unistd.h>
+#include "db_driver.h"
+#include "native_driver.h"
+#include "query_trace.h"
+#include "table_define.h"
+
+namespace
+{
+struct BenchOptions
+{
+    DriverOptions db;
+    std::string sql = "SELECT * FROM t_task_record WHERE id=?";
+    size_t threads = 4;
+    size_t iterations = 10000;
+    std::string backend = "all";
+};
+
+BenchOptions g_options;
+
+struct BenchStats
+{
+    LatencyHistogram execute; //bind + execute，包含网络往返和服务端执行
+    LatencyHistogram decode;  //逐行读取并解码成T_TaskRecord
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+uint64_t elapsedUs(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+template <typename DRIVER>
+void benchThread(BenchStats &stats)
+{
+    DRIVER driver;
+    if (driver.connect(g_options.db) != 0)
+    {
+        std::cerr << "connect failed, code=" << driver.errorCode() << ":" << driver.errorMsg() << std::endl;
+        stats.errors += g_options.iterations;
+        return;
+    }
+    auto stmt = driver.prepare(g_options.sql);
+    if (!stmt)
+    {
+        std::cerr << "prepare failed, code=" << driver.errorCode() << ":" << driver.errorMsg() << std::endl;
+        stats.errors += g_options.iterations;
+        return;
+    }
+
+    bool has_param = g_options.sql.find('?') != std::string::npos;
+    T_TaskRecord record;
+    for (size_t i = 0; i < g_options.iterations; i++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        if (has_param)
+        {
+            stmt->bind(1, static_cast<uint64_t>(i + 1));
+        }
+        if (stmt->execute() != 0)
+        {
+            stats.errors++;
+            continue;
+        }
+        auto executed = std::chrono::steady_clock::now();
+        stats.execute.record(std::chrono::duration_cast<std::chrono::microseconds>(executed - begin).count());
+
+        RowMapper<T_TaskRecord, typename DRIVER::STATEMENT> mapper(*stmt);
+        uint64_t rows = 0;
+        while (stmt->next())
+        {
+            mapper.decode(*stmt, record);
+            rows++;
+        }
+        stats.decode.record(elapsedUs(executed));
+        stats.rows += rows;
+    }
+}
+
+template <typename DRIVER>
+void runBench(const char *name)
+{
+    BenchStats stats;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < g_options.threads; i++)
+    {
+        threads.emplace_back(benchThread<DRIVER>, std::ref(stats));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed_s = elapsedUs(begin) / 1e6;
+    uint64_t total = stats.execute.count();
+
+    printf("[%s]\n", name);
+    printf("  elapsed:    %.3fs\n", elapsed_s);
+    printf("  throughput: %.1f qps, %.1f rows/s\n", elapsed_s > 0 ? total / elapsed_s : 0.0,
+           elapsed_s > 0 ? stats.rows.load() / elapsed_s : 0.0);
+    printf("  errors:     %llu\n", static_cast<unsigned long long>(stats.errors.load()));
+    std::cout << "  execute:    " << latencySummary(stats.execute) << std::endl;
+    std::cout << "  decode:     " << latencySummary(stats.decode) << std::endl;
+}
+
+void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " [-h host] [-P port] [-u user] [-p password] [-D schema] [-q sql]"
+              << " [-t threads] [-n iterations] [-b cppconn|native|all]" << std::endl;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "h:P:u:p:D:q:t:n:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h':
+            g_options.db.host = optarg;
+            break;
+        case 'P':
+            g_options.db.port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 'u':
+            g_options.db.user = optarg;
+            break;
+        case 'p':
+            g_options.db.password = optarg;
+            break;
+        case 'D':
+            g_options.db.schema = optarg;
+            break;
+        case 'q':
+            g_options.sql = optarg;
+            break;
+        case 't':
+            g_options.threads = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'n':
+            g_options.iterations = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'b':
+            g_options.backend = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (g_options.threads == 0 || g_options.iterations == 0 ||
+        (g_options.backend != "cppconn" && g_options.backend != "native" && g_options.backend != "all"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::cout << g_options.threads << " threads x " << g_options.iterations << " iterations: " << g_options.sql << std::endl;
+    if (g_options.backend != "native")
+    {
+        runBench<CppConnDriver>("cppconn");
+    }
+    if (g_options.backend != "cppconn")
+    {
+        runBench<NativeDriver>("native");
+    }
+    return 0;
+}
@@ -0,0 +1,1580 @@
+/*
+* 压测和故障演练用的假MySQL服务：实现握手(mysql_native_password，不校验密码)、COM_QUERY(支持多语句)、
+* COM_STMT_PREPARE/EXECUTE/CLOSE/RESET、COM_PING、COM_INIT_DB、COM_QUIT，按脚本返回结果，
+* 可以配置延迟、断连和错误。每个连接一个线程。
+*
+* 编译: g++ -std=c++14 -O2 -pthread tools/fake_mysql_server.cpp -o fake_mysql_server
+* 运行: ./fake_mysql_server -p 3307 -d 2 -j 3 -r rules.txt -e 1062:0.01,2013:0.001 -i 30000
+*   -p 端口，默认3307
+*   -d 每条语句的固定延迟(ms)   -j 额外的随机延迟上限(ms)
+*   -r 脚本文件                 -e 注入错误 code:概率，逗号分隔；2006/2013是客户端错误码，注入方式是直接断开连接
+*   -i 空闲多久断开连接(ms)，和wait_timeout一样，客户端下一次执行得到2006/2013
+*   -v 打印收到的语句
+*
+* 脚本每行一条规则，第一条匹配的生效，#开头是注释：
+*   正则(不区分大小写，search匹配) => [delay 毫秒] 响应
+* 响应：
+*   ok [影响行数] [last_insert_id]
+*   error 错误码 错误信息
+*   rows 列1,列2|值1,值2|值1,值2      (\N表示NULL，值里不能有逗号和|)
+*   drop                               (断开连接，客户端得到2013)
+* 例如:
+*   ^SELECT status FROM T_TaskRecord => rows status|1
+*   ^INSERT INTO T_TSRecord => error 1062 Duplicate entry '1' for key 'PRIMARY'
+*   ^UPDATE T_TaskRecord => delay 50 ok 1
+* 预处理语句执行时把参数代入sql后再匹配。
+* 内置：SELECT CONNECTION_ID()、SELECT @@变量、SHOW VARIABLES、KILL [QUERY] id、事务语句；
+* 语句带MAX_EXECUTION_TIME(n)提示且延迟超过n时返回3024。其他SELECT/SHOW返回空结果集，其他语句返回ok 0
+*/
+#include <map>
+#include <mutex>
+#include <regex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace
+{
+enum E_CAPABILITY
+{
+    E_CLIENT_LONG_PASSWORD = 0x00000001,
+    E_CLIENT_FOUND_ROWS = 0x00000002,
+    E_CLIENT_LONG_FLAG = 0x00000004,
+    E_CLIENT_CONNECT_WITH_DB = 0x00000008,
+    E_CLIENT_PROTOCOL_41 = 0x00000200,
+    E_CLIENT_TRANSACTIONS = 0x00002000,
+    E_CLIENT_SECURE_CONNECTION = 0x00008000,
+    E_CLIENT_MULTI_STATEMENTS = 0x00010000,
+    E_CLIENT_MULTI_RESULTS = 0x00020000,
+    E_CLIENT_PS_MULTI_RESULTS = 0x00040000,
+    E_CLIENT_PLUGIN_AUTH = 0x00080000,
+    E_CLIENT_CONNECT_ATTRS = 0x00100000,
+    E_CLIENT_PLUGIN_AUTH_LENENC = 0x00200000
+};
+
+enum E_SERVER_STATUS
+{
+    E_STATUS_IN_TRANS = 0x0001,
+    E_STATUS_AUTOCOMMIT = 0x0002,
+    E_STATUS_MORE_RESULTS = 0x0008
+};
+
+enum E_COMMAND
+{
+    E_COM_QUIT = 0x01,
+    E_COM_INIT_DB = 0x02,
+    E_COM_QUERY = 0x03,
+    E_COM_PING = 0x0e,
+    E_COM_CHANGE_USER = 0x11,
+    E_COM_STMT_PREPARE = 0x16,
+    E_COM_STMT_EXECUTE = 0x17,
+    E_COM_STMT_CLOSE = 0x19,
+    E_COM_STMT_RESET = 0x1a,
+    E_COM_RESET_CONNECTION = 0x1f
+};
+
+const uint8_t kTypeVarString = 253;
+const uint32_t kServerCapabilities = E_CLIENT_LONG_PASSWORD | E_CLIENT_FOUND_ROWS | E_CLIENT_LONG_FLAG |
+                                     E_CLIENT_CONNECT_WITH_DB | E_CLIENT_PROTOCOL_41 | E_CLIENT_TRANSACTIONS |
+                                     E_CLIENT_SECURE_CONNECTION | E_CLIENT_MULTI_STATEMENTS | E_CLIENT_MULTI_RESULTS |
+                                     E_CLIENT_PS_MULTI_RESULTS | E_CLIENT_PLUGIN_AUTH | E_CLIENT_CONNECT_ATTRS |
+                                     E_CLIENT_PLUGIN_AUTH_LENENC;
+
+struct Cell
+{
+    bool is_null = false;
+    std::string value;
+};
+
+enum E_RESPONSE_KIND
+{
+    E_RESP_OK = 0,
+    E_RESP_ERROR = 1,
+    E_RESP_ROWS = 2,
+    E_RESP_DROP = 3
+};
+
+struct Response
+{
+    E_RESPONSE_KIND kind = E_RESP_OK;
+    uint32_t delay_ms = 0;
+    uint64_t affected = 0;
+    uint64_t insert_id = 0;
+    uint16_t error_code = 0;
+    std::string message;
+    std::vector<std::string> columns;
+    std::vector<std::vector<Cell>> rows;
+};
+
+struct Rule
+{
+    std::string pattern;
+    std::regex re;
+    Response response;
+};
+
+struct ServerConfig
+{
+    uint16_t port = 3307;
+    uint32_t delay_ms = 0;
+    uint32_t jitter_ms = 0;
+    uint32_t idle_ms = 0;
+    bool verbose = false;
+    std::vector<std::pair<uint16_t, double>> error_rates;
+    std::vector<Rule> rules;
+};
+
+ServerConfig g_config;
+std::atomic<uint32_t> g_next_conn_id{1};
+std::atomic<uint64_t> g_queries{0};
+
+std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (true)
+    {
+        size_t pos = s.find(sep, begin);
+        parts.emplace_back(s.substr(begin, pos == std::string::npos ? std::string::npos : pos - begin));
+        if (pos == std::string::npos)
+        {
+            break;
+        }
+        begin = pos + 1;
+    }
+    return parts;
+}
+
+std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+    {
+        return "";
+    }
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+bool startsWithNoCase(const std::string &s, const char *prefix)
+{
+    return strncasecmp(s.c_str(), prefix, strlen(prefix)) == 0;
+}
+
+const char *sqlState(uint16_t code)
+{
+    switch (code)
+    {
+    case 1062:
+        return "23000";
+    case 1213:
+        return "40001";
+    case 1317:
+        return "70100";
+    case 1064:
+        return "42000";
+    default:
+        return "HY000";
+    }
+}
+
+std::string defaultMessage(uint16_t code)
+{
+    switch (code)
+    {
+    case 1062:
+        return "Duplicate entry 'fake' for key 'PRIMARY'";
+    case 1213:
+        return "Deadlock found when trying to get lock; try restarting transaction";
+    case 1205:
+        return "Lock wait timeout exceeded; try restarting transaction";
+    case 1317:
+        return "Query execution was interrupted";
+    case 3024:
+        return "Query execution was interrupted, maximum statement execution time exceeded";
+    default:
+        return "Injected error " + std::to_string(code);
+    }
+}
+
+/*
+* @fun:解析一条响应，例如"delay 5 rows id,name|1,a"
+* @return false：格式不对
+*/
+bool parseResponse(const std::string &text, Response &resp)
+{
+    std::string rest = trim(text);
+    if (startsWithNoCase(rest, "delay "))
+    {
+        rest = trim(rest.substr(6));
+        size_t end = rest.find_first_of(" \t");
+        resp.delay_ms = static_cast<uint32_t>(strtoul(rest.substr(0, end).c_str(), nullptr, 10));
+        rest = end == std::string::npos ? "" : trim(rest.substr(end));
+    }
+
+    if (startsWithNoCase(rest, "ok"))
+    {
+        resp.kind = E_RESP_OK;
+        std::vector<std::string> args = split(trim(rest.substr(2)), ' ');
+        resp.affected = args.size() > 0 ? strtoull(args[0].c_str(), nullptr, 10) : 0;
+        resp.insert_id = args.size() > 1 ? strtoull(args[1].c_str(), nullptr, 10) : 0;
+        return true;
+    }
+    if (startsWithNoCase(rest, "error "))
+    {
+        resp.kind = E_RESP_ERROR;
+        rest = trim(rest.substr(6));
+        size_t end = rest.find_first_of(" \t");
+        resp.error_code = static_cast<uint16_t>(strtoul(rest.substr(0, end).c_str(), nullptr, 10));
+        resp.message = end == std::string::npos ? defaultMessage(resp.error_code) : trim(rest.substr(end));
+        return resp.error_code > 0;
+    }
+    if (startsWithNoCase(rest, "rows "))
+    {
+        resp.kind = E_RESP_ROWS;
+        std::vector<std::string> parts = split(trim(rest.substr(5)), '|');
+        resp.columns = split(trim(parts[0]), ',');
+        for (size_t i = 1; i < parts.size(); i++)
+        {
+            std::vector<std::string> values = split(trim(parts[i]), ',');
+            if (values.size() != resp.columns.size())
+            {
+                return false;
+            }
+            resp.rows.emplace_back();
+            for (const auto &v : values)
+            {
+                Cell c;
+                c.is_null = v == "\\N";
+                c.value = c.is_null ? "" : v;
+                resp.rows.back().push_back(c);
+            }
+        }
+        return true;
+    }
+    if (startsWithNoCase(rest, "drop"))
+    {
+        resp.kind = E_RESP_DROP;
+        return true;
+    }
+    return false;
+}
+
+int loadRules(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "open rules file failed:" << path << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line))
+    {
+        line_no++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        size_t pos = line.find("=>");
+        Rule rule;
+        if (pos == std::string::npos || !parseResponse(line.substr(pos + 2), rule.response))
+        {
+            std::cerr << "bad rule at line " << line_no << ":" << line << std::endl;
+            return -1;
+        }
+        rule.pattern = trim(line.substr(0, pos));
+        try
+        {
+            rule.re = std::regex(rule.pattern, std::regex::icase | std::regex::ECMAScript);
+        }
+        catch (std::regex_error &e)
+        {
+            std::cerr << "bad regex at line " << line_no << ":" << e.what() << std::endl;
+            return -1;
+        }
+        g_config.rules.emplace_back(std::move(rule));
+    }
+    return 0;
+}
+
+/*
+* 正在执行的语句可以被KILL QUERY中止，KILL连接时同时关闭socket
+*/
+class KillSwitch
+{
+  public:
+    explicit KillSwitch(int fd)
+    {
+        fd_ = fd;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        killed_ = false;
+    }
+
+    void kill(bool close_conn)
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        killed_ = true;
+        if (close_conn)
+        {
+            shutdown(fd_, SHUT_RDWR);
+        }
+        cv_.notify_all();
+    }
+
+    //return true：睡满了；false：被KILL
+    bool sleepFor(uint32_t ms)
+    {
+        std::unique_lock<std::mutex> lck(mutex_);
+        return !cv_.wait_for(lck, std::chrono::milliseconds(ms), [this]() {
+            return killed_;
+        });
+    }
+
+    bool killed()
+    {
+        std::lock_guard<std::mutex> lck(mutex_);
+        return killed_;
+    }
+
+  private:
+    int fd_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool killed_ = false;
+};
+
+std::mutex g_sessions_mutex;
+std::map<uint32_t, std::shared_ptr<KillSwitch>> g_sessions;
+
+class Packet
+{
+  public:
+    void u8(uint8_t v)
+    {
+        data_.push_back(static_cast<char>(v));
+    }
+
+    void u16(uint16_t v)
+    {
+        u8(v & 0xff);
+        u8(v >> 8);
+    }
+
+    void u32(uint32_t v)
+    {
+        u16(v & 0xffff);
+        u16(v >> 16);
+    }
+
+    void lenenc(uint64_t v)
+    {
+        if (v < 251)
+        {
+            u8(static_cast<uint8_t>(v));
+        }
+        else if (v < 65536)
+        {
+            u8(0xfc);
+            u16(static_cast<uint16_t>(v));
+        }
+        else if (v < 16777216)
+        {
+            u8(0xfd);
+            u16(v & 0xffff);
+            u8((v >> 16) & 0xff);
+        }
+        else
+        {
+            u8(0xfe);
+            u32(v & 0xffffffff);
+            u32(v >> 32);
+        }
+    }
+
+    void lenencStr(const std::string &s)
+    {
+        lenenc(s.size());
+        data_ += s;
+    }
+
+    void str(const std::string &s)
+    {
+        data_ += s;
+    }
+
+    void strNul(const std::string &s)
+    {
+        data_ += s;
+        data_.push_back('\0');
+    }
+
+    void zeros(size_t n)
+    {
+        data_.append(n, '\0');
+    }
+
+    const std::string &data() const
+    {
+        return data_;
+    }
+
+  private:
+    std::string data_;
+};
+
+class Reader
+{
+  public:
+    explicit Reader(const std::string &data)
+        : data_(data)
+    {
+    }
+
+    bool ok() const
+    {
+        return ok_;
+    }
+
+    size_t left() const
+    {
+        return pos_ <= data_.size() ? data_.size() - pos_ : 0;
+    }
+
+    uint64_t fixed(size_t n)
+    {
+        if (left() < n)
+        {
+            ok_ = false;
+            pos_ = data_.size();
+            return 0;
+        }
+        uint64_t v = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            v |= static_cast<uint64_t>(static_cast<uint8_t>(data_[pos_ + i])) << (8 * i);
+        }
+        pos_ += n;
+        return v;
+    }
+
+    uint64_t lenenc()
+    {
+        uint8_t first = static_cast<uint8_t>(fixed(1));
+        if (first < 251)
+        {
+            return first;
+        }
+        if (first == 0xfc)
+        {
+            return fixed(2);
+        }
+        if (first == 0xfd)
+        {
+            return fixed(3);
+        }
+        return fixed(8);
+    }
+
+    std::string bytes(size_t n)
+    {
+        if (left() < n)
+        {
+            ok_ = false;
+            pos_ = data_.size();
+            return "";
+        }
+        std::string s = data_.substr(pos_, n);
+        pos_ += n;
+        return s;
+    }
+
+    std::string strNul()
+    {
+        size_t end = data_.find('\0', pos_);
+        if (end == std::string::npos)
+        {
+            return bytes(left());
+        }
+        std::string s = data_.substr(pos_, end - pos_);
+        pos_ = end + 1;
+        return s;
+    }
+
+    std::string rest()
+    {
+        return bytes(left());
+    }
+
+  private:
+    const std::string &data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+struct PreparedStmt
+{
+    std::string sql;
+    uint16_t param_count = 0;
+    std::vector<uint16_t> param_types;
+};
+
+class Session
+{
+  public:
+    explicit Session(int fd)
+    {
+        fd_ = fd;
+        conn_id_ = g_next_conn_id++;
+        kill_switch_ = std::make_shared<KillSwitch>(fd);
+        std::lock_guard<std::mutex> lck(g_sessions_mutex);
+        g_sessions[conn_id_] = kill_switch_;
+    }
+
+    ~Session()
+    {
+        {
+            std::lock_guard<std::mutex> lck(g_sessions_mutex);
+            g_sessions.erase(conn_id_);
+        }
+        close(fd_);
+    }
+
+    void run()
+    {
+        if (handshake() != 0)
+        {
+            return;
+        }
+
+        std::string payload;
+        while (true)
+        {
+            if (g_config.idle_ms > 0)
+            {
+                pollfd pfd;
+                pfd.fd = fd_;
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, g_config.idle_ms) == 0)
+                { //空闲超时，和wait_timeout一样直接断开
+                    return;
+                }
+            }
+
+            if (readPacket(payload) != 0 || payload.empty())
+            {
+                return;
+            }
+            kill_switch_->reset();
+            if (dispatch(payload) != 0)
+            {
+                return;
+            }
+        }
+    }
+
+  private:
+    int handshake()
+    {
+        std::string salt(20, '\0');
+        for (auto &c : salt)
+        {
+            c = static_cast<char>('!' + rand() % 90);
+        }
+
+        Packet p;
+        p.u8(10);
+        p.strNul("8.0.0-fake");
+        p.u32(conn_id_);
+        p.str(salt.substr(0, 8));
+        p.u8(0);
+        p.u16(kServerCapabilities & 0xffff);
+        p.u8(33); //utf8_general_ci
+        p.u16(status_);
+        p.u16(kServerCapabilities >> 16);
+        p.u8(21);
+        p.zeros(10);
+        p.str(salt.substr(8));
+        p.u8(0);
+        p.strNul("mysql_native_password");
+        seq_ = 0;
+        if (writePacket(p) != 0)
+        {
+            return -1;
+        }
+
+        std::string payload;
+        if (readPacket(payload) != 0)
+        {
+            return -1;
+        }
+        Reader r(payload);
+        client_caps_ = static_cast<uint32_t>(r.fixed(4));
+        r.fixed(4 + 1 + 23);
+        r.strNul(); //用户名
+        if (client_caps_ & E_CLIENT_PLUGIN_AUTH_LENENC)
+        {
+            r.bytes(r.lenenc());
+        }
+        else if (client_caps_ & E_CLIENT_SECURE_CONNECTION)
+        {
+            r.bytes(r.fixed(1));
+        }
+        else
+        {
+            r.strNul();
+        }
+        if ((client_caps_ & E_CLIENT_CONNECT_WITH_DB) && r.left() > 0)
+        {
+            r.strNul();
+        }
+        std::string plugin;
+        if ((client_caps_ & E_CLIENT_PLUGIN_AUTH) && r.left() > 0)
+        {
+            plugin = r.strNul();
+        }
+        if (!r.ok())
+        {
+            return -1;
+        }
+
+        if (!plugin.empty() && plugin != "mysql_native_password")
+        { //让客户端切换到mysql_native_password，密码不校验
+            Packet sw;
+            sw.u8(0xfe);
+            sw.strNul("mysql_native_password");
+            sw.str(salt);
+            sw.u8(0);
+            if (writePacket(sw) != 0 || readPacket(payload) != 0)
+            {
+                return -1;
+            }
+        }
+        return writeOk(0, 0);
+    }
+
+    int dispatch(const std::string &payload)
+    {
+        uint8_t cmd = static_cast<uint8_t>(payload[0]);
+        std::string body = payload.substr(1);
+        switch (cmd)
+        {
+        case E_COM_QUIT:
+            return -1;
+        case E_COM_PING:
+        case E_COM_INIT_DB:
+        case E_COM_RESET_CONNECTION:
+        case E_COM_CHANGE_USER:
+            return writeOk(0, 0);
+        case E_COM_QUERY:
+            return onQuery(body);
+        case E_COM_STMT_PREPARE:
+            return onPrepare(body);
+        case E_COM_STMT_EXECUTE:
+            return onExecute(body);
+        case E_COM_STMT_CLOSE:
+            if (body.size() >= 4)
+            {
+                stmts_.erase(Reader(body).fixed(4));
+            }
+            return 0; //没有响应
+        case E_COM_STMT_RESET:
+            return writeOk(0, 0);
+        default:
+            return writeError(1047, "Unknown command");
+        }
+    }
+
+    int onQuery(const std::string &sql)
+    {
+        std::vector<std::string> statements;
+        if (client_caps_ & E_CLIENT_MULTI_STATEMENTS)
+        {
+            statements = splitStatements(sql);
+        }
+        else
+        {
+            statements.push_back(sql);
+        }
+
+        for (size_t i = 0; i < statements.size(); i++)
+        {
+            bool more = i + 1 < statements.size();
+            Response resp;
+            int ret = execute(statements[i], resp);
+            if (ret != 0)
+            {
+                return ret;
+            }
+            if (resp.kind == E_RESP_ERROR)
+            { //出错后后面的语句不再执行
+                return writeError(resp.error_code, resp.message);
+            }
+            ret = resp.kind == E_RESP_ROWS ? writeTextRows(resp, more) : writeOk(resp.affected, resp.insert_id, more);
+            if (ret != 0)
+            {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    int onPrepare(const std::string &sql)
+    {
+        if (g_config.verbose)
+        {
+            std::cout << "[" << conn_id_ << "] prepare:" << sql << std::endl;
+        }
+
+        PreparedStmt stmt;
+        stmt.sql = sql;
+        stmt.param_count = countParams(sql);
+        Response resp = match(sql); //只用来确定结果集的列数
+        uint16_t column_count = resp.kind == E_RESP_ROWS ? static_cast<uint16_t>(resp.columns.size()) : 0;
+        uint32_t stmt_id = ++next_stmt_id_;
+        stmts_[stmt_id] = stmt;
+
+        Packet p;
+        p.u8(0);
+        p.u32(stmt_id);
+        p.u16(column_count);
+        p.u16(stmt.param_count);
+        p.u8(0);
+        p.u16(0);
+        if (writePacket(p) != 0)
+        {
+            return -1;
+        }
+        if (stmt.param_count > 0)
+        {
+            for (uint16_t i = 0; i < stmt.param_count; i++)
+            {
+                if (writeColumnDef("?") != 0)
+                {
+                    return -1;
+                }
+            }
+            if (writeEof(false) != 0)
+            {
+                return -1;
+            }
+        }
+        if (column_count > 0)
+        {
+            for (const auto &c : resp.columns)
+            {
+                if (writeColumnDef(c) != 0)
+                {
+                    return -1;
+                }
+            }
+            if (writeEof(false) != 0)
+            {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    int onExecute(const std::string &body)
+    {
+        Reader r(body);
+        uint32_t stmt_id = static_cast<uint32_t>(r.fixed(4));
+        r.fixed(1 + 4); //flags, iteration_count
+        auto it = stmts_.find(stmt_id);
+        if (!r.ok() || it == stmts_.end())
+        {
+            return writeError(1243, "Unknown prepared statement handler");
+        }
+
+        PreparedStmt &stmt = it->second;
+        std::vector<Cell> params(stmt.param_count);
+        if (stmt.param_count > 0)
+        {
+            std::string null_bitmap = r.bytes((stmt.param_count + 7) / 8);
+            if (r.fixed(1) == 1)
+            {
+                stmt.param_types.clear();
+                for (uint16_t i = 0; i < stmt.param_count; i++)
+                {
+                    stmt.param_types.push_back(static_cast<uint16_t>(r.fixed(2)));
+                }
+            }
+            if (stmt.param_types.size() != stmt.param_count)
+            {
+                return writeError(1210, "Incorrect arguments to mysqld_stmt_execute");
+            }
+            for (uint16_t i = 0; i < stmt.param_count; i++)
+            {
+                if (static_cast<uint8_t>(null_bitmap[i / 8]) & (1 << (i % 8)))
+                {
+                    params[i].is_null = true;
+                    continue;
+                }
+                params[i].value = readBinaryValue(r, stmt.param_types[i] & 0xff, stmt.param_types[i] & 0x8000);
+            }
+            if (!r.ok())
+            {
+                return writeError(1210, "Incorrect arguments to mysqld_stmt_execute");
+            }
+        }
+
+        Response resp;
+        int ret = execute(bindParams(stmt.sql, params, stmt.param_types), resp);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (resp.kind == E_RESP_ERROR)
+        {
+            return writeError(resp.error_code, resp.message);
+        }
+        return resp.kind == E_RESP_ROWS ? writeBinaryRows(resp) : writeOk(resp.affected, resp.insert_id);
+    }
+
+    /*
+    * @fun:按配置和脚本得到一条语句的响应，包括延迟、注入的错误和断连
+    * @return 0：resp有效；-1：连接要断开
+    */
+    int execute(const std::string &sql, Response &resp)
+    {
+        g_queries++;
+        if (g_config.verbose)
+        {
+            std::cout << "[" << conn_id_ << "] " << sql << std::endl;
+        }
+
+        resp = match(sql);
+        for (const auto &er : g_config.error_rates)
+        {
+            if (random01() < er.second)
+            {
+                if (er.first == 2006 || er.first == 2013)
+                { //客户端错误码，只能靠断开连接产生
+                    resp.kind = E_RESP_DROP;
+                }
+                else
+                {
+                    resp.kind = E_RESP_ERROR;
+                    resp.error_code = er.first;
+                    resp.message = defaultMessage(er.first);
+                }
+                break;
+            }
+        }
+
+        uint32_t delay = g_config.delay_ms + resp.delay_ms;
+        if (g_config.jitter_ms > 0)
+        {
+            delay += static_cast<uint32_t>(random01() * g_config.jitter_ms);
+        }
+        int64_t limit = maxExecutionTime(sql);
+        bool timeout = limit > 0 && delay > limit;
+        if (timeout)
+        {
+            delay = static_cast<uint32_t>(limit);
+        }
+        if (delay > 0 && !kill_switch_->sleepFor(delay))
+        {
+            resp = Response();
+            resp.kind = E_RESP_ERROR;
+            resp.error_code = 1317;
+            resp.message = defaultMessage(1317);
+        }
+        else if (timeout)
+        {
+            resp = Response();
+            resp.kind = E_RESP_ERROR;
+            resp.error_code = 3024;
+            resp.message = defaultMessage(3024);
+        }
+        return resp.kind == E_RESP_DROP ? -1 : 0;
+    }
+
+    Response match(const std::string &sql)
+    {
+        for (const auto &rule : g_config.rules)
+        {
+            if (std::regex_search(sql, rule.re))
+            {
+                return rule.response;
+            }
+        }
+        return builtin(trim(sql));
+    }
+
+    Response builtin(const std::string &sql)
+    {
+        Response resp;
+        if (startsWithNoCase(sql, "SELECT CONNECTION_ID()"))
+        {
+            return rows({"CONNECTION_ID()"}, {std::to_string(conn_id_)});
+        }
+        if (startsWithNoCase(sql, "SELECT @@"))
+        {
+            std::vector<std::string> names = split(sql.substr(7), ',');
+            std::vector<std::string> values;
+            for (auto &n : names)
+            {
+                n = trim(n);
+                size_t end = n.find_first_of(" \t");
+                n = n.substr(0, end);
+                values.push_back(variable(n));
+            }
+            return rows(names, values);
+        }
+        if (startsWithNoCase(sql, "SHOW"))
+        {
+            resp.kind = E_RESP_ROWS;
+            resp.columns = {"Variable_name", "Value"};
+            size_t q1 = sql.find('\'');
+            size_t q2 = q1 == std::string::npos ? q1 : sql.find('\'', q1 + 1);
+            if (q2 != std::string::npos)
+            {
+                std::string name = sql.substr(q1 + 1, q2 - q1 - 1);
+                std::string value = variable(name);
+                if (!value.empty())
+                {
+                    resp.rows.push_back({Cell{false, name}, Cell{false, value}});
+                }
+            }
+            return resp;
+        }
+        if (startsWithNoCase(sql, "KILL"))
+        {
+            return kill(sql);
+        }
+        if (startsWithNoCase(sql, "SELECT"))
+        { //没有脚本时返回空结果集
+            resp.kind = E_RESP_ROWS;
+            resp.columns = {"1"};
+            return resp;
+        }
+
+        if (startsWithNoCase(sql, "BEGIN") || startsWithNoCase(sql, "START TRANSACTION"))
+        {
+            status_ |= E_STATUS_IN_TRANS;
+        }
+        else if (startsWithNoCase(sql, "COMMIT") || startsWithNoCase(sql, "ROLLBACK"))
+        {
+            status_ &= ~E_STATUS_IN_TRANS;
+        }
+        else if (startsWithNoCase(sql, "SET"))
+        {
+            std::string s = sql;
+            s.erase(std::remove(s.begin(), s.end(), ' '), s.end());
+            if (strcasestr(s.c_str(), "autocommit=0") != nullptr)
+            {
+                status_ &= ~E_STATUS_AUTOCOMMIT;
+            }
+            else if (strcasestr(s.c_str(), "autocommit=1") != nullptr)
+            {
+                status_ |= E_STATUS_AUTOCOMMIT;
+                status_ &= ~E_STATUS_IN_TRANS;
+            }
+        }
+        return resp;
+    }
+
+    Response kill(const std::string &sql)
+    {
+        std::string rest = trim(sql.substr(4));
+        bool query_only = startsWithNoCase(rest, "QUERY");
+        if (query_only || startsWithNoCase(rest, "CONNECTION"))
+        {
+            rest = trim(rest.substr(query_only ? 5 : 10));
+        }
+        uint32_t target = static_cast<uint32_t>(strtoul(rest.c_str(), nullptr, 10));
+
+        Response resp;
+        std::shared_ptr<KillSwitch> ks;
+        {
+            std::lock_guard<std::mutex> lck(g_sessions_mutex);
+            auto it = g_sessions.find(target);
+            if (it != g_sessions.end())
+            {
+                ks = it->second;
+            }
+        }
+        if (!ks)
+        {
+            resp.kind = E_RESP_ERROR;
+            resp.error_code = 1094;
+            resp.message = "Unknown thread id: " + std::to_string(target);
+            return resp;
+        }
+        ks->kill(!query_only);
+        return resp;
+    }
+
+    std::string variable(std::string name)
+    {
+        for (const char *prefix : {"@@session.", "@@global.", "@@"})
+        {
+            if (startsWithNoCase(name, prefix))
+            {
+                name = name.substr(strlen(prefix));
+                break;
+            }
+        }
+        static const std::map<std::string, std::string> vars = {
+            {"max_allowed_packet", "67108864"},
+            {"version", "8.0.0-fake"},
+            {"version_comment", "fake_mysql_server"},
+            {"transaction_isolation", "REPEATABLE-READ"},
+            {"tx_isolation", "REPEATABLE-READ"},
+            {"lower_case_table_names", "0"},
+            {"sql_mode", "STRICT_TRANS_TABLES"},
+            {"character_set_client", "utf8mb4"},
+            {"character_set_connection", "utf8mb4"},
+            {"character_set_results", "utf8mb4"},
+            {"wait_timeout", "28800"},
+            {"net_write_timeout", "60"}};
+        if (strcasecmp(name.c_str(), "autocommit") == 0)
+        {
+            return (status_ & E_STATUS_AUTOCOMMIT) ? "1" : "0";
+        }
+        auto it = vars.find(name);
+        return it == vars.end() ? "" : it->second;
+    }
+
+    static Response rows(const std::vector<std::string> &columns, const std::vector<std::string> &values)
+    {
+        Response resp;
+        resp.kind = E_RESP_ROWS;
+        resp.columns = columns;
+        resp.rows.emplace_back();
+        for (const auto &v : values)
+        {
+            resp.rows.back().push_back(Cell{false, v});
+        }
+        return resp;
+    }
+
+    //MAX_EXECUTION_TIME(n)提示，没有返回-1
+    static int64_t maxExecutionTime(const std::string &sql)
+    {
+        const char *p = strcasestr(sql.c_str(), "MAX_EXECUTION_TIME(");
+        if (p == nullptr)
+        {
+            return -1;
+        }
+        return strtoll(p + strlen("MAX_EXECUTION_TIME("), nullptr, 10);
+    }
+
+    static double random01()
+    {
+        static thread_local std::minstd_rand engine(std::random_device{}());
+        return std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+    }
+
+    //按引号外的分号切分多语句
+    static std::vector<std::string> splitStatements(const std::string &sql)
+    {
+        std::vector<std::string> statements;
+        std::string cur;
+        char quote = 0;
+        for (size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (quote)
+            {
+                cur += c;
+                if (c == '\\' && i + 1 < sql.size())
+                {
+                    cur += sql[++i];
+                }
+                else if (c == quote)
+                {
+                    quote = 0;
+                }
+                continue;
+            }
+            if (c == '\'' || c == '"' || c == '`')
+            {
+                quote = c;
+            }
+            if (c == ';')
+            {
+                if (!trim(cur).empty())
+                {
+                    statements.push_back(trim(cur));
+                }
+                cur.clear();
+                continue;
+            }
+            cur += c;
+        }
+        if (!trim(cur).empty() || statements.empty())
+        {
+            statements.push_back(trim(cur));
+        }
+        return statements;
+    }
+
+    static uint16_t countParams(const std::string &sql)
+    {
+        uint16_t n = 0;
+        char quote = 0;
+        for (size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (quote)
+            {
+                if (c == '\\')
+                {
+                    i++;
+                }
+                else if (c == quote)
+                {
+                    quote = 0;
+                }
+            }
+            else if (c == '\'' || c == '"' || c == '`')
+            {
+                quote = c;
+            }
+            else if (c == '?')
+            {
+                n++;
+            }
+        }
+        return n;
+    }
+
+    //参数代入sql，字符串加引号，用于脚本匹配和日志
+    static std::string bindParams(const std::string &sql, const std::vector<Cell> &params, const std::vector<uint16_t> &types)
+    {
+        std::string out;
+        size_t idx = 0;
+        char quote = 0;
+        for (size_t i = 0; i < sql.size(); i++)
+        {
+            char c = sql[i];
+            if (quote)
+            {
+                out += c;
+                if (c == '\\' && i + 1 < sql.size())
+                {
+                    out += sql[++i];
+                }
+                else if (c == quote)
+                {
+                    quote = 0;
+                }
+                continue;
+            }
+            if (c == '\'' || c == '"' || c == '`')
+            {
+                quote = c;
+            }
+            if (c == '?' && idx < params.size())
+            {
+                uint8_t type = static_cast<uint8_t>(types[idx] & 0xff);
+                const Cell &p = params[idx++];
+                bool numeric = (type >= 1 && type <= 5) || type == 8 || type == 9;
+                out += p.is_null ? "NULL" : (numeric ? p.value : "'" + p.value + "'");
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    //二进制协议的参数值转成文本
+    static std::string readBinaryValue(Reader &r, uint8_t type, bool is_unsigned)
+    {
+        char buf[64];
+        switch (type)
+        {
+        case 1: //TINY
+            return is_unsigned ? std::to_string(static_cast<uint8_t>(r.fixed(1))) : std::to_string(static_cast<int8_t>(r.fixed(1)));
+        case 2:  //SHORT
+        case 13: //YEAR
+            return is_unsigned ? std::to_string(static_cast<uint16_t>(r.fixed(2))) : std::to_string(static_cast<int16_t>(r.fixed(2)));
+        case 3: //LONG
+        case 9: //INT24
+            return is_unsigned ? std::to_string(static_cast<uint32_t>(r.fixed(4))) : std::to_string(static_cast<int32_t>(r.fixed(4)));
+        case 8: //LONGLONG
+            return is_unsigned ? std::to_string(r.fixed(8)) : std::to_string(static_cast<int64_t>(r.fixed(8)));
+        case 4: //FLOAT
+        {
+            uint32_t bits = static_cast<uint32_t>(r.fixed(4));
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            snprintf(buf, sizeof(buf), "%.9g", f);
+            return buf;
+        }
+        case 5: //DOUBLE
+        {
+            uint64_t bits = r.fixed(8);
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            snprintf(buf, sizeof(buf), "%.17g", d);
+            return buf;
+        }
+        case 6: //NULL
+            return "";
+        case 7:  //TIMESTAMP
+        case 10: //DATE
+        case 12: //DATETIME
+        {
+            std::string v = r.bytes(r.fixed(1));
+            Reader t(v);
+            uint64_t year = t.fixed(2), month = t.fixed(1), day = t.fixed(1);
+            uint64_t hour = v.size() >= 7 ? t.fixed(1) : 0, minute = v.size() >= 7 ? t.fixed(1) : 0, second = v.size() >= 7 ? t.fixed(1) : 0;
+            snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u", (unsigned)year, (unsigned)month, (unsigned)day,
+                     (unsigned)hour, (unsigned)minute, (unsigned)second);
+            return buf;
+        }
+        case 11: //TIME
+        {
+            std::string v = r.bytes(r.fixed(1));
+            Reader t(v);
+            if (v.size() < 8)
+            {
+                return "00:00:00";
+            }
+            bool negative = t.fixed(1) == 1;
+            uint64_t days = t.fixed(4), hour = t.fixed(1), minute = t.fixed(1), second = t.fixed(1);
+            snprintf(buf, sizeof(buf), "%s%02u:%02u:%02u", negative ? "-" : "", (unsigned)(days * 24 + hour), (unsigned)minute, (unsigned)second);
+            return buf;
+        }
+        default: //字符串、DECIMAL、BLOB等都是lenenc字符串
+            return r.bytes(r.lenenc());
+        }
+    }
+
+    int writeOk(uint64_t affected, uint64_t insert_id, bool more = false)
+    {
+        Packet p;
+        p.u8(0);
+        p.lenenc(affected);
+        p.lenenc(insert_id);
+        p.u16(status_ | (more ? E_STATUS_MORE_RESULTS : 0));
+        p.u16(0);
+        return writePacket(p);
+    }
+
+    int writeError(uint16_t code, const std::string &message)
+    {
+        Packet p;
+        p.u8(0xff);
+        p.u16(code);
+        p.u8('#');
+        p.str(sqlState(code));
+        p.str(message);
+        return writePacket(p);
+    }
+
+    int writeEof(bool more)
+    {
+        Packet p;
+        p.u8(0xfe);
+        p.u16(0);
+        p.u16(status_ | (more ? E_STATUS_MORE_RESULTS : 0));
+        return writePacket(p);
+    }
+
+    int writeColumnDef(const std::string &name)
+    {
+        Packet p;
+        p.lenencStr("def");
+        p.lenencStr("fake");
+        p.lenencStr("t");
+        p.lenencStr("t");
+        p.lenencStr(name);
+        p.lenencStr(name);
+        p.u8(0x0c);
+        p.u16(33);
+        p.u32(255);
+        p.u8(kTypeVarString);
+        p.u16(0);
+        p.u8(0);
+        p.u16(0);
+        return writePacket(p);
+    }
+
+    int writeColumns(const Response &resp)
+    {
+        Packet count;
+        count.lenenc(resp.columns.size());
+        if (writePacket(count) != 0)
+        {
+            return -1;
+        }
+        for (const auto &c : resp.columns)
+        {
+            if (writeColumnDef(c) != 0)
+            {
+                return -1;
+            }
+        }
+        return writeEof(false);
+    }
+
+    int writeTextRows(const Response &resp, bool more)
+    {
+        if (writeColumns(resp) != 0)
+        {
+            return -1;
+        }
+        for (const auto &row : resp.rows)
+        {
+            Packet p;
+            for (const auto &c : row)
+            {
+                if (c.is_null)
+                {
+                    p.u8(0xfb);
+                }
+                else
+                {
+                    p.lenencStr(c.value);
+                }
+            }
+            if (writePacket(p) != 0)
+            {
+                return -1;
+            }
+        }
+        return writeEof(more);
+    }
+
+    int writeBinaryRows(const Response &resp)
+    {
+        if (writeColumns(resp) != 0)
+        {
+            return -1;
+        }
+        for (const auto &row : resp.rows)
+        {
+            Packet p;
+            p.u8(0);
+            std::string null_bitmap((row.size() + 7 + 2) / 8, '\0'); //二进制行的NULL位图偏移2位
+            for (size_t i = 0; i < row.size(); i++)
+            {
+                if (row[i].is_null)
+                {
+                    null_bitmap[(i + 2) / 8] |= static_cast<char>(1 << ((i + 2) % 8));
+                }
+            }
+            p.str(null_bitmap);
+            for (const auto &c : row)
+            {
+                if (!c.is_null)
+                {
+                    p.lenencStr(c.value);
+                }
+            }
+            if (writePacket(p) != 0)
+            {
+                return -1;
+            }
+        }
+        return writeEof(false);
+    }
+
+    //读一个完整的包，超过16M的包会被拆成多个
+    int readPacket(std::string &payload)
+    {
+        payload.clear();
+        while (true)
+        {
+            unsigned char header[4];
+            if (readFull(header, 4) != 0)
+            {
+                return -1;
+            }
+            size_t len = header[0] | (header[1] << 8) | (header[2] << 16);
+            seq_ = header[3] + 1;
+            size_t old = payload.size();
+            payload.resize(old + len);
+            if (len > 0 && readFull(&payload[old], len) != 0)
+            {
+                return -1;
+            }
+            if (len < 0xffffff)
+            {
+                return 0;
+            }
+        }
+    }
+
+    int writePacket(const Packet &p)
+    {
+        const std::string &data = p.data();
+        size_t offset = 0;
+        while (true)
+        {
+            size_t len = std::min<size_t>(data.size() - offset, 0xffffff);
+            unsigned char header[4] = {static_cast<unsigned char>(len & 0xff), static_cast<unsigned char>((len >> 8) & 0xff),
+                                       static_cast<unsigned char>((len >> 16) & 0xff), seq_++};
+            if (writeFull(header, 4) != 0 || (len > 0 && writeFull(data.data() + offset, len) != 0))
+            {
+                return -1;
+            }
+            offset += len;
+            if (len < 0xffffff)
+            {
+                return 0;
+            }
+        }
+    }
+
+    int readFull(void *buf, size_t len)
+    {
+        char *p = static_cast<char *>(buf);
+        while (len > 0)
+        {
+            ssize_t n = recv(fd_, p, len, 0);
+            if (n <= 0)
+            {
+                return -1;
+            }
+            p += n;
+            len -= n;
+        }
+        return 0;
+    }
+
+    int writeFull(const void *buf, size_t len)
+    {
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0)
+        {
+            ssize_t n = send(fd_, p, len, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return -1;
+            }
+            p += n;
+            len -= n;
+        }
+        return 0;
+    }
+
+    int fd_;
+    uint32_t conn_id_;
+    uint8_t seq_ = 0;
+    uint32_t client_caps_ = 0;
+    uint16_t status_ = E_STATUS_AUTOCOMMIT;
+    uint32_t next_stmt_id_ = 0;
+    std::map<uint32_t, PreparedStmt> stmts_;
+    std::shared_ptr<KillSwitch> kill_switch_;
+};
+
+int parseErrorRates(const std::string &arg)
+{
+    for (const auto &item : split(arg, ','))
+    {
+        std::vector<std::string> kv = split(item, ':');
+        if (kv.size() != 2)
+        {
+            return -1;
+        }
+        g_config.error_rates.emplace_back(static_cast<uint16_t>(strtoul(kv[0].c_str(), nullptr, 10)), strtod(kv[1].c_str(), nullptr));
+    }
+    return 0;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:j:r:e:i:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            g_config.port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case 'd':
+            g_config.delay_ms = static_cast<uint32_t>(atoi(optarg));
+            break;
+        case 'j':
+            g_config.jitter_ms = static_cast<uint32_t>(atoi(optarg));
+            break;
+        case 'r':
+            if (loadRules(optarg) != 0)
+            {
+                return 1;
+            }
+            break;
+        case 'e':
+            if (parseErrorRates(optarg) != 0)
+            {
+                std::cerr << "bad -e, expect code:rate[,code:rate]" << std::endl;
+                return 1;
+            }
+            break;
+        case 'i':
+            g_config.idle_ms = static_cast<uint32_t>(atoi(optarg));
+            break;
+        case 'v':
+            g_config.verbose = true;
+            break;
+        default:
+            std::cerr << "usage: " << argv[0] << " [-p port] [-d delay_ms] [-j jitter_ms] [-r rules] [-e code:rate,...] [-i idle_ms] [-v]" << std::endl;
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 1024) != 0)
+    {
+        perror("listen");
+        return 1;
+    }
+    std::cout << "fake mysql server listening on 127.0.0.1:" << g_config.port << ", " << g_config.rules.size() << " rules" << std::endl;
+
+    while (true)
+    {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        std::thread([fd]() {
+            Session session(fd);
+            session.run();
+        }).detach();
+    }
+    return 0;
+}
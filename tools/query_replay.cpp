@@ -0,0 +1,299 @@
+/*
+* 回放QueryCapture录制的语句，用于评估连接池配置能支撑的负载。
+* 录制时的每个连接对应一个回放线程，线程内按录制的时间间隔(除以倍速)顺序执行，保持原来的并发形态；
+* 执行通过MySqlConnPool借连接，连接池满时等待并统计次数。结束后输出吞吐、延迟分位数和落后于计划的时间。
+*
+* 编译: g++ -std=c++14 -O2 -pthread -I. -Idb_base tools/query_replay.cpp -lmysqlcppconn -o query_replay
+* 运行: ./query_replay -f capture.qcap -h 127.0.0.1 -P 3307 -u root -p pwd -D course -x 4 -i 10 -c 50
+*   -f 录制文件        -x 倍速，默认1，0表示不等待尽快执行
+*   -h/-P/-u/-p/-D 数据库地址、端口、用户、密码、库名，可以指向tools/fake_mysql_server
+*   -i/-c 连接池的初始连接数和最大连接数
+*   -w 只回放SELECT，用于对生产的从库回放
+*/
+#include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include "mysql_conn_pool.h"
+#include "query_capture.h"
+
+namespace
+{
+struct ReplayOptions
+{
+    std::string file;
+    std::string host = "127.0.0.1";
+    int port = 3306;
+    std::string user = "root";
+    std::string password;
+    std::string schema;
+    double speed = 1.0;
+    size_t init_conns = 10;
+    size_t max_conns = 50;
+    bool read_only = false;
+};
+
+ReplayOptions g_options;
+
+/*
+* MySqlConnPool需要的DB，按命令行参数建立连接
+*/
+class ReplayDB
+{
+  public:
+    using DISCONNECT_CB = std::function<void(ReplayDB *)>;
+
+    int connect()
+    {
+        try
+        {
+            sql::ConnectOptionsMap connection_properties;
+            connection_properties["hostName"] = g_options.host;
+            connection_properties["userName"] = g_options.user;
+            connection_properties["password"] = g_options.password;
+            connection_properties["schema"] = g_options.schema;
+            connection_properties["port"] = g_options.port;
+            connection_properties["OPT_RECONNECT"] = true;
+            connection_properties["CLIENT_MULTI_STATEMENTS"] = true;
+            con_.reset(sql::mysql::get_mysql_driver_instance()->connect(connection_properties));
+            return 0;
+        }
+        catch (sql::SQLException &e)
+        {
+            std::cerr << "connect failed, code=" << e.getErrorCode() << ":" << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    void onDisconnect(const DISCONNECT_CB &cb)
+    {
+        disconnect_cb_ = cb;
+    }
+
+    std::shared_ptr<sql::Connection> getConnection()
+    {
+        return con_;
+    }
+
+  private:
+    std::shared_ptr<sql::Connection> con_;
+    DISCONNECT_CB disconnect_cb_;
+};
+
+struct ReplayStats
+{
+    LatencyHistogram latency;         //从借连接开始到结果读完
+    LatencyHistogram acquire;         //借连接的等待
+    LatencyHistogram lag;             //实际开始时间落后于计划的时间
+    std::map<int, std::shared_ptr<LatencyHistogram>> op_latency;
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> exhausted{0}; //借连接时连接池已满的次数
+};
+
+//执行一条语句并读完所有结果集
+int executeSql(const std::shared_ptr<sql::Connection> &conn, const std::string &sql)
+{
+    try
+    {
+        std::shared_ptr<sql::Statement> stmt;
+        stmt.reset(conn->createStatement());
+        bool has_result = stmt->execute(sql);
+        do
+        {
+            if (has_result)
+            {
+                std::shared_ptr<sql::ResultSet> res;
+                res.reset(stmt->getResultSet());
+                while (res && res->next())
+                {
+                }
+            }
+            has_result = stmt->getMoreResults();
+        } while (has_result);
+        return 0;
+    }
+    catch (sql::SQLException &e)
+    {
+        return e.getErrorCode() > 0 ? e.getErrorCode() : -1;
+    }
+}
+
+void replayStream(const std::shared_ptr<MySqlConnPool<ReplayDB>> &pool, const std::vector<CapturedQuery> &queries,
+                  std::chrono::steady_clock::time_point begin, ReplayStats &stats)
+{
+    for (const auto &q : queries)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (g_options.speed > 0)
+        {
+            auto planned = begin + std::chrono::microseconds(static_cast<int64_t>(q.offset_us / g_options.speed));
+            if (planned > now)
+            {
+                std::this_thread::sleep_until(planned);
+                now = planned;
+            }
+            else
+            {
+                stats.lag.record(std::chrono::duration_cast<std::chrono::microseconds>(now - planned).count());
+            }
+        }
+
+        MySqlConnPool<ReplayDB>::DB_PTR lease;
+        while (!(lease = pool->getConnDB()))
+        { //连接池满，和业务一样只能稍后再试
+            stats.exhausted++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto acquired = std::chrono::steady_clock::now();
+        stats.acquire.record(std::chrono::duration_cast<std::chrono::microseconds>(acquired - now).count());
+
+        int err = executeSql(lease->getConnection(), q.sql);
+        lease.reset();
+        uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now).count();
+        stats.latency.record(latency_us);
+        stats.op_latency.at(q.op)->record(latency_us);
+        if (err != 0)
+        {
+            stats.errors++;
+        }
+    }
+}
+
+void usage(const char *prog)
+{
+    std::cerr << "usage: " << prog << " -f capture [-x speed] [-h host] [-P port] [-u user] [-p password] [-D schema]"
+              << " [-i init_conns] [-c max_conns] [-w]" << std::endl;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "f:x:h:P:u:p:D:i:c:w")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            g_options.file = optarg;
+            break;
+        case 'x':
+            g_options.speed = atof(optarg);
+            break;
+        case 'h':
+            g_options.host = optarg;
+            break;
+        case 'P':
+            g_options.port = atoi(optarg);
+            break;
+        case 'u':
+            g_options.user = optarg;
+            break;
+        case 'p':
+            g_options.password = optarg;
+            break;
+        case 'D':
+            g_options.schema = optarg;
+            break;
+        case 'i':
+            g_options.init_conns = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'c':
+            g_options.max_conns = static_cast<size_t>(atoi(optarg));
+            break;
+        case 'w':
+            g_options.read_only = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (g_options.file.empty() || g_options.max_conns <= g_options.init_conns)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    QueryCaptureReader reader;
+    if (reader.open(g_options.file) != 0)
+    {
+        std::cerr << "open capture failed:" << g_options.file << std::endl;
+        return 1;
+    }
+    std::map<uint64_t, std::vector<CapturedQuery>> streams;
+    ReplayStats stats;
+    uint64_t total = 0;
+    uint64_t last_offset_us = 0;
+    CapturedQuery q;
+    int ret = 0;
+    while ((ret = reader.next(q)) > 0)
+    {
+        if (g_options.read_only && q.op != E_OP_SELECT)
+        {
+            continue;
+        }
+        if (!stats.op_latency[q.op])
+        {
+            stats.op_latency[q.op] = std::make_shared<LatencyHistogram>();
+        }
+        last_offset_us = std::max(last_offset_us, q.offset_us);
+        streams[q.conn].push_back(q);
+        total++;
+    }
+    if (ret < 0)
+    {
+        std::cerr << "capture truncated after " << total << " queries, replaying what was read" << std::endl;
+    }
+    if (total == 0)
+    {
+        std::cerr << "nothing to replay" << std::endl;
+        return 1;
+    }
+
+    auto pool = std::make_shared<MySqlConnPool<ReplayDB>>();
+    if (pool->init(g_options.init_conns, g_options.max_conns) != 0)
+    {
+        std::cerr << "init pool failed" << std::endl;
+        return 1;
+    }
+    std::cout << "replaying " << total << " queries on " << streams.size() << " connections, captured over "
+              << formatUs(last_offset_us) << ", speed x" << g_options.speed << std::endl;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (const auto &s : streams)
+    {
+        threads.emplace_back(replayStream, pool, std::cref(s.second), begin, std::ref(stats));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed_s = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count() / 1e6;
+
+    printf("elapsed:    %.3fs\n", elapsed_s);
+    printf("throughput: %.1f qps\n", elapsed_s > 0 ? total / elapsed_s : 0.0);
+    printf("errors:     %llu\n", static_cast<unsigned long long>(stats.errors.load()));
+    printf("exhausted:  %llu\n", static_cast<unsigned long long>(stats.exhausted.load()));
+    std::cout << "latency:    " << latencySummary(stats.latency) << std::endl;
+    std::cout << "acquire:    " << latencySummary(stats.acquire) << std::endl;
+    std::cout << "behind:     " << stats.lag.count() << " queries started late, " << latencySummary(stats.lag) << std::endl;
+    for (const auto &kv : stats.op_latency)
+    {
+        printf("  %-8s %8llu  ", traceOpName(kv.first), static_cast<unsigned long long>(kv.second->count()));
+        std::cout << latencySummary(*kv.second) << std::endl;
+    }
+    return 0;
+}